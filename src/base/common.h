@@ -233,9 +233,12 @@ static const double kVerySmallNumberDouble = 1e-15;
 #define _MMX_DIV_PS _mm256_div_ps
 #define _MMX_SUB_PS _mm256_sub_ps
 #define _MMX_MUL_PS _mm256_mul_ps
+#define _MMX_AND_PS _mm256_and_ps
 #define _MMX_RSQRT_PS _mm256_rsqrt_ps
 #define _MMX_HADD_PS _mm256_hadd_ps
 #define _MMX_STORE_SS _mm256_storeu_ps
+#define _MMX_LOADU_PS _mm256_loadu_ps
+#define _MMX_STOREU_PS _mm256_storeu_ps
 #define _MMX_INCREMENT 8
 
 #else // SSE
@@ -248,10 +251,13 @@ static const double kVerySmallNumberDouble = 1e-15;
 #define _MMX_ADD_PS _mm_add_ps
 #define _MMX_SUB_PS _mm_sub_ps
 #define _MMX_MUL_PS _mm_mul_ps
+#define _MMX_AND_PS _mm_and_ps
 #define _MMX_DIV_PS _mm_div_ps
 #define _MMX_RSQRT_PS _mm_rsqrt_ps
 #define _MMX_HADD_PS _mm_hadd_ps
 #define _MMX_STORE_SS _mm_store_ss
+#define _MMX_LOADU_PS _mm_loadu_ps
+#define _MMX_STOREU_PS _mm_storeu_ps
 #define _MMX_INCREMENT 4
 
 #endif
@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file benchmarks the wTx scatter and the gradient dot product on the
+binary columns of a block, stored in SparseRows (an index and a value
+per entry) and as bitmaps (see column_codec.h), for a range of column
+densities.
+
+  bitmap_column_benchmark [block_size] [num_columns] [num_rounds]
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/stl-util.h"
+#include "src/data/column_codec.h"
+#include "src/data/data_structure.h"
+
+using namespace f2m;
+
+// Build num_columns binary columns, each of about density of the
+// block_size samples.
+void BuildRows(int block_size, int num_columns, double density,
+               std::vector<SparseRow*>* rows) {
+  std::mt19937 rng(2016);
+  std::bernoulli_distribution has(density);
+  std::vector<index_t> idx;
+  for (int j = 0; j < num_columns; ++j) {
+    idx.clear();
+    for (int i = 0; i < block_size; ++i) {
+      if (has(rng)) {
+        idx.push_back(i);
+      }
+    }
+    SparseRow* row = new SparseRow(idx.size());
+    row->id = j;
+    for (size_t k = 0; k < idx.size(); ++k) {
+      row->idx[k] = idx[k];
+      row->X[k] = 1.0;
+    }
+    rows->push_back(row);
+  }
+}
+
+// result += w^T x over the rows, and then grad[j] = result^T x_j.
+void SparseRowRound(const std::vector<SparseRow*>& rows,
+                    const std::vector<real_t>& w,
+                    std::vector<real_t>& result,
+                    std::vector<real_t>& grad) {
+  for (size_t j = 0; j < rows.size(); ++j) {
+    SparseRow* row = rows[j];
+    real_t w_j = w[j];
+    for (size_t k = 0; k < row->column_len; ++k) {
+      result[row->idx[k]] += w_j * row->X[k];
+    }
+  }
+  for (size_t j = 0; j < rows.size(); ++j) {
+    SparseRow* row = rows[j];
+    real_t g = 0;
+    for (size_t k = 0; k < row->column_len; ++k) {
+      g += result[row->idx[k]] * row->X[k];
+    }
+    grad[j] = g;
+  }
+}
+
+// The same round on the bitmap columns of the encoded block.
+void BitmapRound(const ColumnBlock& block,
+                 const std::vector<real_t>& w,
+                 std::vector<real_t>& result,
+                 std::vector<real_t>& grad) {
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(block, j, &value);
+    CHECK_NOTNULL(bits);
+    BitmapAdd(w[j] * value, bits, block.num_samples, result.data());
+  }
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(block, j, &value);
+    grad[j] = value * BitmapSum(bits, result.data(), block.num_samples);
+  }
+}
+
+double Milliseconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  int block_size = argc > 1 ? atoi(argv[1]) : 4096;
+  int num_columns = argc > 2 ? atoi(argv[2]) : 64;
+  int num_rounds = argc > 3 ? atoi(argv[3]) : 200;
+  const double kDensities[] = {0.3, 0.5, 0.75, 0.95};
+
+  printf("block size: %d, columns: %d, rounds: %d\n",
+         block_size, num_columns, num_rounds);
+  printf("density  SparseRow (ms)  bitmap (ms)  bytes / column  speedup\n");
+  for (double density : kDensities) {
+    std::vector<SparseRow*> rows;
+    BuildRows(block_size, num_columns, density, &rows);
+    std::vector<real_t> Y(block_size, 0);
+    ColumnArena plain, encoded;
+    plain.CopyFrom(Y, rows.data(), rows.size());
+    EncodeBlock(plain.block, &encoded);
+    std::vector<real_t> w(num_columns);
+    for (int j = 0; j < num_columns; ++j) {
+      w[j] = 0.01 * (j % 7) - 0.03;
+    }
+    std::vector<real_t> row_result(block_size, 0), row_grad(num_columns);
+    std::vector<real_t> bitmap_result(block_size, 0);
+    std::vector<real_t> bitmap_grad(num_columns);
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int r = 0; r < num_rounds; ++r) {
+      SparseRowRound(rows, w, row_result, row_grad);
+    }
+    double row_time = Milliseconds(start);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < num_rounds; ++r) {
+      BitmapRound(encoded.block, w, bitmap_result, bitmap_grad);
+    }
+    double bitmap_time = Milliseconds(start);
+
+    // Both layouts must give the same gradients, up to the order of
+    // the float additions.
+    for (int j = 0; j < num_columns; ++j) {
+      CHECK_LE(fabs(row_grad[j] - bitmap_grad[j]),
+               1e-3 * (1 + fabs(row_grad[j])));
+    }
+    printf("%7.3f  %14.2f  %11.2f  %14zu  %6.2fx\n",
+           density, row_time, bitmap_time,
+           static_cast<size_t>(encoded.block.col_offsets[1]),
+           row_time / bitmap_time);
+    STLDeleteElementsAndClear(&rows);
+  }
+  return 0;
+}
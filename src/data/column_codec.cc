@@ -0,0 +1,344 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of column_codec.h.
+*/
+
+#include "src/data/column_codec.h"
+
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+namespace f2m {
+
+// Number of bytes of the LEB128 varint of the value.
+static size_t VarintSize(index_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static uint8* PutVarint(index_t value, uint8* p) {
+  while (value >= 0x80) {
+    *p++ = static_cast<uint8>(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = static_cast<uint8>(value);
+  return p;
+}
+
+const uint32* BitMasks() {
+  static const std::vector<uint32> masks = [] {
+    std::vector<uint32> result(256 * 8);
+    for (int b = 0; b < 256; ++b) {
+      for (int k = 0; k < 8; ++k) {
+        result[b * 8 + k] = ((b >> k) & 1) ? 0xffffffff : 0;
+      }
+    }
+    return result;
+  }();
+  return masks.data();
+}
+
+// Choose the encodings of the column, and return its size in bytes
+// (rounded up to 4 bytes). The sample indices of the column are less
+// than num_samples.
+static size_t ChooseCodec(const index_t* idx,
+                          const real_t* X,
+                          index_t len,
+                          index_t num_samples,
+                          uint8* codec) {
+  size_t delta_size = 0;
+  index_t last = 0;
+  for (index_t k = 0; k < len; ++k) {
+    delta_size += VarintSize(idx[k] - last);
+    last = idx[k];
+  }
+  bool is_const = len > 0;
+  for (index_t k = 1; k < len && is_const; ++k) {
+    is_const = X[k] == X[0];
+  }
+  // A stored 0 would be taken as a missing sample of a dense column.
+  bool has_zero = false;
+  for (index_t k = 0; k < len && !has_zero; ++k) {
+    has_zero = X[k] == 0;
+  }
+  if (is_const && len == num_samples) {
+    *codec = MakeCodec(kIndexDense, kValueConst);
+    return sizeof(real_t);
+  }
+  if (is_const && len >= kMinBitmapRatio * num_samples) {
+    *codec = MakeCodec(kIndexBitmap, kValueConst);
+    return (sizeof(real_t) + (num_samples + 7) / 8 + 3) &
+           ~static_cast<size_t>(3);
+  }
+  if (!has_zero && len >= kMinDenseRatio * num_samples) {
+    *codec = MakeCodec(kIndexDense, kValuePlain);
+    return sizeof(real_t) * num_samples;
+  }
+  IndexCodec index_codec = kIndexPlain;
+  size_t size = sizeof(index_t) * len;
+  if (num_samples <= kMaxNarrowSamples) {
+    index_codec = kIndexNarrow;
+    size = sizeof(uint16) * len;
+  }
+  if (delta_size < size) {
+    index_codec = kIndexDelta;
+    size = delta_size;
+  }
+  ValueCodec value_codec = kValuePlain;
+  if (is_const) {
+    value_codec = kValueConst;
+    size += sizeof(real_t);
+  } else {
+    size += sizeof(real_t) * len;
+  }
+  *codec = MakeCodec(index_codec, value_codec);
+  return (size + 3) & ~static_cast<size_t>(3);
+}
+
+// Return the columns of each one-hot field of the block (see
+// column_codec.h), in the order of the field ids.
+static std::vector<std::vector<index_t>> FindCategorical(
+    const ColumnBlock& block) {
+  std::vector<std::vector<index_t>> result;
+  if (block.col_fields == nullptr) {
+    return result;
+  }
+  std::map<index_t, std::vector<index_t>> fields;
+  for (index_t j = 1; j < block.num_columns; ++j) {
+    fields[block.col_fields[j]].push_back(j);
+  }
+  std::vector<bool> seen(block.num_samples);
+  for (std::map<index_t, std::vector<index_t>>::const_iterator it =
+           fields.begin(); it != fields.end(); ++it) {
+    const std::vector<index_t>& columns = it->second;
+    if (columns.size() > kMaxFieldColumns) {
+      continue;
+    }
+    const real_t* value = block.X + block.col_ptr[columns[0]];
+    std::fill(seen.begin(), seen.end(), false);
+    index_t num_seen = 0;
+    bool is_one_hot = true;
+    for (size_t c = 0; c < columns.size() && is_one_hot; ++c) {
+      index_t j = columns[c];
+      is_one_hot = block.col_ptr[j+1] > block.col_ptr[j];
+      for (index_t k = block.col_ptr[j];
+           k < block.col_ptr[j+1] && is_one_hot; ++k) {
+        is_one_hot = block.X[k] == *value && !seen[block.idx[k]];
+        seen[block.idx[k]] = true;
+        ++num_seen;
+      }
+    }
+    if (is_one_hot && num_seen == block.num_samples) {
+      result.push_back(columns);
+    }
+  }
+  return result;
+}
+
+void EncodeBlock(const ColumnBlock& block, ColumnArena* arena) {
+  CHECK_NOTNULL(arena);
+  CHECK(block.col_codecs == nullptr);
+  index_t num_columns = block.num_columns;
+  arena->Y.assign(block.Y, block.Y + block.num_samples);
+  arena->col_ids.assign(block.col_ids, block.col_ids + num_columns);
+  arena->col_ptr.assign(block.col_ptr, block.col_ptr + num_columns + 1);
+  if (block.col_fields != nullptr) {
+    arena->col_fields.assign(block.col_fields,
+                             block.col_fields + num_columns);
+  } else {
+    arena->col_fields.clear();
+  }
+  if (block.weights != nullptr) {
+    arena->weights.assign(block.weights,
+                          block.weights + block.num_samples);
+  } else {
+    arena->weights.clear();
+  }
+  arena->idx.clear();
+  arena->X.clear();
+  // The first pass sizes the columns and the categorical fields, so
+  // packed is allocated once.
+  std::vector<std::vector<index_t>> fields = FindCategorical(block);
+  std::vector<index_t> field_of(num_columns, 0), code_of(num_columns, 0);
+  arena->col_codecs.assign(num_columns, MakeCodec(kIndexPlain, kValuePlain));
+  arena->categorical.resize(fields.size());
+  for (size_t f = 0; f < fields.size(); ++f) {
+    for (size_t c = 0; c < fields[f].size(); ++c) {
+      index_t j = fields[f][c];
+      arena->col_codecs[j] = MakeCodec(kIndexField, kValueConst);
+      field_of[j] = f;
+      code_of[j] = c;
+    }
+  }
+  arena->col_offsets.resize(num_columns + 1);
+  arena->col_offsets[0] = 0;
+  for (index_t j = 0; j < num_columns; ++j) {
+    index_t begin = block.col_ptr[j];
+    size_t size = sizeof(real_t) + 2 * sizeof(index_t);
+    if (IndexCodecOf(arena->col_codecs[j]) != kIndexField) {
+      size = ChooseCodec(block.idx + begin, block.X + begin,
+                         block.col_ptr[j+1] - begin,
+                         block.num_samples,
+                         &arena->col_codecs[j]);
+    }
+    arena->col_offsets[j+1] = arena->col_offsets[j] + size;
+  }
+  size_t packed_size = arena->col_offsets[num_columns];
+  for (size_t f = 0; f < fields.size(); ++f) {
+    CategoricalField& field = arena->categorical[f];
+    field.field = block.col_fields[fields[f][0]];
+    field.num_columns = fields[f].size();
+    field.code_size = field.num_columns <= 256 ? 1 : 2;
+    field.value = block.X[block.col_ptr[fields[f][0]]];
+    field.columns = packed_size;
+    field.codes = field.columns + sizeof(index_t) * field.num_columns;
+    packed_size = field.codes + field.code_size * block.num_samples;
+    packed_size = (packed_size + 3) & ~static_cast<size_t>(3);
+  }
+  arena->packed.assign(packed_size, 0);
+  for (index_t j = 0; j < num_columns; ++j) {
+    index_t begin = block.col_ptr[j];
+    index_t len = block.col_ptr[j+1] - begin;
+    uint8 codec = arena->col_codecs[j];
+    uint8* p = arena->packed.data() + arena->col_offsets[j];
+    if (IndexCodecOf(codec) == kIndexField) {
+      index_t ref[2] = { field_of[j], code_of[j] };
+      memcpy(p, block.X + begin, sizeof(real_t));
+      memcpy(p + sizeof(real_t), ref, sizeof(ref));
+      // The code of each sample of the column.
+      CategoricalField& field = arena->categorical[field_of[j]];
+      uint8* codes = arena->packed.data() + field.codes;
+      for (index_t k = begin; k < begin + len; ++k) {
+        if (field.code_size == 1) {
+          codes[block.idx[k]] = static_cast<uint8>(code_of[j]);
+        } else {
+          reinterpret_cast<uint16*>(codes)[block.idx[k]] =
+              static_cast<uint16>(code_of[j]);
+        }
+      }
+      continue;
+    }
+    if (IndexCodecOf(codec) == kIndexDense) {
+      if (ValueCodecOf(codec) == kValueConst) {
+        memcpy(p, block.X + begin, sizeof(real_t));
+      } else {
+        real_t* X = reinterpret_cast<real_t*>(p);
+        for (index_t k = begin; k < begin + len; ++k) {
+          X[block.idx[k]] = block.X[k];
+        }
+      }
+      continue;
+    }
+    if (IndexCodecOf(codec) == kIndexBitmap) {
+      memcpy(p, block.X + begin, sizeof(real_t));
+      uint8* bits = p + sizeof(real_t);
+      for (index_t k = begin; k < begin + len; ++k) {
+        bits[block.idx[k] >> 3] |= 1 << (block.idx[k] & 7);
+      }
+      continue;
+    }
+    if (ValueCodecOf(codec) == kValueConst) {
+      memcpy(p, block.X + begin, sizeof(real_t));
+      p += sizeof(real_t);
+    } else {
+      memcpy(p, block.X + begin, sizeof(real_t) * len);
+      p += sizeof(real_t) * len;
+    }
+    if (IndexCodecOf(codec) == kIndexPlain) {
+      memcpy(p, block.idx + begin, sizeof(index_t) * len);
+    } else if (IndexCodecOf(codec) == kIndexNarrow) {
+      uint16* idx = reinterpret_cast<uint16*>(p);
+      for (index_t k = 0; k < len; ++k) {
+        idx[k] = static_cast<uint16>(block.idx[begin + k]);
+      }
+    } else {
+      index_t last = 0;
+      for (index_t k = begin; k < begin + len; ++k) {
+        p = PutVarint(block.idx[k] - last, p);
+        last = block.idx[k];
+      }
+    }
+  }
+  for (size_t f = 0; f < fields.size(); ++f) {
+    memcpy(arena->packed.data() + arena->categorical[f].columns,
+           fields[f].data(), sizeof(index_t) * fields[f].size());
+  }
+  arena->UpdateView();
+}
+
+void DecodeBlock(const ColumnBlock& block, ColumnArena* arena) {
+  CHECK_NOTNULL(arena);
+  index_t num_columns = block.num_columns;
+  arena->Y.assign(block.Y, block.Y + block.num_samples);
+  arena->col_ids.assign(block.col_ids, block.col_ids + num_columns);
+  arena->col_ptr.assign(block.col_ptr, block.col_ptr + num_columns + 1);
+  if (block.col_fields != nullptr) {
+    arena->col_fields.assign(block.col_fields,
+                             block.col_fields + num_columns);
+  } else {
+    arena->col_fields.clear();
+  }
+  if (block.weights != nullptr) {
+    arena->weights.assign(block.weights,
+                          block.weights + block.num_samples);
+  } else {
+    arena->weights.clear();
+  }
+  arena->ClearCodecs();
+  arena->idx.resize(block.nnz);
+  arena->X.resize(block.nnz);
+  index_t* idx = arena->idx.data();
+  real_t* X = arena->X.data();
+  for (index_t j = 0; j < num_columns; ++j) {
+    if (IsCategorical(block, j)) {
+      continue;
+    }
+    index_t k = block.col_ptr[j];
+    ForEachEntry(block, j, [&](index_t i, real_t x) {
+      idx[k] = i;
+      X[k] = x;
+      ++k;
+    });
+  }
+  // The samples of a categorical field are put to their columns in one
+  // scan, so their indices are sorted.
+  for (index_t f = 0; f < block.num_categorical; ++f) {
+    const CategoricalField& field = block.categorical[f];
+    const index_t* columns = FieldColumns(block, field);
+    std::vector<index_t> pos(field.num_columns);
+    for (index_t c = 0; c < field.num_columns; ++c) {
+      pos[c] = block.col_ptr[columns[c]];
+    }
+    ForEachSample(block, field, [&](index_t i, index_t c) {
+      idx[pos[c]] = i;
+      X[pos[c]] = field.value;
+      ++pos[c];
+    });
+  }
+  arena->UpdateView();
+}
+
+} // namespace f2m
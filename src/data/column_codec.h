@@ -0,0 +1,467 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the compact encodings of the columns of a ColumnBlock,
+and ForEachEntry(), which scans a column no matter how it is stored.
+*/
+
+#ifndef F2M_DATA_COLUMN_CODEC_H_
+#define F2M_DATA_COLUMN_CODEC_H_
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// A plain column costs 8 bytes per entry, but the columns of the CTR
+// data are very regular: the sample indices are sorted, so their deltas
+// are small, and the values of a column are often all the same (e.g.,
+// 1 or 0.5). So each column of an encoded block chooses an encoding of
+// its sample indices (the low 4 bits of the codec) and an encoding of
+// its values (the high 4 bits):
+//
+//   kIndexPlain  : index_t idx[len]
+//   kIndexDelta  : the deltas of idx (the first one from 0) in LEB128
+//                  varints, i.e., 1 byte for a delta < 128
+//   kIndexNarrow : uint16 idx[len], only if the block has at most
+//                  kMaxNarrowSamples samples
+//   kIndexField  : index_t f, c: the column is the code c of the
+//                  categorical field f (with kValueConst)
+//   kIndexDense  : nothing, the column is dense. Its values are given
+//                  for all the samples, and 0 for a missing sample
+//   kIndexBitmap : uint8 bits[(num_samples + 7) / 8], the bit i % 8 of
+//                  bits[i / 8] is set if the sample i has the column
+//                  (with kValueConst)
+//   kValuePlain  : real_t X[len], or X[num_samples] if dense
+//   kValueConst  : real_t x, the value of all the entries
+//
+// The values come first, and then the indices. Each column starts at a
+// multiple of 4 bytes of packed, so the plain arrays are aligned.
+//
+// A field of the libffm data is stored as a CategoricalField (see
+// data_structure.h) if each sample has exactly one of its columns (the
+// bias excluded), all of the same value, and it has at most
+// kMaxFieldColumns columns. Its data follows the columns in packed. So
+// the one-hot data costs 1 or 2 bytes per sample per field, no matter
+// how many tiny columns a field has, and the Loss computes a field by
+// ForEachSample() with the weights of its columns gathered first.
+//
+// A column is dense if it has at least kMinDenseRatio of the samples and
+// no stored 0, or if it has all the samples of the same value (e.g.,
+// the bias). The Loss computes a dense column of plain values by the
+// SIMD kernels DenseAxpy() and DenseDot() without any index.
+//
+// A binary column (of a constant value) of at least kMinBitmapRatio of
+// the samples is a bitmap, which costs 1 bit per sample instead of at
+// least 1 byte per entry. The Loss computes it by the masked SIMD
+// kernels BitmapAdd() and BitmapSum().
+//------------------------------------------------------------------------------
+enum IndexCodec {
+  kIndexPlain = 0,
+  kIndexDelta = 1,
+  kIndexNarrow = 2,
+  kIndexField = 3,
+  kIndexDense = 4,
+  kIndexBitmap = 5
+};
+
+// The blocks of at most this many samples can use kIndexNarrow.
+static const index_t kMaxNarrowSamples = 65536;
+
+// The fields of at most this many columns can be categorical.
+static const index_t kMaxFieldColumns = 65536;
+
+// The columns of at least this fraction of the samples can be dense. A
+// dense column is then about as small as the delta encoded one.
+static const real_t kMinDenseRatio = 0.75;
+
+// The binary columns of at least this fraction of the samples are
+// bitmaps. The bitmap is then smaller than the 1-byte deltas, and its
+// masked kernels are faster than the scatter of the indices (see
+// bitmap_column_benchmark.cc).
+static const real_t kMinBitmapRatio = 0.25;
+
+enum ValueCodec {
+  kValuePlain = 0,
+  kValueConst = 1
+};
+
+inline uint8 MakeCodec(IndexCodec index_codec, ValueCodec value_codec) {
+  return static_cast<uint8>(index_codec | (value_codec << 4));
+}
+
+inline IndexCodec IndexCodecOf(uint8 codec) {
+  return static_cast<IndexCodec>(codec & 0x0f);
+}
+
+inline ValueCodec ValueCodecOf(uint8 codec) {
+  return static_cast<ValueCodec>(codec >> 4);
+}
+
+// The values of a column, given to DecodeIndices().
+struct PlainValues {
+  const real_t* X;
+  real_t operator[](index_t k) const { return X[k]; }
+};
+
+struct ConstValue {
+  real_t x;
+  real_t operator[](index_t k) const { return x; }
+};
+
+// Invoke func(idx[k], values[k]) for the len entries of a column whose
+// sample indices are stored in an array of Index (index_t or uint16).
+template <typename Index, typename Values, typename Func>
+inline void ForEachIndex(const Index* idx,
+                         index_t len,
+                         const Values& values,
+                         const Func& func) {
+  for (index_t k = 0; k < len; ++k) {
+    func(static_cast<index_t>(idx[k]), values[k]);
+  }
+}
+
+// Decode the len sample indices at p, and invoke func(idx[k], values[k])
+// for each entry. It is instantiated for each encoding of the values, so
+// the constant value is kept in a register.
+template <typename Values, typename Func>
+inline void DecodeIndices(IndexCodec index_codec,
+                          const uint8* p,
+                          index_t len,
+                          const Values& values,
+                          const Func& func) {
+  if (index_codec == kIndexPlain) {
+    ForEachIndex(reinterpret_cast<const index_t*>(p), len, values, func);
+    return;
+  }
+  if (index_codec == kIndexNarrow) {
+    ForEachIndex(reinterpret_cast<const uint16*>(p), len, values, func);
+    return;
+  }
+  index_t i = 0;
+  for (index_t k = 0; k < len; ++k) {
+    index_t delta = *p++;
+    if (delta >= 0x80) {
+      delta &= 0x7f;
+      int shift = 7;
+      uint8 b = 0;
+      do {
+        b = *p++;
+        delta |= static_cast<index_t>(b & 0x7f) << shift;
+        shift += 7;
+      } while (b & 0x80);
+    }
+    i += delta;
+    func(i, values[k]);
+  }
+}
+
+// Invoke func(i, codes[i]) for each sample of a categorical field whose
+// codes are stored in an array of Code (uint8 or uint16).
+template <typename Code, typename Func>
+inline void ForEachCode(const Code* codes,
+                        index_t num_samples,
+                        const Func& func) {
+  for (index_t i = 0; i < num_samples; ++i) {
+    func(i, static_cast<index_t>(codes[i]));
+  }
+}
+
+// Invoke func(index_t i, index_t c) on each sample i of the block, where
+// c is the code of its column in the categorical field.
+template <typename Func>
+inline void ForEachSample(const ColumnBlock& block,
+                          const CategoricalField& field,
+                          const Func& func) {
+  const uint8* codes = block.packed + field.codes;
+  if (field.code_size == 1) {
+    ForEachCode(codes, block.num_samples, func);
+  } else {
+    ForEachCode(reinterpret_cast<const uint16*>(codes),
+                block.num_samples, func);
+  }
+}
+
+// Return the column of each code of the categorical field.
+inline const index_t* FieldColumns(const ColumnBlock& block,
+                                   const CategoricalField& field) {
+  return reinterpret_cast<const index_t*>(block.packed + field.columns);
+}
+
+// Return true if the j-th column belongs to a categorical field, and
+// then the Loss computes it with the field instead.
+inline bool IsCategorical(const ColumnBlock& block, index_t j) {
+  return block.col_codecs != nullptr &&
+         IndexCodecOf(block.col_codecs[j]) == kIndexField;
+}
+
+// Return the values of all the samples if the j-th column is dense with
+// plain values, or nullptr.
+inline const real_t* DenseValues(const ColumnBlock& block, index_t j) {
+  if (block.col_codecs == nullptr ||
+      block.col_codecs[j] != MakeCodec(kIndexDense, kValuePlain)) {
+    return nullptr;
+  }
+  return reinterpret_cast<const real_t*>(block.packed + block.col_offsets[j]);
+}
+
+// Return the sum of the lanes.
+inline real_t HorizontalSum(__MX v) {
+  real_t lanes[_MMX_INCREMENT];
+  _MMX_STOREU_PS(lanes, v);
+  real_t sum = 0;
+  for (int k = 0; k < _MMX_INCREMENT; ++k) {
+    sum += lanes[k];
+  }
+  return sum;
+}
+
+// y[i] += a * X[i] for i in [0, n).
+inline void DenseAxpy(real_t a, const real_t* X, index_t n, real_t* y) {
+  __MX _a = _MMX_SET1_PS(a);
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    __MX _y = _MMX_ADD_PS(_MMX_LOADU_PS(y + i),
+                          _MMX_MUL_PS(_a, _MMX_LOADU_PS(X + i)));
+    _MMX_STOREU_PS(y + i, _y);
+  }
+  for (; i < n; ++i) {
+    y[i] += a * X[i];
+  }
+}
+
+// y[i] += a * X[i] * X[i] for i in [0, n).
+inline void DenseSquareAxpy(real_t a, const real_t* X, index_t n, real_t* y) {
+  __MX _a = _MMX_SET1_PS(a);
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    __MX _x = _MMX_LOADU_PS(X + i);
+    __MX _y = _MMX_ADD_PS(_MMX_LOADU_PS(y + i),
+                          _MMX_MUL_PS(_a, _MMX_MUL_PS(_x, _x)));
+    _MMX_STOREU_PS(y + i, _y);
+  }
+  for (; i < n; ++i) {
+    y[i] += a * X[i] * X[i];
+  }
+}
+
+// Return the sum of a[i] * b[i] for i in [0, n).
+inline real_t DenseDot(const real_t* a, const real_t* b, index_t n) {
+  __MX _sum = _MMX_SETZERO_PS();
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    _sum = _MMX_ADD_PS(_sum, _MMX_MUL_PS(_MMX_LOADU_PS(a + i),
+                                         _MMX_LOADU_PS(b + i)));
+  }
+  real_t sum = HorizontalSum(_sum);
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// Return the sum of a[i] * b[i] * c[i] for i in [0, n).
+inline real_t DenseDot(const real_t* a,
+                       const real_t* b,
+                       const real_t* c,
+                       index_t n) {
+  __MX _sum = _MMX_SETZERO_PS();
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    __MX _ab = _MMX_MUL_PS(_MMX_LOADU_PS(a + i), _MMX_LOADU_PS(b + i));
+    _sum = _MMX_ADD_PS(_sum, _MMX_MUL_PS(_ab, _MMX_LOADU_PS(c + i)));
+  }
+  real_t sum = HorizontalSum(_sum);
+  for (; i < n; ++i) {
+    sum += a[i] * b[i] * c[i];
+  }
+  return sum;
+}
+
+// Return the bits of the j-th column and set *x to its value if it is a
+// bitmap, or return nullptr.
+inline const uint8* ColumnBitmap(const ColumnBlock& block,
+                                 index_t j,
+                                 real_t* x) {
+  if (block.col_codecs == nullptr ||
+      IndexCodecOf(block.col_codecs[j]) != kIndexBitmap) {
+    return nullptr;
+  }
+  const uint8* p = block.packed + block.col_offsets[j];
+  *x = *reinterpret_cast<const real_t*>(p);
+  return p + sizeof(real_t);
+}
+
+// The 8 lane masks of each byte of a bitmap: BitMasks()[b * 8 + k] has
+// all bits set if the bit k of b is set, or is 0.
+const uint32* BitMasks();
+
+inline bool TestBit(const uint8* bits, index_t i) {
+  return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+// The mask of the lanes of the samples [i, i + _MMX_INCREMENT) in the
+// bitmap, where i is a multiple of _MMX_INCREMENT.
+inline __MX LoadMask(const uint32* masks, const uint8* bits, index_t i) {
+  return _MMX_LOADU_PS(reinterpret_cast<const float*>(
+      masks + bits[i >> 3] * 8 + (i & 7)));
+}
+
+// y[i] += a for each sample i in the bitmap, i in [0, n).
+inline void BitmapAdd(real_t a, const uint8* bits, index_t n, real_t* y) {
+  const uint32* masks = BitMasks();
+  __MX _a = _MMX_SET1_PS(a);
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    __MX _y = _MMX_ADD_PS(_MMX_LOADU_PS(y + i),
+                          _MMX_AND_PS(_a, LoadMask(masks, bits, i)));
+    _MMX_STOREU_PS(y + i, _y);
+  }
+  for (; i < n; ++i) {
+    if (TestBit(bits, i)) {
+      y[i] += a;
+    }
+  }
+}
+
+// Return the sum of a[i] for each sample i in the bitmap, i in [0, n).
+inline real_t BitmapSum(const uint8* bits, const real_t* a, index_t n) {
+  const uint32* masks = BitMasks();
+  __MX _sum = _MMX_SETZERO_PS();
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    _sum = _MMX_ADD_PS(_sum, _MMX_AND_PS(_MMX_LOADU_PS(a + i),
+                                         LoadMask(masks, bits, i)));
+  }
+  real_t sum = HorizontalSum(_sum);
+  for (; i < n; ++i) {
+    if (TestBit(bits, i)) {
+      sum += a[i];
+    }
+  }
+  return sum;
+}
+
+// Return the sum of a[i] * b[i] for each sample i in the bitmap.
+inline real_t BitmapDot(const uint8* bits,
+                        const real_t* a,
+                        const real_t* b,
+                        index_t n) {
+  const uint32* masks = BitMasks();
+  __MX _sum = _MMX_SETZERO_PS();
+  index_t i = 0;
+  for (; i + _MMX_INCREMENT <= n; i += _MMX_INCREMENT) {
+    __MX _ab = _MMX_MUL_PS(_MMX_LOADU_PS(a + i), _MMX_LOADU_PS(b + i));
+    _sum = _MMX_ADD_PS(_sum, _MMX_AND_PS(_ab, LoadMask(masks, bits, i)));
+  }
+  real_t sum = HorizontalSum(_sum);
+  for (; i < n; ++i) {
+    if (TestBit(bits, i)) {
+      sum += a[i] * b[i];
+    }
+  }
+  return sum;
+}
+
+// Invoke func(index_t i, real_t x) on each entry of the j-th column of
+// the block in the order of the samples. We can use it like this:
+//
+//   ForEachEntry(block, j, [&](index_t i, real_t x) {
+//     result[i] += w_j * x;
+//   });
+//
+// The encoded columns are decoded on the fly, so they are never expanded
+// in memory. A column of a categorical field scans the codes of all the
+// samples, so the Loss uses ForEachSample() for them instead.
+template <typename Func>
+inline void ForEachEntry(const ColumnBlock& block,
+                         index_t j,
+                         const Func& func) {
+  index_t begin = block.col_ptr[j];
+  index_t len = block.col_ptr[j+1] - begin;
+  if (block.col_codecs == nullptr) {
+    PlainValues values = { block.X + begin };
+    ForEachIndex(block.idx + begin, len, values, func);
+    return;
+  }
+  uint8 codec = block.col_codecs[j];
+  const uint8* p = block.packed + block.col_offsets[j];
+  const real_t* X = reinterpret_cast<const real_t*>(p);
+  if (IndexCodecOf(codec) == kIndexField) {
+    const index_t* ref = reinterpret_cast<const index_t*>(p + sizeof(real_t));
+    real_t x = X[0];
+    index_t code = ref[1];
+    ForEachSample(block, block.categorical[ref[0]],
+                  [&](index_t i, index_t c) {
+      if (c == code) {
+        func(i, x);
+      }
+    });
+    return;
+  }
+  if (IndexCodecOf(codec) == kIndexDense) {
+    if (ValueCodecOf(codec) == kValueConst) {
+      real_t x = X[0];
+      for (index_t i = 0; i < block.num_samples; ++i) {
+        func(i, x);
+      }
+    } else {
+      for (index_t i = 0; i < block.num_samples; ++i) {
+        if (X[i] != 0) {
+          func(i, X[i]);
+        }
+      }
+    }
+    return;
+  }
+  if (IndexCodecOf(codec) == kIndexBitmap) {
+    const uint8* bits = p + sizeof(real_t);
+    real_t x = X[0];
+    for (index_t b = 0; b < (block.num_samples + 7) / 8; ++b) {
+      for (uint32 v = bits[b]; v != 0; v &= v - 1) {
+        func(b * 8 + __builtin_ctz(v), x);
+      }
+    }
+    return;
+  }
+  if (ValueCodecOf(codec) == kValueConst) {
+    ConstValue values = { X[0] };
+    DecodeIndices(IndexCodecOf(codec), p + sizeof(real_t), len, values, func);
+  } else {
+    PlainValues values = { X };
+    DecodeIndices(IndexCodecOf(codec), p + sizeof(real_t) * len, len,
+                  values, func);
+  }
+}
+
+// Encode the columns of the plain block into the arena, choosing the
+// smallest encodings of each column. Of the encodings of the same size,
+// kIndexNarrow is preferred to kIndexDelta, which decodes slower. The
+// one-hot fields become categorical fields. The labels, the fields and
+// the weights are copied, and idx and X of the arena are left empty.
+void EncodeBlock(const ColumnBlock& block, ColumnArena* arena);
+
+// Decode the block, either plain or encoded, into the plain arrays of
+// the arena.
+void DecodeBlock(const ColumnBlock& block, ColumnArena* arena);
+
+} // namespace f2m
+
+#endif // F2M_DATA_COLUMN_CODEC_H_
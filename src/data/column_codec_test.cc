@@ -0,0 +1,358 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests column_codec.h
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/data/column_codec.h"
+
+namespace f2m {
+
+// Column 0: the bias, every sample and value 1.
+// Column 1: constant value 0.5, deltas over 128 and 16384.
+// Column 2: plain values, small deltas.
+// Column 3: one entry whose varint would take 4 bytes.
+static void BuildArena(ColumnArena* arena) {
+  index_t num_samples = 3000000;
+  arena->Y.assign(num_samples, 0);
+  arena->Y[7] = 1;
+  arena->col_ids = {0, 3, 5, 9};
+  arena->col_fields.clear();
+  arena->weights.clear();
+  arena->idx.clear();
+  arena->X.clear();
+  arena->col_ptr.assign(1, 0);
+  for (index_t i = 0; i < 300; ++i) {
+    arena->idx.push_back(i);
+    arena->X.push_back(1.0);
+  }
+  arena->col_ptr.push_back(arena->idx.size());
+  index_t col_1[] = {2, 200, 20000, 20001};
+  for (index_t i : col_1) {
+    arena->idx.push_back(i);
+    arena->X.push_back(0.5);
+  }
+  arena->col_ptr.push_back(arena->idx.size());
+  for (index_t i = 0; i < 10; ++i) {
+    arena->idx.push_back(i * 3);
+    arena->X.push_back(i * 0.25);
+  }
+  arena->col_ptr.push_back(arena->idx.size());
+  arena->idx.push_back(num_samples - 1);
+  arena->X.push_back(-2.0);
+  arena->col_ptr.push_back(arena->idx.size());
+  arena->UpdateView();
+}
+
+TEST(ColumnCodecTest, ChooseCodecs) {
+  ColumnArena plain, encoded;
+  BuildArena(&plain);
+  EncodeBlock(plain.block, &encoded);
+  const ColumnBlock& block = encoded.block;
+  ASSERT_TRUE(block.col_codecs != nullptr);
+  EXPECT_EQ(block.num_columns, 4);
+  EXPECT_EQ(block.nnz, plain.block.nnz);
+  EXPECT_EQ(block.col_codecs[0], MakeCodec(kIndexDelta, kValueConst));
+  EXPECT_EQ(block.col_codecs[1], MakeCodec(kIndexDelta, kValueConst));
+  EXPECT_EQ(block.col_codecs[2], MakeCodec(kIndexDelta, kValuePlain));
+  EXPECT_EQ(block.col_codecs[3], MakeCodec(kIndexPlain, kValueConst));
+  // 4 + 300, 4 + (1 + 2 + 3 + 1) rounded up, 40 + 10 rounded up, 4 + 4
+  EXPECT_EQ(block.col_offsets[1], 304);
+  EXPECT_EQ(block.col_offsets[2], 316);
+  EXPECT_EQ(block.col_offsets[3], 368);
+  EXPECT_EQ(block.col_offsets[4], 376);
+  EXPECT_EQ(encoded.packed.size(), 376);
+  EXPECT_TRUE(encoded.idx.empty());
+  EXPECT_TRUE(encoded.X.empty());
+}
+
+// The blocks of at most kMaxNarrowSamples samples store the sample
+// indices in 16 bits, unless the deltas are smaller.
+TEST(ColumnCodecTest, NarrowIndices) {
+  for (index_t num_samples : {kMaxNarrowSamples, kMaxNarrowSamples + 1}) {
+    ColumnArena plain, encoded;
+    plain.Y.assign(num_samples, 0);
+    plain.col_ids = {0, 1};
+    plain.col_ptr.assign(1, 0);
+    for (index_t i = 0; i < num_samples; ++i) {
+      plain.idx.push_back(i);
+      plain.X.push_back(1.0);
+    }
+    plain.col_ptr.push_back(plain.idx.size());
+    for (index_t i = 150; i < num_samples; i += 300) {
+      plain.idx.push_back(i);
+      plain.X.push_back(i);
+    }
+    plain.col_ptr.push_back(plain.idx.size());
+    plain.UpdateView();
+    EncodeBlock(plain.block, &encoded);
+    bool narrow = num_samples <= kMaxNarrowSamples;
+    EXPECT_EQ(encoded.block.col_codecs[0],
+              MakeCodec(kIndexDense, kValueConst));
+    EXPECT_EQ(encoded.block.col_codecs[1],
+              MakeCodec(narrow ? kIndexNarrow : kIndexDelta, kValuePlain));
+    index_t k = plain.col_ptr[1];
+    ForEachEntry(encoded.block, 1, [&](index_t i, real_t x) {
+      EXPECT_EQ(i, plain.idx[k]);
+      EXPECT_EQ(x, plain.X[k]);
+      ++k;
+    });
+    EXPECT_EQ(k, plain.col_ptr[2]);
+  }
+}
+
+// The field 1 is one-hot, and the field 2 is not, since the sample 0
+// has both of its columns. The field 3 has one column of all samples.
+TEST(ColumnCodecTest, CategoricalFields) {
+  ColumnArena plain, encoded, decoded;
+  plain.Y.assign(6, 0);
+  plain.col_ids = {0, 1, 2, 3, 4, 5, 6};
+  plain.col_fields = {0, 1, 1, 1, 2, 2, 3};
+  plain.idx = {0, 1, 2, 3, 4, 5,   // bias
+               1, 4,               // field 1
+               0, 2, 5,
+               3,
+               0, 1, 2,            // field 2
+               0, 3,
+               0, 1, 2, 3, 4, 5};  // field 3
+  plain.X = {1, 1, 1, 1, 1, 1,
+             1, 1, 1, 1, 1, 1,
+             1, 1, 1, 1, 1,
+             0.5, 0.5, 0.5, 0.5, 0.5, 0.5};
+  plain.col_ptr = {0, 6, 8, 11, 12, 15, 17, 23};
+  plain.UpdateView();
+  EncodeBlock(plain.block, &encoded);
+  const ColumnBlock& block = encoded.block;
+  ASSERT_EQ(block.num_categorical, 2);
+  EXPECT_EQ(block.categorical[0].field, 1);
+  EXPECT_EQ(block.categorical[0].num_columns, 3);
+  EXPECT_EQ(block.categorical[0].code_size, 1);
+  EXPECT_EQ(block.categorical[0].value, 1.0);
+  EXPECT_EQ(block.categorical[1].field, 3);
+  EXPECT_EQ(block.categorical[1].num_columns, 1);
+  EXPECT_EQ(block.categorical[1].value, 0.5);
+  const index_t* columns = FieldColumns(block, block.categorical[0]);
+  EXPECT_EQ(columns[0], 1);
+  EXPECT_EQ(columns[1], 2);
+  EXPECT_EQ(columns[2], 3);
+  bool categorical[] = {false, true, true, true, false, false, true};
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    EXPECT_EQ(IsCategorical(block, j), categorical[j]);
+  }
+  // The column of each sample of the field 1.
+  index_t expected[] = {1, 0, 1, 2, 0, 1};
+  index_t num_samples = 0;
+  ForEachSample(block, block.categorical[0], [&](index_t i, index_t c) {
+    EXPECT_EQ(c, expected[i]);
+    ++num_samples;
+  });
+  EXPECT_EQ(num_samples, 6);
+  // A column of a categorical field can still be scanned alone.
+  std::vector<index_t> idx;
+  ForEachEntry(block, 2, [&](index_t i, real_t x) {
+    idx.push_back(i);
+    EXPECT_EQ(x, 1.0);
+  });
+  EXPECT_EQ(idx, std::vector<index_t>({0, 2, 5}));
+  DecodeBlock(block, &decoded);
+  EXPECT_EQ(decoded.idx, plain.idx);
+  EXPECT_EQ(decoded.X, plain.X);
+  EXPECT_EQ(decoded.col_fields, plain.col_fields);
+}
+
+// Column 0: every sample, constant value.
+// Column 1: 9 of 11 samples, plain values.
+// Column 2: 9 of 11 samples, but one of the values is 0.
+// Column 3: 8 of 11 samples, under kMinDenseRatio.
+TEST(ColumnCodecTest, DenseColumns) {
+  ColumnArena plain, encoded, decoded;
+  index_t num_samples = 11;
+  plain.Y.assign(num_samples, 0);
+  plain.col_ids = {0, 1, 2, 3};
+  plain.col_ptr.assign(1, 0);
+  for (index_t i = 0; i < num_samples; ++i) {
+    plain.idx.push_back(i);
+    plain.X.push_back(1.0);
+  }
+  plain.col_ptr.push_back(plain.idx.size());
+  for (index_t j = 1; j < 4; ++j) {
+    for (index_t i = 0; i < num_samples; ++i) {
+      if (i == 3 || i == 7 || (j == 3 && i == 9)) {
+        continue;
+      }
+      plain.idx.push_back(i);
+      plain.X.push_back(j == 2 && i == 5 ? 0 : i * 0.5 + j);
+    }
+    plain.col_ptr.push_back(plain.idx.size());
+  }
+  plain.UpdateView();
+  EncodeBlock(plain.block, &encoded);
+  const ColumnBlock& block = encoded.block;
+  EXPECT_EQ(block.col_codecs[0], MakeCodec(kIndexDense, kValueConst));
+  EXPECT_EQ(block.col_codecs[1], MakeCodec(kIndexDense, kValuePlain));
+  EXPECT_EQ(block.col_codecs[2], MakeCodec(kIndexDelta, kValuePlain));
+  EXPECT_EQ(block.col_codecs[3], MakeCodec(kIndexDelta, kValuePlain));
+  EXPECT_TRUE(DenseValues(block, 0) == nullptr);
+  const real_t* dense = DenseValues(block, 1);
+  ASSERT_TRUE(dense != nullptr);
+  EXPECT_EQ(dense[3], 0);
+  EXPECT_EQ(dense[4], 3.0);
+  // The missing samples of a dense column are skipped.
+  index_t k = plain.col_ptr[1];
+  ForEachEntry(block, 1, [&](index_t i, real_t x) {
+    EXPECT_EQ(i, plain.idx[k]);
+    EXPECT_EQ(x, plain.X[k]);
+    ++k;
+  });
+  EXPECT_EQ(k, plain.col_ptr[2]);
+  DecodeBlock(block, &decoded);
+  EXPECT_EQ(decoded.idx, plain.idx);
+  EXPECT_EQ(decoded.X, plain.X);
+  // The kernels against the scalar loops.
+  std::vector<real_t> y(num_samples), z(num_samples);
+  for (index_t i = 0; i < num_samples; ++i) {
+    y[i] = z[i] = i * 0.25 - 1;
+  }
+  DenseAxpy(2.0, dense, num_samples, y.data());
+  DenseSquareAxpy(-0.5, dense, num_samples, y.data());
+  real_t dot = 0, dot3 = 0;
+  for (index_t i = 0; i < num_samples; ++i) {
+    dot += z[i] * dense[i];
+    dot3 += z[i] * dense[i] * dense[i];
+    z[i] += 2.0 * dense[i] - 0.5 * dense[i] * dense[i];
+    EXPECT_FLOAT_EQ(y[i], z[i]);
+  }
+  for (index_t i = 0; i < num_samples; ++i) {
+    z[i] = i * 0.25 - 1;
+  }
+  EXPECT_FLOAT_EQ(DenseDot(z.data(), dense, num_samples), dot);
+  EXPECT_FLOAT_EQ(DenseDot(z.data(), dense, dense, num_samples), dot3);
+}
+
+// Column 1: constant value 0.5 at 2/3 of the samples.
+// Column 2: constant value 1 at 1/10 of the samples, under
+// kMinBitmapRatio.
+TEST(ColumnCodecTest, BitmapColumns) {
+  ColumnArena plain, encoded, decoded;
+  index_t num_samples = 101;
+  plain.Y.assign(num_samples, 0);
+  plain.col_ids = {0, 1, 2};
+  plain.col_ptr.assign(1, 0);
+  for (index_t i = 0; i < num_samples; ++i) {
+    plain.idx.push_back(i);
+    plain.X.push_back(1.0);
+  }
+  plain.col_ptr.push_back(plain.idx.size());
+  for (index_t i = 0; i < num_samples; ++i) {
+    if (i % 3 != 0) {
+      plain.idx.push_back(i);
+      plain.X.push_back(0.5);
+    }
+  }
+  plain.col_ptr.push_back(plain.idx.size());
+  for (index_t i = 0; i < num_samples; i += 10) {
+    plain.idx.push_back(i);
+    plain.X.push_back(1.0);
+  }
+  plain.col_ptr.push_back(plain.idx.size());
+  plain.UpdateView();
+  EncodeBlock(plain.block, &encoded);
+  const ColumnBlock& block = encoded.block;
+  EXPECT_EQ(block.col_codecs[1], MakeCodec(kIndexBitmap, kValueConst));
+  EXPECT_EQ(block.col_codecs[2], MakeCodec(kIndexDelta, kValueConst));
+  // 4 + 13 rounded up
+  EXPECT_EQ(block.col_offsets[2] - block.col_offsets[1], 20);
+  real_t value = 0;
+  EXPECT_TRUE(ColumnBitmap(block, 2, &value) == nullptr);
+  const uint8* bits = ColumnBitmap(block, 1, &value);
+  ASSERT_TRUE(bits != nullptr);
+  EXPECT_EQ(value, 0.5);
+  index_t k = plain.col_ptr[1];
+  ForEachEntry(block, 1, [&](index_t i, real_t x) {
+    EXPECT_EQ(i, plain.idx[k]);
+    EXPECT_EQ(x, 0.5);
+    ++k;
+  });
+  EXPECT_EQ(k, plain.col_ptr[2]);
+  DecodeBlock(block, &decoded);
+  EXPECT_EQ(decoded.idx, plain.idx);
+  EXPECT_EQ(decoded.X, plain.X);
+  // The kernels against the scalar loops.
+  std::vector<real_t> a(num_samples), b(num_samples), y(num_samples);
+  for (index_t i = 0; i < num_samples; ++i) {
+    a[i] = i * 0.25 - 1;
+    b[i] = 2 - i * 0.125;
+  }
+  y = a;
+  BitmapAdd(3.0, bits, num_samples, y.data());
+  real_t sum = 0, dot = 0;
+  for (index_t i = 0; i < num_samples; ++i) {
+    bool set = i % 3 != 0;
+    EXPECT_FLOAT_EQ(y[i], set ? a[i] + 3.0 : a[i]);
+    sum += set ? a[i] : 0;
+    dot += set ? a[i] * b[i] : 0;
+  }
+  EXPECT_FLOAT_EQ(BitmapSum(bits, a.data(), num_samples), sum);
+  EXPECT_FLOAT_EQ(BitmapDot(bits, a.data(), b.data(), num_samples), dot);
+}
+
+TEST(ColumnCodecTest, ForEachEntry) {
+  ColumnArena plain, encoded;
+  BuildArena(&plain);
+  EncodeBlock(plain.block, &encoded);
+  for (index_t j = 0; j < plain.block.num_columns; ++j) {
+    std::vector<index_t> idx;
+    std::vector<real_t> X;
+    ForEachEntry(encoded.block, j, [&](index_t i, real_t x) {
+      idx.push_back(i);
+      X.push_back(x);
+    });
+    index_t begin = plain.col_ptr[j], end = plain.col_ptr[j+1];
+    ASSERT_EQ(idx.size(), end - begin);
+    for (index_t k = begin; k < end; ++k) {
+      EXPECT_EQ(idx[k - begin], plain.idx[k]);
+      EXPECT_FLOAT_EQ(X[k - begin], plain.X[k]);
+    }
+  }
+}
+
+TEST(ColumnCodecTest, DecodeBlock) {
+  ColumnArena plain, encoded, decoded;
+  BuildArena(&plain);
+  plain.weights.assign(plain.Y.size(), 2.0);
+  plain.col_fields = {0, 1, 1, 2};
+  plain.UpdateView();
+  EncodeBlock(plain.block, &encoded);
+  EXPECT_TRUE(encoded.block.weights != nullptr);
+  EXPECT_TRUE(encoded.block.col_fields != nullptr);
+  DecodeBlock(encoded.block, &decoded);
+  EXPECT_TRUE(decoded.block.col_codecs == nullptr);
+  EXPECT_EQ(decoded.Y, plain.Y);
+  EXPECT_EQ(decoded.col_ids, plain.col_ids);
+  EXPECT_EQ(decoded.col_ptr, plain.col_ptr);
+  EXPECT_EQ(decoded.col_fields, plain.col_fields);
+  EXPECT_EQ(decoded.weights, plain.weights);
+  EXPECT_EQ(decoded.idx, plain.idx);
+  EXPECT_EQ(decoded.X, plain.X);
+  EXPECT_EQ(decoded.block.nnz, plain.block.nnz);
+}
+
+} // namespace f2m
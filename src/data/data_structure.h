@@ -23,6 +23,7 @@ This file defines the basic data structures used by f2m.
 #ifndef F2M_DATA_DATA_STRUCTURE_H_
 #define F2M_DATA_DATA_STRUCTURE_H_
 
+#include <algorithm>
 #include <vector>
 
 #include "src/base/common.h"
@@ -149,6 +150,192 @@ struct SparseRow {
   bool if_has_field;           // for ffm ?
 };
 
+//------------------------------------------------------------------------------
+// In the one-hot data, each sample has exactly one column of a field.
+// So a CategoricalField of an encoded block stores the code of the
+// column of each sample, instead of the samples of each column. The
+// code c is the column packed[columns][c] (index_t) of the block, and
+// the codes of the samples are packed[codes] (uint8 or uint16). See
+// column_codec.h.
+//------------------------------------------------------------------------------
+struct CategoricalField {
+  index_t field;             // Field id.
+  index_t num_columns;       // Number of columns of the field.
+  index_t columns;           // Offset into packed of the column of each code.
+  index_t codes;             // Offset into packed of the code of each sample.
+  index_t code_size;         // 1 or 2 bytes per code.
+  real_t value;              // Feature value of all the entries.
+};
+
+//------------------------------------------------------------------------------
+// ColumnBlock is a read-only view of one column block stored in a flat
+// (compressed sparse column) layout: the entries of the k-th column are
+// idx[col_ptr[k] .. col_ptr[k+1]) and X[col_ptr[k] .. col_ptr[k+1]).
+// Note that the ColumnBlock does not own its memory, which usually lives
+// in a mmap-ed binary file (see src/reader/binary_format.h).
+// The libffm data gives each column a field, and col_fields is nullptr
+// for the data without fields. The samples kept by the downsampling
+// have importance weights, and weights is nullptr if every sample has
+// weight 1 (see TotalWeight()).
+//
+// The columns can also be encoded in a compact form (see column_codec.h),
+// and then idx and X are not used: the data of the k-th column is
+// packed[col_offsets[k] .. col_offsets[k+1]) in the encoding of
+// col_codecs[k]. The Loss scans a column by ForEachEntry(), which
+// decodes it on the fly. col_codecs is nullptr for the plain blocks.
+// The one-hot fields of an encoded block are categorical fields.
+//------------------------------------------------------------------------------
+struct ColumnBlock {
+  index_t num_samples;       // Number of samples (the length of Y).
+  index_t num_columns;       // Number of columns, including the bias.
+  index_t nnz;               // Number of entries of all the columns.
+  const real_t* Y;           // Labels of the samples.
+  const index_t* col_ids;    // Feature id of each column.
+  const index_t* col_ptr;    // (num_columns + 1) offsets into idx and X.
+  const index_t* idx;        // Sample index (in this block) of each entry.
+  const real_t* X;           // Feature value of each entry.
+  const index_t* col_fields; // Field of each column, or nullptr.
+  const real_t* weights;     // Weight of each sample, or nullptr.
+  const uint8* col_codecs;   // Encoding of each column, or nullptr.
+  const index_t* col_offsets; // (num_columns + 1) offsets into packed.
+  const uint8* packed;       // Encoded data of the columns.
+  index_t num_categorical;   // Number of categorical fields.
+  const CategoricalField* categorical;   // The categorical fields.
+};
+
+// Return the total weight of the samples of the block.
+inline real_t TotalWeight(const ColumnBlock& block) {
+  if (block.weights == nullptr) {
+    return block.num_samples;
+  }
+  real_t total = 0;
+  for (index_t i = 0; i < block.num_samples; ++i) {
+    total += block.weights[i];
+  }
+  return total;
+}
+
+//------------------------------------------------------------------------------
+// ColumnArena owns the memory of a ColumnBlock: all the columns of a block
+// are stored in four contiguous arrays instead of one heap-allocated
+// SparseRow per column, so the Loss can scan a block without pointer
+// chasing. We can use it like this:
+//
+//   ColumnArena arena;
+//   arena.CopyFrom(Y, matrix.row.data(), matrix.row_len);
+//   matrix.block = &arena.block;
+//
+// Note that the view is updated by CopyFrom() and UpdateView(). If we
+// change the arrays directly, UpdateView() must be invoked.
+//------------------------------------------------------------------------------
+struct ColumnArena {
+  ColumnArena() {
+    col_ptr.push_back(0);
+    UpdateView();
+  }
+
+  // Copy the labels and the columns. rows[0] is the bias column. If
+  // the rows have fields, the field of the first entry of each row is
+  // taken as the field of the column.
+  void CopyFrom(const std::vector<real_t>& labels,
+                SparseRow* const* rows,
+                size_t num_rows) {
+    size_t nnz = 0;
+    for (size_t i = 0; i < num_rows; ++i) {
+      nnz += rows[i]->column_len;
+    }
+    bool has_fields = num_rows > 0 && rows[0]->if_has_field;
+    Y.assign(labels.begin(), labels.end());
+    weights.clear();
+    col_fields.resize(has_fields ? num_rows : 0);
+    ClearCodecs();
+    col_ids.resize(num_rows);
+    col_ptr.resize(num_rows + 1);
+    idx.resize(nnz);
+    X.resize(nnz);
+    index_t pos = 0;
+    col_ptr[0] = 0;
+    for (size_t i = 0; i < num_rows; ++i) {
+      const SparseRow* row = rows[i];
+      col_ids[i] = row->id;
+      if (has_fields) {
+        col_fields[i] = row->column_len > 0 ? row->field[0] : 0;
+      }
+      std::copy(row->idx.begin(), row->idx.begin() + row->column_len,
+                idx.begin() + pos);
+      std::copy(row->X.begin(), row->X.begin() + row->column_len,
+                X.begin() + pos);
+      pos += row->column_len;
+      col_ptr[i + 1] = pos;
+    }
+    UpdateView();
+  }
+
+  // Drop the encoded columns, so that idx and X are used.
+  void ClearCodecs() {
+    col_codecs.clear();
+    col_offsets.clear();
+    packed.clear();
+    categorical.clear();
+  }
+
+  // Point the view to the arrays.
+  void UpdateView() {
+    block.num_samples = Y.size();
+    block.num_columns = col_ids.size();
+    block.nnz = col_codecs.empty() ? idx.size() : col_ptr.back();
+    block.Y = Y.data();
+    block.col_ids = col_ids.data();
+    block.col_ptr = col_ptr.data();
+    block.idx = idx.data();
+    block.X = X.data();
+    block.col_fields = col_fields.empty() ? nullptr : col_fields.data();
+    block.weights = weights.empty() ? nullptr : weights.data();
+    block.col_codecs = col_codecs.empty() ? nullptr : col_codecs.data();
+    block.col_offsets = col_offsets.data();
+    block.packed = packed.data();
+    block.num_categorical = categorical.size();
+    block.categorical = categorical.data();
+  }
+
+  // Return the memory used by the arrays.
+  size_t MemorySize() const {
+    return sizeof(real_t) * (Y.capacity() + X.capacity() +
+                             weights.capacity()) +
+           sizeof(index_t) * (col_ids.capacity() +
+                              col_ptr.capacity() +
+                              idx.capacity() +
+                              col_fields.capacity() +
+                              col_offsets.capacity()) +
+           col_codecs.capacity() + packed.capacity() +
+           sizeof(CategoricalField) * categorical.capacity();
+  }
+
+  std::vector<real_t> Y;         // Labels of the samples.
+  std::vector<index_t> col_ids;  // Feature id of each column.
+  std::vector<index_t> col_ptr;  // (num_columns + 1) offsets.
+  std::vector<index_t> idx;      // Sample index of each entry.
+  std::vector<real_t> X;         // Feature value of each entry.
+  std::vector<index_t> col_fields;  // Field of each column, or empty.
+  std::vector<real_t> weights;      // Weight of each sample, or empty.
+  std::vector<uint8> col_codecs;    // Encoding of each column, or empty.
+  std::vector<index_t> col_offsets; // Offsets into packed.
+  std::vector<uint8> packed;        // Encoded data of the columns.
+  std::vector<CategoricalField> categorical;   // Categorical fields.
+  ColumnBlock block;             // View of the arrays.
+};
+
+//------------------------------------------------------------------------------
+// ColumnRef refers to one column of the DMatrix, no matter the column is
+// stored in a SparseRow or in a ColumnBlock.
+//------------------------------------------------------------------------------
+struct ColumnRef {
+  index_t id;                // Feature id.
+  index_t len;               // Number of entries.
+  const index_t* idx;        // Sample index of each entry.
+  const real_t* X;           // Feature value of each entry.
+};
+
 //------------------------------------------------------------------------------
 // DMatrix (data matrix) is used to store a batch of trainning dataset.
 // For many large-scale Ml problems, we can not load all the trainning data
@@ -157,7 +344,11 @@ struct SparseRow {
 //------------------------------------------------------------------------------
 struct DMatrix {
   // Constructor and Destructor
-  DMatrix() {  
+  DMatrix()
+    : has_field(false),
+      row_len(0),
+      can_release(false),
+      block(nullptr) {
     Y.clear();
   }
   ~DMatrix() { Release(); }
@@ -165,7 +356,8 @@ struct DMatrix {
   explicit DMatrix(size_t length)
     : row(length, nullptr),
       row_len(length),
-      can_release(false) { 
+      can_release(false),
+      block(nullptr) { 
     Y.clear();
   }
 
@@ -213,6 +405,37 @@ struct DMatrix {
     }
   }
 
+  // Point current matrix to the block, and copy the labels of the block
+  // to Y[0] = labels. Only used by the matrix that owns no SparseRow.
+  void SetBlock(const ColumnBlock* new_block, std::vector<real_t>* labels) {
+    CHECK(!can_release);
+    labels->assign(new_block->Y, new_block->Y + new_block->num_samples);
+    Y.resize(1);
+    Y[0] = labels;
+    block = new_block;
+    row_len = new_block->num_columns;
+  }
+
+  // Return the i-th column of current matrix. The block must not be
+  // encoded (see column_codec.h).
+  inline ColumnRef Column(size_t i) const {
+    ColumnRef col;
+    if (block != nullptr) {
+      CHECK(block->col_codecs == nullptr);
+      index_t start = block->col_ptr[i];
+      col.id = block->col_ids[i];
+      col.len = block->col_ptr[i+1] - start;
+      col.idx = block->idx + start;
+      col.X = block->X + start;
+    } else {
+      col.id = row[i]->id;
+      col.len = row[i]->column_len;
+      col.idx = row[i]->idx.data();
+      col.X = row[i]->X.data();
+    }
+    return col;
+  }
+
   // Release memory of all SparseRows.
   void Release() {
     // To avoid double free
@@ -234,6 +457,10 @@ struct DMatrix {
   size_t row_len;
   // To avoid double free.
   bool can_release;
+  // Flat view of current block. If it is not NULL, the columns are read
+  // from this view and the SparseRows are not used. All the Readers
+  // return the flat view, and the Loss only scans the flat view.
+  const ColumnBlock* block;
 };
 
 } // namespace f2m
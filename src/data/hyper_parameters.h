@@ -78,8 +78,32 @@ struct HyperParam {
   int num_folds = 5;
   // in-memory or on-disk trainning.
   bool in_memory_trainning = true;
+  // Using the binary cache of the text file ?
+  bool binary_cache = true;
+  // Name of the dataset shared by the processes (empty means not shared).
+  std::string shared_dataset;
+  // Read the binary blocks by io_uring with O_DIRECT in on-disk trainning ?
+  bool direct_io = false;
+  // Number of blocks read ahead by direct io.
+  int io_queue_depth = 16;
+  // Memory budget (MB) of the block cache of direct io.
+  int block_cache_size = 0;
+  // Shuffle the order of the blocks at each epoch ?
+  bool shuffle = true;
+  // Seed of the block shuffling.
+  int shuffle_seed = 0;
+  // Regroup the samples into new blocks every N epochs (0 means never).
+  int reblock_epochs = 0;
+  // Fraction of the negative samples kept in the trainning set.
+  real_t negative_rate = 1.0;
+  // Encode the columns of the blocks in memory.
+  bool compress_columns = false;
+  // Number of threads used to parse the text file.
+  int num_parse_threads = 1;
   // Mini-batch size in each iteration..
   int batch_size = 0;
+  // Split or merge the stored blocks into blocks of batch_size samples ?
+  bool resize_blocks = false;
   // Using Early-stop ?
   bool early_stop = false;
   // Using sigmoid ?
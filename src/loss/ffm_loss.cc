@@ -119,13 +119,14 @@ void FFMLoss::CalcGrad(const DMatrix* matrix,
 
 // Return cross-entropy loss.
 real_t FFMLoss::Evaluate(const std::vector<real_t>& pred,
-                         const std::vector<real_t>& label) {
+                         const std::vector<real_t>& label,
+                         const real_t* weights) {
   CHECK_GT(pred.size(), 0);
   CHECK_GT(label.size(), 0);
   if (task_type_ == Regression) {
-    return this->square_loss(pred, label);
+    return this->square_loss(pred, label, weights);
   } else {
-    return this->cross_entropy_loss(pred, label);
+    return this->cross_entropy_loss(pred, label, weights);
   }
 }
 
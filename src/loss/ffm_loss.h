@@ -48,7 +48,8 @@ class FFMLoss : public Loss {
   // Given the prediction results and the groud truth, return the loss value.
   // For FFM we use the cross-entropy loss.
   real_t Evaluate(const std::vector<real_t>& pred,
-                  const std::vector<real_t>& label);
+                  const std::vector<real_t>& label,
+                  const real_t* weights = nullptr);
 
  private:
   index_t max_feature_;    // The number of feature.
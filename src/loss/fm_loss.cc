@@ -43,10 +43,11 @@ void FMLoss::Initialize(const HyperParam& hyper_param) {
 
 // Return cross-entropy loss.
 real_t FMLoss::Evaluate(const std::vector<real_t>& pred,
-                        const std::vector<real_t>& label) {
+                        const std::vector<real_t>& label,
+                        const real_t* weights) {
   CHECK_GT(pred.size(), 0);
   CHECK_GT(label.size(), 0);
-  return this->cross_entropy_loss(pred, label);
+  return this->cross_entropy_loss(pred, label, weights);
 }
 
 // Math: [ partial_grad * X ] for linear term
@@ -59,50 +60,118 @@ void FMLoss::CalcGrad(const DMatrix* matrix,
   CHECK_NOTNULL(matrix);
   CHECK_GT(matrix->row_len, 0);
   CHECK_NOTNULL(updater);
+  const ColumnBlock* block = matrix->block;
+  CHECK_NOTNULL(block);
   std::vector<real_t> *w = param->GetParameter();
-  size_t row_len = matrix->row_len;
+  index_t num_columns = block->num_columns;
+  const index_t* col_ids = block->col_ids;
   // Calc real gradient
   index_t num_y = matrix->Y[0]->size();
+  if (result.size() < num_y) {
+    result.resize(num_y, 0);
+  }
   wTx(matrix, w, result);
   for (size_t i = 0; i < num_y; ++i) {
       real_t y = (*matrix->Y[0])[i] > 0 ? 1.0 : -1.0;
       result[i] = -y / (1.0 + (1.0 /fasterexp(-y * result[i])));
   }
-  for (size_t i = 0; i < row_len; ++i) {
-    SparseRow* row = matrix->row[i];
-    index_t col_len = row->column_len;
+  real_t total_weight = WeightGrad(block, result);
+  const real_t* r = result.data();
+  real_t* sum = tmp_result2.data();
+  for (index_t i = 0; i < num_columns; ++i) {
+    if (IsCategorical(*block, i)) {
+      continue;
+    }
     real_t realGrad = 0.0;
-    for (size_t j = 0; j < col_len; ++j) {
-      realGrad += result[row->idx[j]] * row->X[j];
+    const real_t* dense = DenseValues(*block, i);
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(*block, i, &value);
+    if (dense != nullptr) {
+      realGrad = DenseDot(r, dense, num_y);
+    } else if (bits != nullptr) {
+      realGrad = value * BitmapSum(bits, r, num_y);
+    } else {
+      ForEachEntry(*block, i, [&](index_t id, real_t x) {
+        realGrad += r[id] * x;
+      });
     }
-    realGrad /= num_y;
-    grad_->Addgrad(row->id, realGrad);
+    realGrad /= total_weight;
+    grad_->Addgrad(col_ids[i], realGrad);
+  }
+  for (index_t f = 0; f < block->num_categorical; ++f) {
+    const CategoricalField& field = block->categorical[f];
+    GatherField(block, field, w, 0);
+    real_t* g = code_grad.data();
+    ForEachSample(*block, field, [&](index_t id, index_t c) {
+      g[c] += r[id];
+    });
+    ScatterField(block, field, 0, 1.0 / total_weight);
   }
 
   for (size_t i = 1; i <= num_factor_; ++i) {
     size_t bias = i * max_feature_;
-    for (size_t j = 1; j < row_len; ++j) {
-      SparseRow* row = matrix->row[j];
-      index_t col_len = row->column_len;
-      real_t w_i = (*w)[row->id + bias];
-      for (size_t k = 0; k < col_len; ++k) {
-        tmp_result2[row->idx[k]] +=  row->X[k] * w_i;
+    for (index_t j = 1; j < num_columns; ++j) {
+      if (IsCategorical(*block, j)) {
+        continue;
+      }
+      real_t w_i = (*w)[col_ids[j] + bias];
+      const real_t* dense = DenseValues(*block, j);
+      if (dense != nullptr) {
+        DenseAxpy(w_i, dense, num_y, sum);
+        continue;
       }
+      real_t value = 0;
+      const uint8* bits = ColumnBitmap(*block, j, &value);
+      if (bits != nullptr) {
+        BitmapAdd(w_i * value, bits, num_y, sum);
+        continue;
+      }
+      ForEachEntry(*block, j, [&](index_t id, real_t x) {
+        sum[id] += x * w_i;
+      });
+    }
+    for (index_t f = 0; f < block->num_categorical; ++f) {
+      const CategoricalField& field = block->categorical[f];
+      GatherField(block, field, w, bias);
+      const real_t* wx = code_wx.data();
+      ForEachSample(*block, field, [&](index_t id, index_t c) {
+        sum[id] += wx[c];
+      });
     }
-    for (size_t j = 1; j < row_len; ++j) {
-      SparseRow* row = matrix->row[j];
-      index_t pos = row->id + bias;
-      index_t col_len = row->column_len;
+    for (index_t j = 1; j < num_columns; ++j) {
+      if (IsCategorical(*block, j)) {
+        continue;
+      }
+      index_t pos = col_ids[j] + bias;
       real_t realGrad = 0.0;
       real_t w_i = (*w)[pos];
-      for (size_t k = 0; k < col_len; ++k) {
-        real_t x = row->X[k];
-        index_t idx = row->idx[k];
-        realGrad += result[idx] * (tmp_result2[idx] - w_i * x) * x;
+      const real_t* dense = DenseValues(*block, j);
+      real_t value = 0;
+      const uint8* bits = ColumnBitmap(*block, j, &value);
+      if (dense != nullptr) {
+        realGrad = DenseDot(r, sum, dense, num_y) -
+                   w_i * DenseDot(r, dense, dense, num_y);
+      } else if (bits != nullptr) {
+        realGrad = value * (BitmapDot(bits, r, sum, num_y) -
+                            w_i * value * BitmapSum(bits, r, num_y));
+      } else {
+        ForEachEntry(*block, j, [&](index_t id, real_t x) {
+          realGrad += r[id] * (sum[id] - w_i * x) * x;
+        });
       }
-      realGrad /= num_y;
+      realGrad /= total_weight;
       grad_->Addgrad(pos, realGrad);
     }
+    for (index_t f = 0; f < block->num_categorical; ++f) {
+      const CategoricalField& field = block->categorical[f];
+      GatherField(block, field, w, bias);
+      const real_t* wx = code_wx.data();
+      real_t* g = code_grad.data();
+      ForEachSample(*block, field, [&](index_t id, index_t c) {
+        g[c] += r[id] * (sum[id] - wx[c]);
+      });
+      ScatterField(block, field, bias, 1.0 / total_weight);
+    }
     memset(tmp_result2.data(), 0, sizeof(real_t) * num_y);
   }
   updater->BatchUpdate(grad_, param);
@@ -114,32 +183,86 @@ void FMLoss::wTx(const DMatrix* matrix,
                std::vector<real_t>* w,
                std::vector<real_t>& result) {
   index_t num_y = matrix->Y[0]->size();
+  // The stored blocks may have more samples than the batch size, e.g.,
+  // when the blocks are resized for trainning only.
+  if (tmp_result1.size() < num_y) {
+    tmp_result1.resize(num_y, 0);
+    tmp_result2.resize(num_y, 0);
+  }
   memset(result.data(), 0, sizeof(real_t) * num_y);
   memset(tmp_result1.data(), 0, sizeof(real_t) * num_y);
   memset(tmp_result2.data(), 0, sizeof(real_t) * num_y);
-  size_t row_len = matrix->row_len;
+  const ColumnBlock* block = matrix->block;
+  CHECK_NOTNULL(block);
+  index_t num_columns = block->num_columns;
+  const index_t* col_ids = block->col_ids;
+  real_t* r = result.data();
+  real_t* square_sum = tmp_result1.data();
+  real_t* sum = tmp_result2.data();
   // Calc real gradient
-  for (size_t i = 0; i < row_len; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t w_i = (*w)[row->id];
-    index_t col_len = row->column_len;
-    for (size_t j = 0; j < col_len; ++j) {
-      result[row->idx[j]] += w_i * row->X[j];
+  for (index_t i = 0; i < num_columns; ++i) {
+    if (IsCategorical(*block, i)) {
+      continue;
+    }
+    real_t w_i = (*w)[col_ids[i]];
+    const real_t* dense = DenseValues(*block, i);
+    if (dense != nullptr) {
+      DenseAxpy(w_i, dense, num_y, r);
+      continue;
     }
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(*block, i, &value);
+    if (bits != nullptr) {
+      BitmapAdd(w_i * value, bits, num_y, r);
+      continue;
+    }
+    ForEachEntry(*block, i, [&](index_t id, real_t x) {
+      r[id] += w_i * x;
+    });
+  }
+  for (index_t f = 0; f < block->num_categorical; ++f) {
+    const CategoricalField& field = block->categorical[f];
+    GatherField(block, field, w, 0);
+    const real_t* wx = code_wx.data();
+    ForEachSample(*block, field, [&](index_t id, index_t c) {
+      r[id] += wx[c];
+    });
   }
  
   for (size_t i = 1; i <= num_factor_; ++i) {
     size_t bias = i * max_feature_;
-    for (size_t j = 1; j < row_len; ++j) {
-      SparseRow* row = matrix->row[j];
-      real_t w_i = (*w)[row->id + bias];
-     // printf("|%lu| ", row->id + bias);
-      index_t col_len = row->column_len;
-      for (size_t k = 0; k < col_len; ++k) {
-        real_t vx = row->X[k] * w_i;
-        tmp_result1[row->idx[k]] -= vx * vx;
-        tmp_result2[row->idx[k]] += vx;  
+    for (index_t j = 1; j < num_columns; ++j) {
+      if (IsCategorical(*block, j)) {
+        continue;
       }
+      real_t w_i = (*w)[col_ids[j] + bias];
+      const real_t* dense = DenseValues(*block, j);
+      if (dense != nullptr) {
+        DenseSquareAxpy(-w_i * w_i, dense, num_y, square_sum);
+        DenseAxpy(w_i, dense, num_y, sum);
+        continue;
+      }
+      real_t value = 0;
+      const uint8* bits = ColumnBitmap(*block, j, &value);
+      if (bits != nullptr) {
+        BitmapAdd(-w_i * value * w_i * value, bits, num_y, square_sum);
+        BitmapAdd(w_i * value, bits, num_y, sum);
+        continue;
+      }
+      ForEachEntry(*block, j, [&](index_t id, real_t x) {
+        real_t vx = x * w_i;
+        square_sum[id] -= vx * vx;
+        sum[id] += vx;
+      });
+    }
+    for (index_t f = 0; f < block->num_categorical; ++f) {
+      const CategoricalField& field = block->categorical[f];
+      GatherField(block, field, w, bias);
+      const real_t* wx = code_wx.data();
+      ForEachSample(*block, field, [&](index_t id, index_t c) {
+        square_sum[id] -= wx[c] * wx[c];
+        sum[id] += wx[c];
+      });
     }
     for (size_t k = 0; k < num_y; ++k) {
       tmp_result1[k] += tmp_result2[k] * tmp_result2[k];
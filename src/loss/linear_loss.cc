@@ -58,10 +58,11 @@ void LinearLoss::CalcGrad(const DMatrix* matrix,
 
 // Return sqaure loss.
 real_t LinearLoss::Evaluate(const std::vector<real_t>& pred,
-                            const std::vector<real_t>& label) {
+                            const std::vector<real_t>& label,
+                            const real_t* weights) {
   CHECK_GT(pred.size(), 0);
   CHECK_GT(label.size(), 0);
-  return this->square_loss(pred, label);
+  return this->square_loss(pred, label, weights);
 }
 
 } // namespace f2m
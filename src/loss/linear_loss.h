@@ -43,7 +43,8 @@ class LinearLoss : public Loss {
   // Given the prediciton results and the ground truth, return the loss value.
   // For linear regression, we use the sqaure loss.
   real_t Evaluate(const std::vector<real_t>& pred,
-                  const std::vector<real_t>& label);
+                  const std::vector<real_t>& label,
+                  const real_t* weights = nullptr);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LinearLoss);
@@ -41,24 +41,49 @@ void LogitLoss::CalcGrad(const DMatrix* matrix,
   CHECK_NOTNULL(matrix);
   CHECK_GT(matrix->row_len, 0);
   CHECK_NOTNULL(updater);
+  const ColumnBlock* block = matrix->block;
+  CHECK_NOTNULL(block);
   std::vector<real_t> *w = param->GetParameter();
-  size_t row_len = matrix->row_len;
   // Calc real gradient
   index_t num_y = matrix->Y[0]->size();
+  if (result.size() < num_y) {
+    result.resize(num_y, 0);
+  }
   wTx(matrix, w, result);
   for (size_t i = 0; i < num_y; ++i) {
     real_t y = (*matrix->Y[0])[i] > 0 ? 1.0 : -1.0;
     result[i] = -y / (1.0 + (1.0 / fasterexp(-y * result[i])));
   }
-  real_t realGrad = 0.0;
-  for (size_t i = 0; i < row_len; ++i) {
-    SparseRow* row = matrix->row[i];
-    index_t col_len = row->column_len;
-    for (size_t j = 0; j < col_len; ++j) {
-      realGrad += result[row->idx[j]] * row->X[j];
+  real_t total_weight = WeightGrad(block, result);
+  const real_t* r = result.data();
+  for (index_t i = 0; i < block->num_columns; ++i) {
+    if (IsCategorical(*block, i)) {
+      continue;
+    }
+    real_t realGrad = 0.0;
+    const real_t* dense = DenseValues(*block, i);
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(*block, i, &value);
+    if (dense != nullptr) {
+      realGrad = DenseDot(r, dense, block->num_samples);
+    } else if (bits != nullptr) {
+      realGrad = value * BitmapSum(bits, r, block->num_samples);
+    } else {
+      ForEachEntry(*block, i, [&](index_t id, real_t x) {
+        realGrad += r[id] * x;
+      });
     }
-    realGrad /= num_y;
-    grad_->Addgrad(row->id, realGrad);
+    realGrad /= total_weight;
+    grad_->Addgrad(block->col_ids[i], realGrad);
+  }
+  for (index_t f = 0; f < block->num_categorical; ++f) {
+    const CategoricalField& field = block->categorical[f];
+    GatherField(block, field, w, 0);
+    real_t* g = code_grad.data();
+    ForEachSample(*block, field, [&](index_t id, index_t c) {
+      g[c] += r[id];
+    });
+    ScatterField(block, field, 0, 1.0 / total_weight);
   }
   // Updating in dense model
   updater->BatchUpdate(grad_, param);
@@ -67,10 +92,11 @@ void LogitLoss::CalcGrad(const DMatrix* matrix,
 
 // Return cross-entropy loss.
 real_t LogitLoss::Evaluate(const std::vector<real_t>& pred,
-                           const std::vector<real_t>& label) {
+                           const std::vector<real_t>& label,
+                           const real_t* weights) {
   CHECK_GT(pred.size(), 0);
   CHECK_GT(label.size(), 0);
-  return this->cross_entropy_loss(pred, label);
+  return this->cross_entropy_loss(pred, label, weights);
 }
 
 } // namespace f2mmZ
@@ -46,7 +46,8 @@ class LogitLoss : public Loss {
   // Given the prediction results and the ground truth, return the loss value.
   // For logistic regression, we use the cross-entropy loss.
   real_t Evaluate(const std::vector<real_t>& pred,
-                  const std::vector<real_t>& label);
+                  const std::vector<real_t>& label,
+                  const real_t* weights = nullptr);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LogitLoss);
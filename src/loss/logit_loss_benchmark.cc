@@ -0,0 +1,196 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file benchmarks one epoch of LogitLoss::CalcGrad on the column
+blocks stored in SparseRows (one heap-allocated SparseRow per column,
+as before) and in ColumnArenas (four contiguous arrays per block).
+
+  logit_loss_benchmark [num_blocks] [block_size] [nnz_per_sample] [num_feature]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/math.h"
+#include "src/base/stl-util.h"
+#include "src/data/data_structure.h"
+#include "src/data/hyper_parameters.h"
+#include "src/data/model_parameters_in_column.h"
+#include "src/loss/logit_loss.h"
+#include "src/update/updater.h"
+
+using namespace f2m;
+
+// One column block stored in both layouts.
+struct Block {
+  std::vector<real_t> Y;
+  std::vector<SparseRow*> rows;
+  ColumnArena arena;
+};
+
+// Build random blocks. Each sample has nnz_per_sample features.
+void BuildBlocks(int num_blocks, int block_size, int nnz_per_sample,
+                 int num_feature, std::vector<Block*>* blocks) {
+  std::mt19937 rng(2016);
+  std::uniform_int_distribution<int> feature(1, num_feature - 1);
+  std::vector<std::vector<index_t> > columns(num_feature);
+  for (int b = 0; b < num_blocks; ++b) {
+    Block* block = new Block;
+    block->Y.resize(block_size);
+    for (int i = 0; i < block_size; ++i) {
+      block->Y[i] = rng() % 2;
+      for (int j = 0; j < nnz_per_sample; ++j) {
+        columns[feature(rng)].push_back(i);
+      }
+    }
+    // The bias column
+    SparseRow* bias = new SparseRow(block_size);
+    for (int i = 0; i < block_size; ++i) {
+      bias->idx[i] = i;
+      bias->X[i] = 1.0;
+    }
+    block->rows.push_back(bias);
+    for (int id = 1; id < num_feature; ++id) {
+      if (columns[id].empty()) {
+        continue;
+      }
+      SparseRow* row = new SparseRow(columns[id].size());
+      row->id = id;
+      for (size_t k = 0; k < columns[id].size(); ++k) {
+        row->idx[k] = columns[id][k];
+        row->X[k] = 0.5;
+      }
+      block->rows.push_back(row);
+      columns[id].clear();
+    }
+    block->arena.CopyFrom(block->Y, block->rows.data(), block->rows.size());
+    blocks->push_back(block);
+  }
+}
+
+// The LogitLoss::CalcGrad that scans the SparseRows.
+void SparseRowCalcGrad(Block* block,
+                       Model* param,
+                       Updater* updater,
+                       Gradient* grad,
+                       std::vector<real_t>& result) {
+  std::vector<real_t> *w = param->GetParameter();
+  size_t row_len = block->rows.size();
+  index_t num_y = block->Y.size();
+  memset(result.data(), 0, sizeof(real_t) * num_y);
+  for (size_t i = 0; i < row_len; ++i) {
+    SparseRow* row = block->rows[i];
+    real_t w_i = (*w)[row->id];
+    for (size_t j = 0; j < row->column_len; ++j) {
+      result[row->idx[j]] += w_i * row->X[j];
+    }
+  }
+  for (size_t i = 0; i < num_y; ++i) {
+    real_t y = block->Y[i] > 0 ? 1.0 : -1.0;
+    result[i] = -y / (1.0 + (1.0 / fasterexp(-y * result[i])));
+  }
+  for (size_t i = 0; i < row_len; ++i) {
+    SparseRow* row = block->rows[i];
+    real_t realGrad = 0.0;
+    for (size_t j = 0; j < row->column_len; ++j) {
+      realGrad += result[row->idx[j]] * row->X[j];
+    }
+    realGrad /= num_y;
+    grad->Addgrad(row->id, realGrad);
+  }
+  updater->BatchUpdate(grad, param);
+  grad->Reset();
+}
+
+double Milliseconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  int num_blocks = argc > 1 ? atoi(argv[1]) : 200;
+  int block_size = argc > 2 ? atoi(argv[2]) : 1000;
+  int nnz_per_sample = argc > 3 ? atoi(argv[3]) : 40;
+  int num_feature = argc > 4 ? atoi(argv[4]) : 100000;
+  const int kNumEpoch = 5;
+
+  std::vector<Block*> blocks;
+  BuildBlocks(num_blocks, block_size, nnz_per_sample, num_feature, &blocks);
+
+  HyperParam hyper_param;
+  hyper_param.max_feature = num_feature;
+  hyper_param.num_param = num_feature;
+  hyper_param.batch_size = block_size;
+  Updater updater;
+  updater.Initialize(hyper_param);
+  LogitLoss loss;
+  loss.Initialize(hyper_param);
+  Gradient grad;
+  grad.Initialize(num_feature);
+  std::vector<real_t> result(block_size);
+  Model row_model(num_feature, SGD);
+  Model arena_model(num_feature, SGD);
+
+  double row_time = 0, arena_time = 0;
+  for (int epoch = 0; epoch < kNumEpoch; ++epoch) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      SparseRowCalcGrad(blocks[b], &row_model, &updater, &grad, result);
+    }
+    row_time += Milliseconds(start);
+    DMatrix matrix;
+    matrix.Y.push_back(nullptr);
+    start = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < blocks.size(); ++b) {
+      matrix.Y[0] = &blocks[b]->arena.Y;
+      matrix.block = &blocks[b]->arena.block;
+      matrix.Setlength(blocks[b]->arena.block.num_columns);
+      loss.CalcGrad(&matrix, &arena_model, &updater);
+    }
+    arena_time += Milliseconds(start);
+    matrix.Y.clear();
+  }
+
+  // Both layouts must give the same model.
+  std::vector<real_t>* w1 = row_model.GetParameter();
+  std::vector<real_t>* w2 = arena_model.GetParameter();
+  for (size_t i = 0; i < w1->size(); ++i) {
+    CHECK_EQ((*w1)[i], (*w2)[i]);
+  }
+
+  printf("blocks: %d, block size: %d, nnz per sample: %d, features: %d\n",
+         num_blocks, block_size, nnz_per_sample, num_feature);
+  printf("SparseRow   : %.2f ms / epoch\n", row_time / kNumEpoch);
+  printf("ColumnArena : %.2f ms / epoch\n", arena_time / kNumEpoch);
+  printf("Speedup     : %.2fx\n", row_time / arena_time);
+
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    STLDeleteElementsAndClear(&blocks[b]->rows);
+  }
+  STLDeleteElementsAndClear(&blocks);
+  return 0;
+}
@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests the gradients of LogitLoss::CalcGrad() on the plain and
+the encoded column blocks.
+*/
+
+#include "gtest/gtest.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/math.h"
+#include "src/data/column_codec.h"
+#include "src/data/data_structure.h"
+#include "src/data/hyper_parameters.h"
+#include "src/data/model_parameters_in_column.h"
+#include "src/loss/logit_loss.h"
+#include "src/update/updater.h"
+
+namespace f2m {
+
+const index_t kNumFeature = 8;
+
+// Keep the gradients of the last BatchUpdate(), instead of updating
+// the model.
+class RecordUpdater : public Updater {
+ public:
+  void BatchUpdate(Gradient* grad, Model* model) {
+    grads = *grad->GetDenseVector();
+  }
+
+  std::unordered_map<index_t, real_t> grads;
+};
+
+// Four samples and the columns:
+// bias (field 0): all the samples, value 1.
+// 1 (field 1): samples 0 and 1, value 1.
+// 2 (field 1): samples 2 and 3, value 1.
+// 3 (field 2): samples 0 and 1, value 0.5.
+// So the field 1 is one-hot.
+void BuildArena(ColumnArena* arena) {
+  arena->Y = {1, 1, 0, 1};
+  arena->col_ids = {0, 1, 2, 3};
+  arena->col_fields = {0, 1, 1, 2};
+  arena->idx = {0, 1, 2, 3,
+                0, 1,
+                2, 3,
+                0, 1};
+  arena->X = {1, 1, 1, 1,
+              1, 1,
+              1, 1,
+              0.5, 0.5};
+  arena->col_ptr = {0, 4, 6, 8, 10};
+  arena->weights.clear();
+  arena->UpdateView();
+}
+
+// With w = 0, every sample has the residual -y * h (h is about 1/2 by
+// fasterexp()), and the gradient of the column j is only its own
+// sum_i (-y_i * h) * x_ij / 4.
+void CheckGrads(const ColumnBlock& block) {
+  HyperParam hyper_param;
+  hyper_param.max_feature = kNumFeature;
+  hyper_param.batch_size = block.num_samples;
+  LogitLoss loss;
+  loss.Initialize(hyper_param);
+  Model model(kNumFeature, SGD);
+  RecordUpdater updater;
+  std::vector<real_t> Y(block.Y, block.Y + block.num_samples);
+  DMatrix matrix;
+  matrix.Y.push_back(&Y);
+  matrix.block = &block;
+  matrix.Setlength(block.num_columns);
+  loss.CalcGrad(&matrix, &model, &updater);
+  matrix.Y.clear();
+  real_t h = 1.0 / (1.0 + (1.0 / fasterexp(0)));
+  EXPECT_FLOAT_EQ(updater.grads[0], -h / 2);
+  EXPECT_FLOAT_EQ(updater.grads[1], -h / 2);
+  EXPECT_FLOAT_EQ(updater.grads[2], 0.0);
+  EXPECT_FLOAT_EQ(updater.grads[3], -h / 4);
+}
+
+TEST(LogitLossGradTest, PlainBlock) {
+  ColumnArena plain;
+  BuildArena(&plain);
+  CheckGrads(plain.block);
+}
+
+TEST(LogitLossGradTest, EncodedBlock) {
+  ColumnArena plain, encoded;
+  BuildArena(&plain);
+  EncodeBlock(plain.block, &encoded);
+  ASSERT_EQ(encoded.block.num_categorical, 1);
+  CheckGrads(encoded.block);
+}
+
+} // namespace f2m
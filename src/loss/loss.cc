@@ -55,35 +55,53 @@ void Loss::Predict(const DMatrix* matrix,
   wTx(matrix, w, pred);
 }
 
+// Multiply the partial gradient of each sample by its weight.
+real_t Loss::WeightGrad(const ColumnBlock* block,
+                        std::vector<real_t>& result) {
+  CHECK_NOTNULL(block);
+  if (block->weights != nullptr) {
+    for (index_t i = 0; i < block->num_samples; ++i) {
+      result[i] *= block->weights[i];
+    }
+  }
+  return TotalWeight(*block);
+}
+
 // Cross-entropy loss.
 real_t Loss::cross_entropy_loss(const std::vector<real_t>& pred,
-                                const std::vector<real_t>& label) {
+                                const std::vector<real_t>& label,
+                                const real_t* weights) {
   real_t objv = 0.0;
   for (index_t i = 0; i < pred.size(); ++i) {
     real_t y = label[i] > 0 ? 1.0 : -1.0;
-    objv += log(1.0 + fasterexp(-y*pred[i]));
+    real_t weight = weights != nullptr ? weights[i] : 1.0;
+    objv += weight * log(1.0 + fasterexp(-y*pred[i]));
   }
   return objv;
 }
 
 // Square loss.
 real_t Loss::square_loss(const std::vector<real_t>& pred,
-                         const std::vector<real_t>& label) {
+                         const std::vector<real_t>& label,
+                         const real_t* weights) {
   real_t objv = 0.0;
   for (index_t i = 0; i < pred.size(); ++i) {
     real_t tmp = label[i] - pred[i];
-    objv += 0.5 * (tmp*tmp);
+    real_t weight = weights != nullptr ? weights[i] : 1.0;
+    objv += weight * 0.5 * (tmp*tmp);
   }
   return objv;
 }
 
 // Hinge loss.
 real_t Loss::hinge_loss(const std::vector<real_t>& pred,
-                        const std::vector<real_t>& label) {
+                        const std::vector<real_t>& label,
+                        const real_t* weights) {
   real_t objv = 0.0;
   for (index_t i = 0; i < pred.size(); ++i) {
     real_t tmp = label[i] * pred[i];
-    objv += tmp < 1 ? 1 - tmp : 0;
+    real_t weight = weights != nullptr ? weights[i] : 1.0;
+    objv += tmp < 1 ? weight * (1 - tmp) : 0;
   }
   return objv;
 }
@@ -92,18 +110,61 @@ real_t Loss::hinge_loss(const std::vector<real_t>& pred,
 void Loss::wTx(const DMatrix* matrix,
                std::vector<real_t>* w,
                std::vector<real_t>& result) {
+  const ColumnBlock* block = matrix->block;
+  CHECK_NOTNULL(block);
   index_t num_y = matrix->Y[0]->size();
   memset(result.data(), 0, sizeof(real_t) * num_y);
-  //printf(" result size is %lu\n", result.size());
-  size_t row_len = matrix->row_len;
-  // Calc real gradient
-  for (size_t i = 0; i < row_len; ++i) {
-    SparseRow* row = matrix->row[i];
-    real_t w_i = (*w)[row->id];
-    index_t col_len = row->column_len;
-    for (size_t j = 0; j < col_len; ++j) {
-      result[row->idx[j]] += w_i * row->X[j];
+  real_t* r = result.data();
+  for (index_t i = 0; i < block->num_columns; ++i) {
+    if (IsCategorical(*block, i)) {
+      continue;
     }
+    real_t w_i = (*w)[block->col_ids[i]];
+    const real_t* dense = DenseValues(*block, i);
+    if (dense != nullptr) {
+      DenseAxpy(w_i, dense, block->num_samples, r);
+      continue;
+    }
+    real_t value = 0;
+    const uint8* bits = ColumnBitmap(*block, i, &value);
+    if (bits != nullptr) {
+      BitmapAdd(w_i * value, bits, block->num_samples, r);
+      continue;
+    }
+    ForEachEntry(*block, i, [&](index_t id, real_t x) {
+      r[id] += w_i * x;
+    });
+  }
+  for (index_t f = 0; f < block->num_categorical; ++f) {
+    const CategoricalField& field = block->categorical[f];
+    GatherField(block, field, w, 0);
+    const real_t* wx = code_wx.data();
+    ForEachSample(*block, field, [&](index_t id, index_t c) {
+      r[id] += wx[c];
+    });
+  }
+}
+
+void Loss::GatherField(const ColumnBlock* block,
+                       const CategoricalField& field,
+                       const std::vector<real_t>* w,
+                       size_t offset) {
+  const index_t* columns = FieldColumns(*block, field);
+  code_wx.resize(field.num_columns);
+  code_grad.assign(field.num_columns, 0);
+  for (index_t c = 0; c < field.num_columns; ++c) {
+    code_wx[c] = (*w)[block->col_ids[columns[c]] + offset] * field.value;
+  }
+}
+
+void Loss::ScatterField(const ColumnBlock* block,
+                        const CategoricalField& field,
+                        size_t offset,
+                        real_t scale) {
+  const index_t* columns = FieldColumns(*block, field);
+  for (index_t c = 0; c < field.num_columns; ++c) {
+    grad_->Addgrad(block->col_ids[columns[c]] + offset,
+                   code_grad[c] * field.value * scale);
   }
 }
 
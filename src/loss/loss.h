@@ -29,6 +29,7 @@ learning algorithms.
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
+#include "src/data/column_codec.h"
 #include "src/data/data_structure.h"
 #include "src/data/model_parameters_in_column.h"
 #include "src/data/hyper_parameters.h"
@@ -68,30 +69,58 @@ class Loss {
                         Updater* updater) = 0;
 
   // Given the prediction results and the groudtruth, return the loss value.
+  // Each sample is weighted by weights[i] (see ColumnBlock) if weights
+  // is not nullptr.
   virtual real_t Evaluate(const std::vector<real_t>& pred,
-                          const std::vector<real_t>& label) = 0;
+                          const std::vector<real_t>& label,
+                          const real_t* weights = nullptr) = 0;
 
  protected:
   // Define the cross-entropy loss.
   // Note that the cross-entropy loss takes -1 and 1 for positive and
   // negative examples, respectivly.
   real_t cross_entropy_loss(const std::vector<real_t>& pred,
-                            const std::vector<real_t>& label);
+                            const std::vector<real_t>& label,
+                            const real_t* weights = nullptr);
 
   // Define the square loss.
   real_t square_loss(const std::vector<real_t>& pred,
-                     const std::vector<real_t>& label);
+                     const std::vector<real_t>& label,
+                     const real_t* weights = nullptr);
 
   // Define the hinge loss
   real_t hinge_loss(const std::vector<real_t>& pred,
-                    const std::vector<real_t>& label);
+                    const std::vector<real_t>& label,
+                    const real_t* weights = nullptr);
+
+  // Multiply the partial gradient of each sample in result by its
+  // weight (see ColumnBlock), and return the total weight of the block,
+  // which takes the place of the number of samples in the mean of the
+  // gradients.
+  real_t WeightGrad(const ColumnBlock* block, std::vector<real_t>& result);
 
   // Calculate wTx.
   virtual void wTx(const DMatrix* matrix,
                    std::vector<real_t>* w,
                    std::vector<real_t>& result);
 
+  // Gather w[id + offset] * value of the columns of the categorical
+  // field (see column_codec.h) into code_wx, and clear code_grad.
+  void GatherField(const ColumnBlock* block,
+                   const CategoricalField& field,
+                   const std::vector<real_t>* w,
+                   size_t offset);
+
+  // Add code_grad * value * scale to the gradient of each column of
+  // the categorical field.
+  void ScatterField(const ColumnBlock* block,
+                    const CategoricalField& field,
+                    size_t offset,
+                    real_t scale);
+
   std::vector<real_t> result;
+  std::vector<real_t> code_wx;     // w * x of each code of a field
+  std::vector<real_t> code_grad;   // Partial gradient of each code
   Gradient* grad_;   // Storing gradient in dense model
   bool is_sparse_;   // Dense or sparse
 
@@ -39,7 +39,8 @@ class TestLoss : public Loss {
                 Gradient* grad) {}
 
   real_t Evaluate(const std::vector<real_t>& pred,
-                  const std::vector<real_t>& label) { return 0.0; }
+                  const std::vector<real_t>& label,
+                  const real_t* weights) { return 0.0; }
 
   real_t CrossEntropy(const std::vector<real_t>& pred,
                       const std::vector<real_t>& label) {
@@ -56,10 +56,11 @@ void SVMLoss::CalcGrad(const DMatrix* matrix,
 }
 
 real_t SVMLoss::Evaluate(const std::vector<real_t>& pred,
-                         const std::vector<real_t>& label) {
+                         const std::vector<real_t>& label,
+                         const real_t* weights) {
   CHECK_GT(pred.size(), 0);
   CHECK_GT(label.size(), 0);
-  return this->hinge_loss(pred, label);
+  return this->hinge_loss(pred, label, weights);
 }
 
 } // namespace f2m
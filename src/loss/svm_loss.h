@@ -43,7 +43,8 @@ class SVMLoss : public Loss {
   // Given the prediction results and the groud truth, return the loss value.
   // For SVM, we use the hinge loss.
   real_t Evaluate(const std::vector<real_t>& pred,
-                  const std::vector<real_t>& label);
+                  const std::vector<real_t>& label,
+                  const real_t* weights = nullptr);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(SVMLoss);
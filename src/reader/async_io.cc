@@ -0,0 +1,317 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of async_io.h.
+*/
+
+#include "src/reader/async_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define F2M_HAS_IO_URING
+#endif
+#endif
+
+namespace f2m {
+
+int OpenForRead(const std::string& filename, bool direct, bool* is_direct) {
+  *is_direct = false;
+#if defined(O_DIRECT)
+  if (direct) {
+    int fd = open(filename.c_str(), O_RDONLY | O_DIRECT);
+    if (fd != -1) {
+      *is_direct = true;
+      return fd;
+    }
+    if (errno != EINVAL) {
+      return -1;
+    }
+    LOG(WARNING) << "O_DIRECT is not supported by the file system of "
+                 << filename << ", use the page cache instead.";
+  }
+#endif
+  return open(filename.c_str(), O_RDONLY);
+}
+
+char* AllocateAligned(uint64 size) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, kDirectIOAlignment, size) != 0) {
+    LOG(FATAL) << "Cannot allocate " << size << " bytes.";
+  }
+  return reinterpret_cast<char*>(ptr);
+}
+
+//------------------------------------------------------------------------------
+// Implementation of AsyncIO
+//------------------------------------------------------------------------------
+
+AsyncIO::AsyncIO()
+  : queue_depth_(0),
+    num_pending_(0),
+    ring_fd_(-1),
+    sq_ring_(nullptr),
+    sq_ring_size_(0),
+    cq_ring_(nullptr),
+    cq_ring_size_(0),
+    sqes_(nullptr),
+    sqes_size_(0),
+    sq_head_(nullptr),
+    sq_tail_(nullptr),
+    sq_mask_(nullptr),
+    sq_array_(nullptr),
+    cq_head_(nullptr),
+    cq_tail_(nullptr),
+    cq_mask_(nullptr),
+    cqes_(nullptr) {  }
+
+AsyncIO::~AsyncIO() {
+  // The kernel may still write to the buffers of the reads in flight.
+  uint64 bytes = 0;
+  while (num_pending_ > 0) {
+    Wait(&bytes);
+  }
+  CloseRing();
+}
+
+void AsyncIO::Initialize(int queue_depth, bool use_uring) {
+  CHECK_GT(queue_depth, 0);
+  CHECK_EQ(num_pending_, 0);
+  CloseRing();
+  queue_depth_ = queue_depth;
+  requests_.resize(queue_depth);
+  free_requests_.clear();
+  for (int i = queue_depth - 1; i >= 0; --i) {
+    free_requests_.push_back(i);
+  }
+  completed_.clear();
+  if (use_uring && !SetupRing(queue_depth)) {
+    LOG(WARNING) << "io_uring is not available, fall back to pread().";
+  }
+}
+
+#if defined(F2M_HAS_IO_URING)
+
+static int IoUringSetup(unsigned entries, struct io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int IoUringEnter(int fd, unsigned to_submit,
+                        unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                 flags, NULL, 0);
+}
+
+static void* MapRing(int fd, uint64 size, uint64 offset) {
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+bool AsyncIO::SetupRing(int queue_depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = IoUringSetup(queue_depth, &params);
+  if (fd < 0) {
+    return false;
+  }
+  ring_fd_ = fd;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes +
+                  params.cq_entries * sizeof(struct io_uring_cqe);
+  // Since Linux 5.4, the two rings are mapped by one mmap().
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ =
+        std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = MapRing(fd, sq_ring_size_, IORING_OFF_SQ_RING);
+  cq_ring_ = single_mmap ? sq_ring_
+                         : MapRing(fd, cq_ring_size_, IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = MapRing(fd, sqes_size_, IORING_OFF_SQES);
+  if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr) {
+    CloseRing();
+    return false;
+  }
+  char* sq = reinterpret_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = reinterpret_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  return true;
+}
+
+void AsyncIO::CloseRing() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  sqes_ = sq_ring_ = cq_ring_ = nullptr;
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+// We are the only producer of the submission queue, and each request
+// is submitted as soon as it is queued, so the queue never overflows.
+void AsyncIO::Submit(int request) {
+  Request& r = requests_[request];
+  r.iov.iov_base = r.buf + r.done;
+  r.iov.iov_len = r.size - r.done;
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & *sq_mask_;
+  struct io_uring_sqe* sqe =
+      reinterpret_cast<struct io_uring_sqe*>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = r.fd;
+  sqe->addr = reinterpret_cast<uint64>(&r.iov);
+  sqe->len = 1;
+  sqe->off = r.offset + r.done;
+  sqe->user_data = request;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  for (;;) {
+    int ret = IoUringEnter(ring_fd_, 1, 0, 0);
+    if (ret >= 0) {
+      break;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      LOG(FATAL) << "Cannot submit to io_uring: " << strerror(errno);
+    }
+  }
+}
+
+#else  // F2M_HAS_IO_URING
+
+bool AsyncIO::SetupRing(int queue_depth) { return false; }
+
+void AsyncIO::CloseRing() {  }
+
+void AsyncIO::Submit(int request) {
+  LOG(FATAL) << "io_uring is not supported.";
+}
+
+#endif  // F2M_HAS_IO_URING
+
+void AsyncIO::ReadAll(int request) {
+  Request& r = requests_[request];
+  while (r.done < r.size) {
+    ssize_t ret = pread(r.fd, r.buf + r.done, r.size - r.done,
+                        r.offset + r.done);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(FATAL) << "Cannot read file: " << strerror(errno);
+    }
+    if (ret == 0) {
+      break;
+    }
+    r.done += ret;
+  }
+}
+
+void AsyncIO::Read(int fd, uint64 id, char* buf, uint64 offset, uint64 size) {
+  CHECK(!free_requests_.empty());
+  int request = free_requests_.back();
+  free_requests_.pop_back();
+  Request& r = requests_[request];
+  r.fd = fd;
+  r.id = id;
+  r.buf = buf;
+  r.offset = offset;
+  r.size = size;
+  r.done = 0;
+  ++num_pending_;
+  if (IsAsync()) {
+    Submit(request);
+  } else {
+    ReadAll(request);
+    completed_.push_back(request);
+  }
+}
+
+uint64 AsyncIO::Wait(uint64* bytes) {
+  CHECK_GT(num_pending_, 0);
+  int request = -1;
+  if (!IsAsync()) {
+    request = completed_.front();
+    completed_.pop_front();
+  }
+#if defined(F2M_HAS_IO_URING)
+  while (request == -1) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      int ret = IoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+      if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        LOG(FATAL) << "Cannot wait for io_uring: " << strerror(errno);
+      }
+      continue;
+    }
+    struct io_uring_cqe* cqe =
+        reinterpret_cast<struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    int r = cqe->user_data;
+    int res = cqe->res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    if (res == -EINTR || res == -EAGAIN) {
+      Submit(r);
+      continue;
+    }
+    if (res < 0) {
+      LOG(FATAL) << "Cannot read file: " << strerror(-res);
+    }
+    requests_[r].done += res;
+    // A short read before the end of file, so we read the rest.
+    if (res > 0 && requests_[r].done < requests_[r].size) {
+      Submit(r);
+      continue;
+    }
+    request = r;
+  }
+#endif
+  --num_pending_;
+  free_requests_.push_back(request);
+  *bytes = requests_[request].done;
+  return requests_[request].id;
+}
+
+} // namespace f2m
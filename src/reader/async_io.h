@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the AsyncIO class, which reads the ranges of files
+asynchronously by the io_uring of Linux. We invoke the io_uring system
+calls directly, so there is no dependency on liburing.
+*/
+
+#ifndef F2M_READER_ASYNC_IO_H_
+#define F2M_READER_ASYNC_IO_H_
+
+#include <sys/uio.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+
+namespace f2m {
+
+// The buffers, offsets and sizes of O_DIRECT reads must be aligned to
+// the logical block size of the device, which is at most 4 KB.
+static const uint64 kDirectIOAlignment = 4096;
+
+// Open the file for reading. If direct is true, we try O_DIRECT first,
+// and fall back to the page cache if the file system does not support
+// it (e.g., tmpfs). *is_direct tells which one we get. Return -1 if we
+// cannot open the file.
+int OpenForRead(const std::string& filename, bool direct, bool* is_direct);
+
+// Allocate a kDirectIOAlignment aligned buffer, which is freed by free().
+char* AllocateAligned(uint64 size);
+
+//------------------------------------------------------------------------------
+// AsyncIO keeps at most queue_depth reads in flight. Each read has an
+// id given by the caller, and Wait() returns the ids in the order of
+// completion, which may be different from the order of Read(). We can
+// use it like this:
+//
+//   AsyncIO io;
+//   io.Initialize(8);
+//   io.Read(fd, 0, buf_0, offset_0, size_0);
+//   io.Read(fd, 1, buf_1, offset_1, size_1);
+//   uint64 bytes = 0;
+//   uint64 id = io.Wait(&bytes);   // buf_<id> is ready
+//
+// If io_uring is not available (old kernel, seccomp, or
+// io_uring_disabled), we fall back to pread(), which reads the data in
+// Read() and only queues the id for Wait().
+//------------------------------------------------------------------------------
+class AsyncIO {
+ public:
+  AsyncIO();
+  ~AsyncIO();
+
+  // Set up the io_uring. We use pread() if use_uring is false or
+  // io_uring is not available.
+  void Initialize(int queue_depth, bool use_uring = true);
+
+  // Start reading [offset, offset + size) of fd to buf. It must not be
+  // invoked when there are already queue_depth reads in flight.
+  void Read(int fd, uint64 id, char* buf, uint64 offset, uint64 size);
+
+  // Wait for a read to complete, and return its id. *bytes is the
+  // number of bytes we read, which is less than the size only at the
+  // end of file.
+  uint64 Wait(uint64* bytes);
+
+  // Number of reads in flight.
+  int NumPending() const { return num_pending_; }
+
+  // Return true if we are using io_uring.
+  bool IsAsync() const { return ring_fd_ != -1; }
+
+ private:
+  // A read in flight.
+  struct Request {
+    int fd;
+    uint64 id;
+    char* buf;
+    uint64 offset;
+    uint64 size;
+    uint64 done;        // Bytes we have read
+    struct iovec iov;   // Must be kept until completion
+  };
+
+  int queue_depth_;
+  int num_pending_;
+  std::vector<Request> requests_;
+  std::vector<int> free_requests_;
+  std::deque<int> completed_;   // Only used by pread()
+  // The mapped rings of io_uring
+  int ring_fd_;
+  void* sq_ring_;
+  uint64 sq_ring_size_;
+  void* cq_ring_;
+  uint64 cq_ring_size_;
+  void* sqes_;
+  uint64 sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  void* cqes_;
+
+  // Map the rings of io_uring. Return false if it is not available.
+  bool SetupRing(int queue_depth);
+
+  // Unmap the rings.
+  void CloseRing();
+
+  // Submit the rest of the request to io_uring.
+  void Submit(int request);
+
+  // Read the rest of the request by pread().
+  void ReadAll(int request);
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncIO);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_ASYNC_IO_H_
@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests async_io.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/reader/async_io.h"
+
+using std::string;
+using std::vector;
+
+namespace f2m {
+
+const string kTestfilename = "/tmp/test_async_io.bin";
+
+// Read random aligned ranges with at most queue_depth reads in flight,
+// and check the data of each completed read.
+void ReadRanges(bool use_uring, bool direct, int queue_depth) {
+  string data;
+  std::mt19937 rng(2016);
+  for (int i = 0; i < 1000003; ++i) {
+    data.push_back(rng() % 256);
+  }
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "w");
+  WriteDataToDisk(file, data.data(), data.size());
+  Close(file);
+  bool is_direct = false;
+  int fd = OpenForRead(kTestfilename, direct, &is_direct);
+  ASSERT_NE(fd, -1);
+  EXPECT_TRUE(direct || !is_direct);
+  AsyncIO io;
+  io.Initialize(queue_depth, use_uring);
+  EXPECT_TRUE(use_uring || !io.IsAsync());
+  const uint64 kNumReads = 100;
+  const uint64 kMaxSize = 16 * kDirectIOAlignment;
+  vector<char*> buffers(kNumReads);
+  vector<uint64> offsets(kNumReads), sizes(kNumReads);
+  vector<bool> completed(kNumReads, false);
+  uint64 num_pages = data.size() / kDirectIOAlignment + 1;
+  for (uint64 i = 0; i < kNumReads; ++i) {
+    buffers[i] = AllocateAligned(kMaxSize);
+    offsets[i] = rng() % num_pages * kDirectIOAlignment;
+    sizes[i] = (rng() % 16 + 1) * kDirectIOAlignment;
+  }
+  uint64 next = 0;
+  for (uint64 n = 0; n < kNumReads; ++n) {
+    while (next < kNumReads && io.NumPending() < queue_depth) {
+      io.Read(fd, next, buffers[next], offsets[next], sizes[next]);
+      ++next;
+    }
+    uint64 bytes = 0;
+    uint64 id = io.Wait(&bytes);
+    ASSERT_LT(id, kNumReads);
+    EXPECT_FALSE(completed[id]);
+    completed[id] = true;
+    // Only the read at the end of file is short.
+    uint64 expected = std::min(sizes[id], data.size() - offsets[id]);
+    ASSERT_EQ(bytes, expected);
+    EXPECT_EQ(memcmp(buffers[id], data.data() + offsets[id], bytes), 0);
+  }
+  EXPECT_EQ(io.NumPending(), 0);
+  for (uint64 i = 0; i < kNumReads; ++i) {
+    free(buffers[i]);
+  }
+  close(fd);
+  RemoveFile(kTestfilename.c_str());
+}
+
+TEST(ASYNC_IO_TEST, ReadByUring) {
+  ReadRanges(true, true, 1);
+  ReadRanges(true, true, 8);
+  ReadRanges(true, false, 8);
+}
+
+TEST(ASYNC_IO_TEST, ReadByPread) {
+  ReadRanges(false, true, 8);
+  ReadRanges(false, false, 1);
+}
+
+} // namespace f2m
@@ -0,0 +1,408 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the binary column-block format.
+*/
+
+#include "src/reader/binary_format.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+
+namespace f2m {
+
+static const char kZeroPadding[kBlockAlignment] = { 0 };
+
+uint64 BinaryBlockSize(index_t num_samples,
+                       index_t num_columns,
+                       index_t nnz,
+                       bool has_fields) {
+  return sizeof(BinaryBlockHeader) +
+         sizeof(real_t) * num_samples +
+         sizeof(index_t) * num_columns +
+         sizeof(index_t) * (num_columns + 1) +
+         sizeof(index_t) * nnz +
+         sizeof(real_t) * nnz +
+         (has_fields ? sizeof(index_t) * num_columns : 0);
+}
+
+void BinaryBlockView(const char* buf, ColumnBlock* block) {
+  CHECK_NOTNULL(buf);
+  CHECK_NOTNULL(block);
+  const BinaryBlockHeader* header =
+      reinterpret_cast<const BinaryBlockHeader*>(buf);
+  block->num_samples = header->num_samples;
+  block->num_columns = header->num_columns;
+  block->nnz = header->nnz;
+  const char* p = buf + sizeof(BinaryBlockHeader);
+  block->Y = reinterpret_cast<const real_t*>(p);
+  p += sizeof(real_t) * block->num_samples;
+  block->col_ids = reinterpret_cast<const index_t*>(p);
+  p += sizeof(index_t) * block->num_columns;
+  block->col_ptr = reinterpret_cast<const index_t*>(p);
+  p += sizeof(index_t) * (block->num_columns + 1);
+  block->idx = reinterpret_cast<const index_t*>(p);
+  p += sizeof(index_t) * block->nnz;
+  block->X = reinterpret_cast<const real_t*>(p);
+  p += sizeof(real_t) * block->nnz;
+  block->col_fields = (header->flags & kBlockHasFields) ?
+      reinterpret_cast<const index_t*>(p) : nullptr;
+  block->weights = nullptr;
+  block->col_codecs = nullptr;
+  block->col_offsets = nullptr;
+  block->packed = nullptr;
+  block->num_categorical = 0;
+  block->categorical = nullptr;
+}
+
+bool IsValidBinaryBlock(const char* buf, uint64 size) {
+  CHECK_NOTNULL(buf);
+  if (size < sizeof(BinaryBlockHeader)) {
+    return false;
+  }
+  const BinaryBlockHeader* header =
+      reinterpret_cast<const BinaryBlockHeader*>(buf);
+  bool has_fields = header->flags & kBlockHasFields;
+  if (header->num_columns == 0 ||
+      BinaryBlockSize(header->num_samples, header->num_columns, header->nnz,
+                      has_fields) > size) {
+    return false;
+  }
+  // The column lengths must add up to nnz.
+  const index_t* col_ptr = reinterpret_cast<const index_t*>(
+      buf + sizeof(BinaryBlockHeader) +
+      sizeof(real_t) * header->num_samples +
+      sizeof(index_t) * header->num_columns);
+  return col_ptr[0] == 0 && col_ptr[header->num_columns] == header->nnz;
+}
+
+void GetFileStat(const std::string& filename, uint64* size, int64* mtime) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) {
+    LOG(FATAL) << "Cannot stat file: " << filename;
+  }
+  *size = st.st_size;
+  *mtime = static_cast<int64>(st.st_mtim.tv_sec) * 1000000000 +
+           st.st_mtim.tv_nsec;
+}
+
+// Read the file header. Return false if it is not a binary file.
+static bool ReadHeader(const std::string& filename, BinaryFileHeader* header) {
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  size_t read_len = fread(header, 1, sizeof(BinaryFileHeader), file);
+  Close(file);
+  return read_len == sizeof(BinaryFileHeader) &&
+         memcmp(header->magic, kBinaryMagic, sizeof(kBinaryMagic)) == 0;
+}
+
+bool IsBinaryFile(const std::string& filename) {
+  BinaryFileHeader header;
+  return ReadHeader(filename, &header);
+}
+
+bool IsValidBinaryCache(const std::string& cache_file,
+                        const std::string& source_file) {
+  BinaryFileHeader header;
+  if (!ReadHeader(cache_file, &header) ||
+      header.version != kBinaryVersion) {
+    return false;
+  }
+  uint64 size = 0;
+  int64 mtime = 0;
+  GetFileStat(source_file, &size, &mtime);
+  return header.source_size == size && header.source_mtime == mtime;
+}
+
+// Read the header and the ends of col_ptr of the block of size bytes
+// at offset of the file, and check them as IsValidBinaryBlock() does,
+// without reading the whole block.
+static bool IsValidBlockAt(FILE* file, uint64 offset, uint64 size) {
+  BinaryBlockHeader header;
+  if (size < sizeof(BinaryBlockHeader) ||
+      fseek(file, offset, SEEK_SET) != 0 ||
+      fread(&header, sizeof(header), 1, file) != 1) {
+    return false;
+  }
+  bool has_fields = header.flags & kBlockHasFields;
+  if (header.num_columns == 0 ||
+      BinaryBlockSize(header.num_samples, header.num_columns, header.nnz,
+                      has_fields) > size) {
+    return false;
+  }
+  index_t first = 0, last = 0;
+  uint64 col_ptr = offset + sizeof(BinaryBlockHeader) +
+                   sizeof(real_t) * header.num_samples +
+                   sizeof(index_t) * header.num_columns;
+  return fseek(file, col_ptr, SEEK_SET) == 0 &&
+         fread(&first, sizeof(first), 1, file) == 1 &&
+         fseek(file, col_ptr + sizeof(index_t) * header.num_columns,
+               SEEK_SET) == 0 &&
+         fread(&last, sizeof(last), 1, file) == 1 &&
+         first == 0 && last == header.nnz;
+}
+
+bool ReadBlockTable(const std::string& filename,
+                    std::vector<uint64>* offsets,
+                    std::vector<uint64>* sizes) {
+  CHECK_NOTNULL(offsets);
+  CHECK_NOTNULL(sizes);
+  BinaryFileHeader header;
+  if (!ReadHeader(filename, &header) ||
+      header.version != kBinaryVersion) {
+    return false;
+  }
+  uint64 file_size = 0;
+  int64 mtime = 0;
+  GetFileStat(filename, &file_size, &mtime);
+  // Check the offset table against the file size before allocating it,
+  // so that a corrupt num_blocks cannot ask for a huge table.
+  if (header.index_offset < sizeof(BinaryFileHeader) ||
+      header.index_offset > file_size ||
+      header.num_blocks > (file_size - header.index_offset) / sizeof(uint64)) {
+    return false;
+  }
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  offsets->resize(header.num_blocks);
+  bool valid =
+      fseek(file, header.index_offset, SEEK_SET) == 0 &&
+      fread(offsets->data(), sizeof(uint64), header.num_blocks, file) ==
+          header.num_blocks;
+  sizes->resize(header.num_blocks);
+  for (size_t i = 0; valid && i < offsets->size(); ++i) {
+    // The blocks are written in order, so each block must end before
+    // the next one (or the offset table) starts.
+    uint64 begin = (*offsets)[i];
+    uint64 end = i + 1 < offsets->size() ? (*offsets)[i + 1]
+                                         : header.index_offset;
+    valid = begin >= sizeof(BinaryFileHeader) && begin <= end &&
+            end <= header.index_offset &&
+            IsValidBlockAt(file, begin, end - begin);
+    (*sizes)[i] = end - begin;
+  }
+  Close(file);
+  return valid;
+}
+
+//------------------------------------------------------------------------------
+// Implementation of BinaryWriter
+//------------------------------------------------------------------------------
+
+bool BinaryWriter::Open(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  filename_ = filename;
+  tmp_filename_ = filename + ".tmp";
+  file_ = fopen(tmp_filename_.c_str(), "w");
+  if (file_ == nullptr) {
+    return false;
+  }
+  memset(&header_, 0, sizeof(header_));
+  memcpy(header_.magic, kBinaryMagic, sizeof(kBinaryMagic));
+  header_.version = kBinaryVersion;
+  header_.header_size = sizeof(BinaryFileHeader);
+  offsets_.clear();
+  offset_ = 0;
+  // Leave room for the header, which is written in Close().
+  Write(&header_, sizeof(header_));
+  return true;
+}
+
+void BinaryWriter::SetSource(const std::string& source_file) {
+  GetFileStat(source_file, &header_.source_size, &header_.source_mtime);
+}
+
+void BinaryWriter::StartBlock(index_t num_samples,
+                              index_t num_columns,
+                              index_t nnz,
+                              uint32 flags) {
+  CHECK_NOTNULL(file_);
+  uint64 padding = (kBlockAlignment - offset_ % kBlockAlignment)
+                   % kBlockAlignment;
+  Write(kZeroPadding, padding);
+  offsets_.push_back(offset_);
+  BinaryBlockHeader block_header;
+  block_header.num_samples = num_samples;
+  block_header.num_columns = num_columns;
+  block_header.nnz = nnz;
+  block_header.flags = flags;
+  Write(&block_header, sizeof(block_header));
+  header_.num_blocks++;
+  header_.num_samples += num_samples;
+  header_.nnz += nnz;
+}
+
+void BinaryWriter::WriteBlock(const std::vector<real_t>& Y,
+                              SparseRow* const* rows,
+                              size_t num_rows) {
+  CHECK_NOTNULL(rows);
+  CHECK_GT(num_rows, 0);
+  uint64 nnz = 0;
+  for (size_t i = 0; i < num_rows; ++i) {
+    nnz += rows[i]->column_len;
+  }
+  CHECK_LE(nnz, kUInt32Max);
+  StartBlock(Y.size(), num_rows, nnz, 0);
+  Write(Y.data(), sizeof(real_t) * Y.size());
+  for (size_t i = 0; i < num_rows; ++i) {
+    index_t id = rows[i]->id;
+    if (id > header_.max_feature) {
+      header_.max_feature = id;
+    }
+    Write(&id, sizeof(id));
+  }
+  index_t pos = 0;
+  Write(&pos, sizeof(pos));
+  for (size_t i = 0; i < num_rows; ++i) {
+    pos += rows[i]->column_len;
+    Write(&pos, sizeof(pos));
+  }
+  for (size_t i = 0; i < num_rows; ++i) {
+    Write(rows[i]->idx.data(), sizeof(index_t) * rows[i]->column_len);
+  }
+  for (size_t i = 0; i < num_rows; ++i) {
+    Write(rows[i]->X.data(), sizeof(real_t) * rows[i]->column_len);
+  }
+}
+
+void BinaryWriter::WriteBlock(const ColumnBlock& block) {
+  // The encoded columns are only kept in memory.
+  CHECK(block.col_codecs == nullptr);
+  StartBlock(block.num_samples, block.num_columns, block.nnz,
+             block.col_fields != nullptr ? kBlockHasFields : 0);
+  Write(block.Y, sizeof(real_t) * block.num_samples);
+  Write(block.col_ids, sizeof(index_t) * block.num_columns);
+  Write(block.col_ptr, sizeof(index_t) * (block.num_columns + 1));
+  Write(block.idx, sizeof(index_t) * block.nnz);
+  Write(block.X, sizeof(real_t) * block.nnz);
+  if (block.col_fields != nullptr) {
+    Write(block.col_fields, sizeof(index_t) * block.num_columns);
+  }
+  for (index_t i = 0; i < block.num_columns; ++i) {
+    if (block.col_ids[i] > header_.max_feature) {
+      header_.max_feature = block.col_ids[i];
+    }
+  }
+}
+
+void BinaryWriter::Write(const void* buf, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  WriteDataToDisk(file_, reinterpret_cast<const char*>(buf), len);
+  offset_ += len;
+}
+
+void BinaryWriter::Close() {
+  CHECK_NOTNULL(file_);
+  header_.index_offset = offset_;
+  Write(offsets_.data(), sizeof(uint64) * offsets_.size());
+  // Write the header at the begining of the file.
+  if (fseek(file_, 0L, SEEK_SET) != 0) {
+    LOG(FATAL) << "Error: invoke fseek().";
+  }
+  WriteDataToDisk(file_,
+                  reinterpret_cast<const char*>(&header_),
+                  sizeof(header_));
+  ::Close(file_);
+  file_ = nullptr;
+  if (rename(tmp_filename_.c_str(), filename_.c_str()) != 0) {
+    LOG(FATAL) << "Cannot rename " << tmp_filename_
+               << " to " << filename_;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Implementation of BinaryFile
+//------------------------------------------------------------------------------
+
+bool BinaryFile::Open(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(BinaryFileHeader)) {
+    close(fd);
+    return false;
+  }
+  size_ = st.st_size;
+  void* ptr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    LOG(ERROR) << "Cannot mmap file: " << filename;
+    size_ = 0;
+    return false;
+  }
+  buf_ = reinterpret_cast<char*>(ptr);
+  const BinaryFileHeader& header = Header();
+  if (memcmp(header.magic, kBinaryMagic, sizeof(kBinaryMagic)) != 0 ||
+      header.version != kBinaryVersion ||
+      header.index_offset < sizeof(BinaryFileHeader) ||
+      header.index_offset > size_ ||
+      header.num_blocks > (size_ - header.index_offset) / sizeof(uint64)) {
+    LOG(ERROR) << "Invalid binary file: " << filename;
+    Close();
+    return false;
+  }
+  const uint64* offsets =
+      reinterpret_cast<const uint64*>(buf_ + header.index_offset);
+  blocks_.resize(header.num_blocks);
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    // The blocks are written in order, so each block must end before
+    // the next one (or the offset table) starts.
+    uint64 end = i + 1 < blocks_.size() ? offsets[i+1] : header.index_offset;
+    if (!IsValidBlock(offsets[i], end)) {
+      LOG(ERROR) << "Invalid block " << i << " of binary file: " << filename;
+      Close();
+      return false;
+    }
+    BinaryBlockView(buf_ + offsets[i], &blocks_[i]);
+  }
+  return true;
+}
+
+bool BinaryFile::IsValidBlock(uint64 begin, uint64 end) const {
+  if (begin < sizeof(BinaryFileHeader) || begin > end ||
+      end > Header().index_offset) {
+    return false;
+  }
+  return IsValidBinaryBlock(buf_ + begin, end - begin);
+}
+
+void BinaryFile::Close() {
+  if (buf_ != nullptr) {
+    munmap(buf_, size_);
+    buf_ = nullptr;
+    size_ = 0;
+  }
+  blocks_.clear();
+}
+
+} // namespace f2m
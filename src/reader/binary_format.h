@@ -0,0 +1,219 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the binary column-block format, which can be mapped
+into memory and used by the Loss without any parsing.
+*/
+
+#ifndef F2M_READER_BINARY_FORMAT_H_
+#define F2M_READER_BINARY_FORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// The binary file has the following layout:
+//
+//   [BinaryFileHeader]
+//   [block 0] [block 1] ... [block N-1]
+//   [uint64 offset of block 0] ... [uint64 offset of block N-1]
+//
+// Each block starts at a kBlockAlignment aligned offset and looks like:
+//
+//   [BinaryBlockHeader]
+//   [real_t  Y[num_samples]]
+//   [index_t col_ids[num_columns]]
+//   [index_t col_ptr[num_columns + 1]]
+//   [index_t idx[nnz]]
+//   [real_t  X[nnz]]
+//   [index_t col_fields[num_columns]]    <- only if kBlockHasFields
+//
+// which is exactly the layout of the ColumnBlock, so a mapped block can be
+// used as a ColumnBlock without any copy. The column lengths are given by
+// the differences of col_ptr. The first column of each block is the bias.
+// The fields of the libffm data are stored after X, so the blocks without
+// fields are the same as before.
+//------------------------------------------------------------------------------
+
+static const char kBinaryMagic[8] = { 'F', '2', 'M', 'C', 'O', 'L', 'B', 'K' };
+static const uint32 kBinaryVersion = 1;
+static const uint64 kBlockAlignment = 64;
+
+// The flags of BinaryBlockHeader.
+static const uint32 kBlockHasFields = 1;
+
+// The binary cache of "train.txt" is "train.txt.bin".
+static const char kBinaryCacheSuffix[] = ".bin";
+
+struct BinaryFileHeader {
+  char magic[8];             // kBinaryMagic
+  uint32 version;            // kBinaryVersion
+  uint32 header_size;        // sizeof(BinaryFileHeader)
+  uint64 num_blocks;         // Number of column blocks.
+  uint64 num_samples;        // Number of samples of all the blocks.
+  uint64 nnz;                // Number of entries of all the blocks.
+  uint64 max_feature;        // The max feature id.
+  uint64 index_offset;       // Offset of the block offset table.
+  uint64 source_size;        // Size of the text file we converted from.
+  int64 source_mtime;        // Modify time (ns) of the text file.
+};
+
+struct BinaryBlockHeader {
+  uint32 num_samples;
+  uint32 num_columns;
+  uint32 nnz;
+  uint32 flags;
+};
+
+// Return the size (in bytes) of a block, including its header.
+uint64 BinaryBlockSize(index_t num_samples,
+                       index_t num_columns,
+                       index_t nnz,
+                       bool has_fields = false);
+
+// Build a ColumnBlock on a block which starts at buf.
+void BinaryBlockView(const char* buf, ColumnBlock* block);
+
+// Return true if the block of size bytes which starts at buf has the
+// extent given by its header, i.e., BinaryBlockView() on the block does
+// not read past the end of it.
+bool IsValidBinaryBlock(const char* buf, uint64 size);
+
+// Return true if the file starts with kBinaryMagic.
+bool IsBinaryFile(const std::string& filename);
+
+// Return true if cache_file is a binary cache of source_file and
+// the size and the modify time of source_file did not change.
+bool IsValidBinaryCache(const std::string& cache_file,
+                        const std::string& source_file);
+
+// Read the offset and the size of each block from the offset table of
+// the binary file, without mapping the file. The size of a block
+// includes the padding after it. Return false if the file, or the
+// header of a block, is not valid.
+bool ReadBlockTable(const std::string& filename,
+                    std::vector<uint64>* offsets,
+                    std::vector<uint64>* sizes);
+
+// Get the size and the modify time (in nanoseconds) of a file. The
+// seconds cannot tell a file rewritten in the same second.
+void GetFileStat(const std::string& filename, uint64* size, int64* mtime);
+
+//------------------------------------------------------------------------------
+// BinaryWriter writes column blocks to a binary file. We can use it
+// like this:
+//
+//   BinaryWriter writer;
+//   writer.Open("/tmp/train.txt.bin");
+//   writer.SetSource("/tmp/train.txt");   // only for binary cache
+//   for each block:
+//     writer.WriteBlock(Y, rows, num_rows);
+//   writer.Close();
+//
+// The data is written to a temp file, which is renamed to the target
+// filename in Close(), so that others never see an incomplete file.
+//------------------------------------------------------------------------------
+class BinaryWriter {
+ public:
+  BinaryWriter() : file_(nullptr) {  }
+  ~BinaryWriter() {  }
+
+  // Return false if we cannot create the file.
+  bool Open(const std::string& filename);
+
+  // Record the size and the modify time of the text file.
+  void SetSource(const std::string& source_file);
+
+  // Write one block. rows[0] is the bias column.
+  void WriteBlock(const std::vector<real_t>& Y,
+                  SparseRow* const* rows,
+                  size_t num_rows);
+
+  // Write a block that is already in the ColumnBlock layout. The weights
+  // of the samples are not stored, since they are only given in memory
+  // by Dataset::Downsample(). The block must not be encoded.
+  void WriteBlock(const ColumnBlock& block);
+
+  // Write the offset table and the file header.
+  void Close();
+
+ private:
+  FILE* file_;
+  std::string filename_;
+  std::string tmp_filename_;
+  BinaryFileHeader header_;
+  std::vector<uint64> offsets_;
+  uint64 offset_;
+
+  // Begin a new block at an aligned offset.
+  void StartBlock(index_t num_samples,
+                  index_t num_columns,
+                  index_t nnz,
+                  uint32 flags);
+
+  // Write data and move the offset.
+  void Write(const void* buf, size_t len);
+
+  DISALLOW_COPY_AND_ASSIGN(BinaryWriter);
+};
+
+//------------------------------------------------------------------------------
+// BinaryFile maps a binary file into memory (read-only) and returns the
+// column blocks as ColumnBlock views.
+//------------------------------------------------------------------------------
+class BinaryFile {
+ public:
+  BinaryFile() : buf_(nullptr), size_(0) {  }
+  ~BinaryFile() { Close(); }
+
+  // Map the file into memory. Return false if the file is not valid,
+  // e.g., a block does not fit in the file since it is truncated.
+  bool Open(const std::string& filename);
+
+  // Unmap the file.
+  void Close();
+
+  inline const BinaryFileHeader& Header() const {
+    return *reinterpret_cast<const BinaryFileHeader*>(buf_);
+  }
+
+  inline size_t NumBlocks() const { return blocks_.size(); }
+
+  inline const ColumnBlock& Block(size_t i) const { return blocks_[i]; }
+
+ private:
+  // Return true if the block [begin, end) of the mapped file has the
+  // extent given by its header.
+  bool IsValidBlock(uint64 begin, uint64 end) const;
+
+  char* buf_;
+  uint64 size_;
+  std::vector<ColumnBlock> blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(BinaryFile);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_BINARY_FORMAT_H_
@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests binary_format.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/data/data_structure.h"
+#include "src/reader/binary_format.h"
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
+
+using std::vector;
+using std::string;
+
+namespace f2m {
+
+const string kTextFile = "/tmp/test_binary_format.txt";
+const string kBinaryFile = "/tmp/test_binary_format.bin";
+// Two blocks: (3 samples, bias + 2 columns) and (2 samples, bias + 1 column)
+const string kText = "3\n"
+                     "1 0 1\n"
+                     "3 0:0.5 2:0.25 \n"
+                     "7 1:1.5 \n"
+                     "2\n"
+                     "0 1\n"
+                     "5 0:2 1:3 \n"
+                     "8\n";
+
+void WriteTextFile() {
+  FILE* file = OpenFileOrDie(kTextFile.c_str(), "w");
+  WriteDataToDisk(file, kText.c_str(), kText.size());
+  Close(file);
+}
+
+void CheckFirstBlock(const DMatrix* matrix) {
+  EXPECT_EQ(matrix->row_len, 3);
+  EXPECT_EQ(matrix->Y[0]->size(), 3);
+  EXPECT_EQ((*matrix->Y[0])[0], (real_t)1);
+  EXPECT_EQ((*matrix->Y[0])[1], (real_t)0);
+  // bias column
+  ColumnRef bias = matrix->Column(0);
+  EXPECT_EQ(bias.id, 0);
+  EXPECT_EQ(bias.len, 3);
+  EXPECT_EQ(bias.idx[2], 2);
+  EXPECT_EQ(bias.X[2], (real_t)1.0);
+  ColumnRef col = matrix->Column(1);
+  EXPECT_EQ(col.id, 3);
+  EXPECT_EQ(col.len, 2);
+  EXPECT_EQ(col.idx[1], 2);
+  EXPECT_EQ(col.X[1], (real_t)0.25);
+  col = matrix->Column(2);
+  EXPECT_EQ(col.id, 7);
+  EXPECT_EQ(col.len, 1);
+  EXPECT_EQ(col.idx[0], 1);
+  EXPECT_EQ(col.X[0], (real_t)1.5);
+}
+
+TEST(BINARY_FORMAT_TEST, WriteAndRead) {
+  DMatrix matrix(3);
+  matrix.InitSparseRow();
+  for (index_t i = 0; i < 3; ++i) {
+    matrix.row[i]->Resize(i + 1);
+    matrix.row[i]->id = i * 10;
+    for (index_t j = 0; j <= i; ++j) {
+      matrix.row[i]->idx[j] = j;
+      matrix.row[i]->X[j] = i + j;
+    }
+  }
+  vector<real_t> Y(3, 1.0);
+  BinaryWriter writer;
+  EXPECT_TRUE(writer.Open(kBinaryFile));
+  writer.WriteBlock(Y, matrix.row.data(), 3);
+  writer.WriteBlock(Y, matrix.row.data(), 2);
+  writer.Close();
+  EXPECT_TRUE(IsBinaryFile(kBinaryFile));
+  BinaryFile file;
+  EXPECT_TRUE(file.Open(kBinaryFile));
+  EXPECT_EQ(file.NumBlocks(), 2);
+  EXPECT_EQ(file.Header().num_samples, 6);
+  EXPECT_EQ(file.Header().nnz, 9);
+  EXPECT_EQ(file.Header().max_feature, 20);
+  const ColumnBlock& block = file.Block(0);
+  EXPECT_EQ(block.num_samples, 3);
+  EXPECT_EQ(block.num_columns, 3);
+  EXPECT_EQ(block.nnz, 6);
+  EXPECT_EQ(block.col_ids[2], 20);
+  EXPECT_EQ(block.col_ptr[3], 6);
+  EXPECT_EQ(block.idx[5], 2);
+  EXPECT_EQ(block.X[5], (real_t)4);
+  EXPECT_EQ(file.Block(1).num_columns, 2);
+  EXPECT_EQ(file.Block(1).nnz, 3);
+  // Write a ColumnBlock again
+  EXPECT_TRUE(writer.Open(kTextFile));
+  writer.WriteBlock(block);
+  writer.Close();
+  BinaryFile copy;
+  EXPECT_TRUE(copy.Open(kTextFile));
+  EXPECT_EQ(copy.NumBlocks(), 1);
+  EXPECT_EQ(copy.Block(0).X[5], (real_t)4);
+  RemoveFile(kBinaryFile.c_str());
+  RemoveFile(kTextFile.c_str());
+}
+
+TEST(BINARY_FORMAT_TEST, MmapReader) {
+  WriteTextFile();
+  string cache_file = kTextFile + kBinaryCacheSuffix;
+  EXPECT_FALSE(IsBinaryFile(kTextFile));
+  EXPECT_FALSE(IsValidBinaryCache(cache_file, kTextFile));
+  LibsvmParser parser;
+  // The first run writes the binary cache.
+  for (int n = 0; n < 2; ++n) {
+    MmapReader reader;
+    reader.Initialize(kTextFile, 100, &parser, LR);
+    EXPECT_TRUE(IsValidBinaryCache(cache_file, kTextFile));
+    DMatrix* matrix = nullptr;
+    for (int epoch = 0; epoch < 2; ++epoch) {
+      EXPECT_EQ(reader.Samples(matrix), 3);
+      CheckFirstBlock(matrix);
+      EXPECT_EQ(reader.Samples(matrix), 2);
+      EXPECT_EQ(matrix->Y[0]->size(), 2);
+      EXPECT_EQ(matrix->Column(1).id, 5);
+      EXPECT_EQ(matrix->Column(1).X[1], (real_t)3);
+      EXPECT_EQ(reader.Samples(matrix), 0);
+      reader.GoToHead();
+    }
+  }
+  // The binary file can be read directly.
+  MmapReader reader;
+  reader.Initialize(cache_file, 100, &parser, LR);
+  DMatrix* matrix = nullptr;
+  EXPECT_EQ(reader.Samples(matrix), 3);
+  CheckFirstBlock(matrix);
+  // The text file rewritten in the same second with the same size is
+  // told by the nanoseconds of its mtime.
+  struct stat st;
+  ASSERT_EQ(stat(kTextFile.c_str(), &st), 0);
+  struct timespec times[2] = { st.st_atim, st.st_mtim };
+  times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000;
+  ASSERT_EQ(utimensat(AT_FDCWD, kTextFile.c_str(), times, 0), 0);
+  EXPECT_FALSE(IsValidBinaryCache(cache_file, kTextFile));
+  RemoveFile(cache_file.c_str());
+  RemoveFile(kTextFile.c_str());
+}
+
+// Overwrite the nnz of the block i in the header of the binary file.
+void CorruptBlock(const string& filename, size_t i, uint32 nnz) {
+  BinaryFileHeader header;
+  FILE* file = OpenFileOrDie(filename.c_str(), "r+");
+  CHECK_EQ(fread(&header, sizeof(header), 1, file), 1);
+  uint64 offset = 0;
+  fseek(file, header.index_offset + sizeof(uint64) * i, SEEK_SET);
+  CHECK_EQ(fread(&offset, sizeof(offset), 1, file), 1);
+  fseek(file, offset + offsetof(BinaryBlockHeader, nnz), SEEK_SET);
+  CHECK_EQ(fwrite(&nnz, sizeof(nnz), 1, file), 1);
+  Close(file);
+}
+
+TEST(BINARY_FORMAT_TEST, InvalidBlock) {
+  WriteTextFile();
+  string cache_file = kTextFile + kBinaryCacheSuffix;
+  LibsvmParser parser;
+  {
+    MmapReader reader;
+    reader.Initialize(kTextFile, 100, &parser, LR);
+  }
+  BinaryFile file;
+  vector<uint64> offsets, sizes;
+  EXPECT_TRUE(file.Open(cache_file));
+  EXPECT_TRUE(ReadBlockTable(cache_file, &offsets, &sizes));
+  file.Close();
+  // A block runs into the next one.
+  CorruptBlock(cache_file, 0, 1000);
+  EXPECT_FALSE(file.Open(cache_file));
+  EXPECT_FALSE(ReadBlockTable(cache_file, &offsets, &sizes));
+  // A block runs past the end of the file.
+  CorruptBlock(cache_file, 0, 6);
+  CorruptBlock(cache_file, 1, 1 << 30);
+  EXPECT_FALSE(file.Open(cache_file));
+  EXPECT_FALSE(ReadBlockTable(cache_file, &offsets, &sizes));
+  // The column lengths do not add up to nnz.
+  CorruptBlock(cache_file, 1, 2);
+  EXPECT_FALSE(file.Open(cache_file));
+  EXPECT_FALSE(ReadBlockTable(cache_file, &offsets, &sizes));
+  // The header of the cache is still valid, and the reader converts
+  // the text file again.
+  EXPECT_TRUE(IsValidBinaryCache(cache_file, kTextFile));
+  MmapReader reader;
+  reader.Initialize(kTextFile, 100, &parser, LR);
+  DMatrix* matrix = nullptr;
+  EXPECT_EQ(reader.Samples(matrix), 3);
+  CheckFirstBlock(matrix);
+  EXPECT_EQ(reader.Samples(matrix), 2);
+  EXPECT_TRUE(file.Open(cache_file));
+  RemoveFile(cache_file.c_str());
+  RemoveFile(kTextFile.c_str());
+}
+
+// Overwrite the num_blocks of the header of the binary file.
+void CorruptNumBlocks(const string& filename, uint64 num_blocks) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r+");
+  fseek(file, offsetof(BinaryFileHeader, num_blocks), SEEK_SET);
+  CHECK_EQ(fwrite(&num_blocks, sizeof(num_blocks), 1, file), 1);
+  Close(file);
+}
+
+// The AsyncReader checks the offset table before allocating it, and
+// converts the text file again if its cache is not valid.
+TEST(BINARY_FORMAT_TEST, AsyncReaderInvalidCache) {
+  WriteTextFile();
+  string cache_file = kTextFile + kBinaryCacheSuffix;
+  LibsvmParser parser;
+  {
+    AsyncReader reader;
+    reader.DisableAsyncIO();
+    reader.Initialize(kTextFile, 100, &parser, LR);
+  }
+  vector<uint64> offsets, sizes;
+  CorruptNumBlocks(cache_file, (uint64)1 << 60);
+  EXPECT_FALSE(ReadBlockTable(cache_file, &offsets, &sizes));
+  EXPECT_TRUE(offsets.empty());
+  CorruptNumBlocks(cache_file, 2);
+  CorruptBlock(cache_file, 1, 1 << 30);
+  EXPECT_TRUE(IsValidBinaryCache(cache_file, kTextFile));
+  for (int k = 0; k < 2; ++k) {
+    AsyncReader reader;
+    reader.DisableAsyncIO();
+    reader.Initialize(kTextFile, 100, &parser, LR);
+    DMatrix* matrix = nullptr;
+    EXPECT_EQ(reader.Samples(matrix), 3);
+    CheckFirstBlock(matrix);
+    EXPECT_EQ(reader.Samples(matrix), 2);
+    EXPECT_EQ(reader.Samples(matrix), 0);
+    EXPECT_TRUE(ReadBlockTable(cache_file, &offsets, &sizes));
+    // Truncate the cache before the offset table.
+    if (k == 0) {
+      EXPECT_EQ(truncate(cache_file.c_str(), offsets[1]), 0);
+    }
+  }
+  RemoveFile(cache_file.c_str());
+  RemoveFile(kTextFile.c_str());
+}
+
+} // namespace f2m
@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of block_cache.h.
+*/
+
+#include "src/reader/block_cache.h"
+
+#include <stdlib.h>
+
+namespace f2m {
+
+void BlockCache::Initialize(uint64 capacity) {
+  Clear();
+  capacity_ = capacity;
+  num_hits_ = num_misses_ = 0;
+}
+
+const char* BlockCache::Lookup(size_t block) {
+  std::unordered_map<size_t, Entry>::iterator it = entries_.find(block);
+  if (it == entries_.end()) {
+    ++num_misses_;
+    return nullptr;
+  }
+  ++num_hits_;
+  lru_.splice(lru_.begin(), lru_, it->second.pos);
+  return it->second.buf;
+}
+
+bool BlockCache::Insert(size_t block, char* buf, uint64 size) {
+  CHECK_NOTNULL(buf);
+  CHECK(!Contains(block));
+  if (size > capacity_) {
+    return false;
+  }
+  while (size_ + size > capacity_) {
+    std::unordered_map<size_t, Entry>::iterator it =
+        entries_.find(lru_.back());
+    free(it->second.buf);
+    size_ -= it->second.size;
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+  lru_.push_front(block);
+  Entry& entry = entries_[block];
+  entry.buf = buf;
+  entry.size = size;
+  entry.pos = lru_.begin();
+  size_ += size;
+  return true;
+}
+
+void BlockCache::Clear() {
+  for (std::unordered_map<size_t, Entry>::iterator it = entries_.begin();
+       it != entries_.end(); ++it) {
+    free(it->second.buf);
+  }
+  entries_.clear();
+  lru_.clear();
+  size_ = 0;
+}
+
+void BlockCache::TakeStats(uint64* num_hits, uint64* num_misses) {
+  *num_hits = num_hits_;
+  *num_misses = num_misses_;
+  num_hits_ = num_misses_ = 0;
+}
+
+} // namespace f2m
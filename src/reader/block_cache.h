@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the BlockCache class, which keeps the recently used
+blocks of an on-disk data file in memory within a byte budget.
+*/
+
+#ifndef F2M_READER_BLOCK_CACHE_H_
+#define F2M_READER_BLOCK_CACHE_H_
+
+#include <list>
+#include <unordered_map>
+
+#include "src/base/common.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// BlockCache maps the index of a block to the buffer of the block. The
+// total size of the buffers is kept within the capacity by evicting the
+// least recently used blocks. The cache owns the buffers, which are
+// allocated by malloc() (or AllocateAligned() in async_io.h) and freed
+// on eviction. We can use it like this:
+//
+//   BlockCache cache;
+//   cache.Initialize(1024 * 1024 * 1024);   // 1 GB
+//   const char* buf = cache.Lookup(i);
+//   if (buf == nullptr) {
+//     char* new_buf = ReadBlock(i);
+//     if (!cache.Insert(i, new_buf, size)) {
+//       free(new_buf);   // larger than the capacity
+//     }
+//   }
+//
+// A buffer returned by Lookup() is valid until the next Insert().
+//------------------------------------------------------------------------------
+class BlockCache {
+ public:
+  BlockCache() : capacity_(0), size_(0), num_hits_(0), num_misses_(0) {  }
+  ~BlockCache() { Clear(); }
+
+  // Set the capacity (in bytes). A cache of zero capacity keeps nothing.
+  void Initialize(uint64 capacity);
+
+  // Return the buffer of the block and mark it as the most recently
+  // used one, or nullptr if it is not in the cache.
+  const char* Lookup(size_t block);
+
+  // Return true if the block is in the cache. It does not change the
+  // order of the blocks and is not counted as a hit or a miss.
+  bool Contains(size_t block) const { return entries_.count(block) > 0; }
+
+  // Add the buffer of the block, which is size bytes. The least
+  // recently used blocks are evicted to make room for it. Return false
+  // if it is larger than the capacity, and then the caller still owns
+  // the buffer. The block must not be in the cache.
+  bool Insert(size_t block, char* buf, uint64 size);
+
+  // Free all the buffers.
+  void Clear();
+
+  // Number of blocks in the cache.
+  size_t NumBlocks() const { return entries_.size(); }
+
+  // Total size of the buffers in the cache.
+  uint64 Size() const { return size_; }
+
+  // Return the number of hits and misses of Lookup() since the last
+  // call, and reset them.
+  void TakeStats(uint64* num_hits, uint64* num_misses);
+
+ private:
+  struct Entry {
+    char* buf;
+    uint64 size;
+    std::list<size_t>::iterator pos;   // Position in lru_
+  };
+
+  uint64 capacity_;
+  uint64 size_;
+  uint64 num_hits_;
+  uint64 num_misses_;
+  std::list<size_t> lru_;   // The most recently used block is at front
+  std::unordered_map<size_t, Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCache);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_BLOCK_CACHE_H_
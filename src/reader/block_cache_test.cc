@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests block_cache.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/reader/block_cache.h"
+
+namespace f2m {
+
+// A buffer filled by the block index.
+char* NewBuffer(size_t block, uint64 size) {
+  char* buf = reinterpret_cast<char*>(malloc(size));
+  memset(buf, static_cast<int>(block), size);
+  return buf;
+}
+
+TEST(BLOCK_CACHE_TEST, EvictLeastRecentlyUsed) {
+  BlockCache cache;
+  cache.Initialize(300);
+  EXPECT_TRUE(cache.Insert(0, NewBuffer(0, 100), 100));
+  EXPECT_TRUE(cache.Insert(1, NewBuffer(1, 100), 100));
+  EXPECT_TRUE(cache.Insert(2, NewBuffer(2, 100), 100));
+  EXPECT_EQ(cache.Size(), 300);
+  // Block 0 is used again, so block 1 is evicted.
+  const char* buf = cache.Lookup(0);
+  ASSERT_TRUE(buf != nullptr);
+  EXPECT_EQ(buf[99], 0);
+  EXPECT_TRUE(cache.Insert(3, NewBuffer(3, 50), 50));
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_EQ(cache.NumBlocks(), 3);
+  EXPECT_EQ(cache.Size(), 250);
+  // Evict two blocks for a large one.
+  EXPECT_TRUE(cache.Insert(4, NewBuffer(4, 200), 200));
+  EXPECT_FALSE(cache.Contains(2));
+  EXPECT_FALSE(cache.Contains(0));
+  EXPECT_TRUE(cache.Contains(3));
+  EXPECT_EQ(cache.Lookup(4)[199], 4);
+  EXPECT_TRUE(cache.Lookup(1) == nullptr);
+  uint64 num_hits = 0, num_misses = 0;
+  cache.TakeStats(&num_hits, &num_misses);
+  EXPECT_EQ(num_hits, 2);
+  EXPECT_EQ(num_misses, 1);
+  cache.TakeStats(&num_hits, &num_misses);
+  EXPECT_EQ(num_hits + num_misses, 0);
+  // Too large, and the caller keeps the buffer.
+  char* large = NewBuffer(5, 301);
+  EXPECT_FALSE(cache.Insert(5, large, 301));
+  free(large);
+  cache.Clear();
+  EXPECT_EQ(cache.NumBlocks(), 0);
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(BLOCK_CACHE_TEST, ZeroCapacity) {
+  BlockCache cache;
+  cache.Initialize(0);
+  char* buf = NewBuffer(0, 1);
+  EXPECT_FALSE(cache.Insert(0, buf, 1));
+  free(buf);
+  EXPECT_TRUE(cache.Lookup(0) == nullptr);
+}
+
+} // namespace f2m
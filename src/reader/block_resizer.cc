@@ -0,0 +1,142 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of block_resizer.h.
+*/
+
+#include "src/reader/block_resizer.h"
+
+#include <algorithm>
+
+#include "src/data/column_codec.h"
+
+namespace f2m {
+
+void BlockResizer::Initialize(index_t num_samples) {
+  CHECK_GT(num_samples, 0);
+  num_samples_ = num_samples;
+  Reset();
+}
+
+void BlockResizer::Reset() {
+  block_ = nullptr;
+  pos_ = 0;
+}
+
+// Each column of a stored block is cut by binary search, since its
+// sample indices are sorted.
+void BlockResizer::AppendPiece(const ColumnBlock& block,
+                               index_t begin,
+                               index_t end,
+                               index_t first) {
+  arena_.Y.insert(arena_.Y.end(), block.Y + begin, block.Y + end);
+  if (block.weights != nullptr) {
+    arena_.weights.insert(arena_.weights.end(),
+                          block.weights + begin, block.weights + end);
+  }
+  has_fields_ = block.col_fields != nullptr;
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    const index_t* col_begin = block.idx + block.col_ptr[j];
+    const index_t* col_end = block.idx + block.col_ptr[j+1];
+    const index_t* lo = std::lower_bound(col_begin, col_end, begin);
+    const index_t* hi = std::lower_bound(lo, col_end, end);
+    for (const index_t* p = lo; p < hi; ++p) {
+      Entry entry;
+      entry.id = block.col_ids[j];
+      entry.field = has_fields_ ? block.col_fields[j] : 0;
+      entry.sample = *p - begin + first;
+      entry.value = block.X[p - block.idx];
+      entries_.push_back(entry);
+    }
+  }
+}
+
+// The entries of a column are appended piece by piece, so a stable sort
+// by id keeps their samples in order.
+void BlockResizer::BuildBlock(bool merge) {
+  if (merge) {
+    std::stable_sort(entries_.begin(), entries_.end(),
+                     [](const Entry& a, const Entry& b) {
+                       return a.id < b.id;
+                     });
+  }
+  arena_.col_ids.clear();
+  arena_.col_fields.clear();
+  arena_.col_ptr.assign(1, 0);
+  arena_.idx.resize(entries_.size());
+  arena_.X.resize(entries_.size());
+  for (size_t k = 0; k < entries_.size(); ++k) {
+    if (k > 0 && entries_[k].id != entries_[k-1].id) {
+      arena_.col_ptr.push_back(k);
+    }
+    if (k == 0 || entries_[k].id != entries_[k-1].id) {
+      arena_.col_ids.push_back(entries_[k].id);
+      if (has_fields_) {
+        arena_.col_fields.push_back(entries_[k].field);
+      }
+    }
+    arena_.idx[k] = entries_[k].sample;
+    arena_.X[k] = entries_[k].value;
+  }
+  if (!entries_.empty()) {
+    arena_.col_ptr.push_back(entries_.size());
+  }
+  arena_.UpdateView();
+}
+
+const ColumnBlock* BlockResizer::Next(const BlockSource& source) {
+  CHECK_GT(num_samples_, 0);
+  arena_.Y.clear();
+  arena_.weights.clear();
+  entries_.clear();
+  index_t num_filled = 0;
+  int num_pieces = 0;
+  while (num_filled < num_samples_) {
+    if (block_ == nullptr || pos_ >= block_->num_samples) {
+      block_ = source();
+      pos_ = 0;
+      if (block_ == nullptr) {
+        break;
+      }
+      // The stored block has the right size.
+      if (num_filled == 0 && block_->num_samples == num_samples_) {
+        pos_ = num_samples_;
+        return block_;
+      }
+      if (block_->col_codecs != nullptr) {
+        DecodeBlock(*block_, &decoded_);
+        block_ = &decoded_.block;
+      }
+      continue;
+    }
+    index_t end = std::min(block_->num_samples,
+                           pos_ + num_samples_ - num_filled);
+    AppendPiece(*block_, pos_, end, num_filled);
+    num_filled += end - pos_;
+    pos_ = end;
+    ++num_pieces;
+  }
+  if (num_filled == 0) {
+    return nullptr;
+  }
+  BuildBlock(num_pieces > 1);
+  return &arena_.block;
+}
+
+} // namespace f2m
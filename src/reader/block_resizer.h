@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the BlockResizer class, which splits or merges the
+column blocks of a Reader into blocks of a given number of samples.
+*/
+
+#ifndef F2M_READER_BLOCK_RESIZER_H_
+#define F2M_READER_BLOCK_RESIZER_H_
+
+#include <functional>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+// Return the next stored block, or nullptr at the end of the data. The
+// block must be valid until the next call.
+typedef std::function<const ColumnBlock*()> BlockSource;
+
+//------------------------------------------------------------------------------
+// The number of samples of a stored block is decided when the data is
+// converted (see transposer.h). BlockResizer cuts the samples of the
+// stored blocks, in their order, into blocks of num_samples samples, so
+// we can try another mini-batch size without converting the data again.
+// A big block is split into several blocks, and small blocks are merged
+// into one. The sample indices of each column are remapped, and Y is
+// sliced. A stored block of exactly num_samples samples is returned as
+// it is, without copying. We can use it like this:
+//
+//   BlockResizer resizer;
+//   resizer.Initialize(256);
+//   const ColumnBlock* block = nullptr;
+//   while ((block = resizer.Next(source)) != nullptr) {
+//     // use the block ...
+//   }
+//   resizer.Reset();   // for the next epoch
+//
+// The last block of the data may have fewer samples. The sample indices
+// of each column must be sorted, as the Transposer writes them. An
+// encoded stored block (see column_codec.h) is decoded once before it
+// is cut, and the new blocks are plain.
+//------------------------------------------------------------------------------
+class BlockResizer {
+ public:
+  BlockResizer()
+    : num_samples_(0), block_(nullptr), pos_(0), has_fields_(false) {  }
+  ~BlockResizer() {  }
+
+  // Set the number of samples of each block.
+  void Initialize(index_t num_samples);
+
+  // Return the next block, or nullptr at the end of the source. The
+  // block is valid until the next call of Next() or Reset().
+  const ColumnBlock* Next(const BlockSource& source);
+
+  // Forget the rest of the current stored block, e.g., when the Reader
+  // goes back to the head of the data.
+  void Reset();
+
+ private:
+  // An entry of a merged block.
+  struct Entry {
+    index_t id;
+    index_t field;
+    index_t sample;
+    real_t value;
+  };
+
+  index_t num_samples_;
+  const ColumnBlock* block_;    // Current stored block
+  index_t pos_;                 // Samples of block_ that have been used
+  bool has_fields_;             // The pieces have fields (libffm)
+  ColumnArena arena_;           // The new block
+  ColumnArena decoded_;         // block_ if it is encoded
+  std::vector<Entry> entries_;  // Entries of the pieces to merge
+
+  // Append the samples [begin, end) of the block to entries_, and their
+  // labels to arena_. The first one becomes the sample of index first.
+  void AppendPiece(const ColumnBlock& block,
+                   index_t begin,
+                   index_t end,
+                   index_t first);
+
+  // Build arena_ from entries_. The columns are merged by id if the
+  // entries come from more than one piece.
+  void BuildBlock(bool merge);
+
+  DISALLOW_COPY_AND_ASSIGN(BlockResizer);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_BLOCK_RESIZER_H_
@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests block_resizer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "src/base/stl-util.h"
+#include "src/reader/block_resizer.h"
+
+namespace f2m {
+
+// The Y of a sample is its id. Each sample has the bias column, the
+// column 1 if the id is even, and the column 2 if the id % 3 == 0. The
+// value of a feature is the id.
+void MakeBlock(index_t first_id, index_t num_samples, ColumnArena* arena) {
+  arena->Y.clear();
+  arena->col_ids.clear();
+  arena->col_ptr.assign(1, 0);
+  arena->idx.clear();
+  arena->X.clear();
+  for (index_t i = 0; i < num_samples; ++i) {
+    arena->Y.push_back(first_id + i);
+  }
+  for (index_t j = 0; j < 3; ++j) {
+    arena->col_ids.push_back(j);
+    for (index_t i = 0; i < num_samples; ++i) {
+      index_t id = first_id + i;
+      if (j == 0 || id % (j + 1) == 0) {
+        arena->idx.push_back(i);
+        arena->X.push_back(j == 0 ? 1.0 : id);
+      }
+    }
+    arena->col_ptr.push_back(arena->idx.size());
+  }
+  arena->UpdateView();
+}
+
+class BlockResizerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    const index_t sizes[] = { 5, 3, 4 };
+    index_t first_id = 0;
+    for (int i = 0; i < 3; ++i) {
+      arenas_.push_back(new ColumnArena);
+      MakeBlock(first_id, sizes[i], arenas_.back());
+      first_id += sizes[i];
+    }
+    num_samples_ = first_id;
+    next_ = 0;
+  }
+  virtual void TearDown() {
+    STLDeleteElementsAndClear(&arenas_);
+  }
+
+  const ColumnBlock* NextStored() {
+    if (next_ >= arenas_.size()) {
+      return nullptr;
+    }
+    return &arenas_[next_++]->block;
+  }
+
+  std::vector<ColumnArena*> arenas_;
+  index_t num_samples_;
+  size_t next_;
+};
+
+void CheckBlock(const ColumnBlock* block) {
+  std::vector<index_t> num_entries(block->num_samples, 0);
+  for (index_t c = 0; c < block->num_columns; ++c) {
+    index_t j = block->col_ids[c];
+    if (c > 0) {
+      EXPECT_LT(block->col_ids[c-1], j);
+    }
+    for (index_t k = block->col_ptr[c]; k < block->col_ptr[c+1]; ++k) {
+      index_t id = block->Y[block->idx[k]];
+      EXPECT_EQ(block->X[k], j == 0 ? (real_t)1.0 : (real_t)id);
+      EXPECT_EQ(id % (j + 1), 0);
+      if (k > block->col_ptr[c]) {
+        EXPECT_LT(block->idx[k-1], block->idx[k]);
+      }
+      num_entries[block->idx[k]]++;
+    }
+  }
+  EXPECT_EQ(block->nnz, block->col_ptr[block->num_columns]);
+  for (index_t i = 0; i < block->num_samples; ++i) {
+    index_t id = block->Y[i];
+    EXPECT_EQ(num_entries[i], 1 + (id % 2 == 0) + (id % 3 == 0));
+  }
+}
+
+TEST_F(BlockResizerTest, SplitAndMerge) {
+  BlockSource source = [this]() { return NextStored(); };
+  BlockResizer resizer;
+  for (index_t size = 1; size <= num_samples_ + 1; ++size) {
+    resizer.Initialize(size);
+    next_ = 0;
+    index_t id = 0;
+    const ColumnBlock* block = nullptr;
+    while ((block = resizer.Next(source)) != nullptr) {
+      EXPECT_EQ(block->num_samples, std::min(size, num_samples_ - id));
+      for (index_t i = 0; i < block->num_samples; ++i) {
+        EXPECT_EQ(block->Y[i], (real_t)id++);
+      }
+      CheckBlock(block);
+    }
+    EXPECT_EQ(id, num_samples_);
+  }
+}
+
+TEST_F(BlockResizerTest, KeepStoredBlock) {
+  BlockSource source = [this]() { return NextStored(); };
+  BlockResizer resizer;
+  resizer.Initialize(5);
+  // The first stored block has 5 samples, and it is not copied.
+  EXPECT_EQ(resizer.Next(source), &arenas_[0]->block);
+  const ColumnBlock* block = resizer.Next(source);
+  EXPECT_EQ(block->num_samples, 5);
+  EXPECT_EQ(block->Y[0], 5);
+  // Forget the rest of the third block.
+  resizer.Reset();
+  EXPECT_TRUE(resizer.Next(source) == nullptr);
+  next_ = 0;
+  block = resizer.Next(source);
+  EXPECT_EQ(block->Y[0], 0);
+}
+
+} // namespace f2m
@@ -0,0 +1,812 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of dataset.h.
+*/
+
+#include "src/reader/dataset.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <thread>
+
+#include "src/base/scoped_ptr.h"
+#include "src/base/stl-util.h"
+#include "src/base/stringprintf.h"
+#include "src/data/column_codec.h"
+#include "src/reader/input_stream.h"
+#include "src/reader/metadata.h"
+#include "src/reader/tokenizer.h"
+#include "src/thread/mutex.h"
+
+static const uint64 kParseWindowSize = 64 * 1024 * 1024; // 64 MB
+static const uint64 kStreamReadSize = 4 * 1024 * 1024;    // 4 MB
+static const uint64 kMaxBlockBytes = 1ULL << 34;          // 16 GB
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// Data paths
+//------------------------------------------------------------------------------
+
+static bool IsDirectory(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool HasSuffix(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool IsShardedPath(const std::string& path) {
+  return path.find_first_of("*?[") != std::string::npos || IsDirectory(path);
+}
+
+std::vector<std::string> ListShards(const std::string& path) {
+  std::vector<std::string> files;
+  if (path.find_first_of("*?[") != std::string::npos) {
+    glob_t result;
+    if (glob(path.c_str(), 0, NULL, &result) == 0) {
+      for (size_t i = 0; i < result.gl_pathc; ++i) {
+        files.push_back(result.gl_pathv[i]);
+      }
+    }
+    globfree(&result);
+  } else if (IsDirectory(path)) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      LOG(FATAL) << "Cannot open directory: " << path;
+    }
+    std::string prefix = HasSuffix(path, "/") ? path : path + "/";
+    struct dirent* entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (entry->d_name[0] != '.') {
+        files.push_back(prefix + entry->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+  } else {
+    return std::vector<std::string>(1, path);
+  }
+  // Remove the directories, and the sidecars of the other shards.
+  std::set<std::string> names(files.begin(), files.end());
+  std::vector<std::string> shards;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string& file = files[i];
+    if (IsDirectory(file)) {
+      continue;
+    }
+    const char* suffixes[] = { kBinaryCacheSuffix, kMetadataSuffix };
+    bool is_sidecar = false;
+    for (int k = 0; k < 2; ++k) {
+      std::string suffix = suffixes[k];
+      if (HasSuffix(file, suffix) &&
+          names.count(file.substr(0, file.size() - suffix.size())) > 0) {
+        is_sidecar = true;
+      }
+    }
+    if (!is_sidecar) {
+      shards.push_back(file);
+    }
+  }
+  if (shards.empty()) {
+    LOG(FATAL) << "Cannot find any data file in: " << path;
+  }
+  return shards;
+}
+
+//------------------------------------------------------------------------------
+// Implementation of Dataset
+//------------------------------------------------------------------------------
+
+Dataset::~Dataset() {
+  STLDeleteElementsAndClear(&arenas_);
+  STLDeleteElementsAndClear(&binary_files_);
+}
+
+// Return the peak resident set size (in bytes) of current process.
+static uint64 PeakRSS() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return static_cast<uint64>(usage.ru_maxrss) * 1024;
+}
+
+// Map the text file into memory, and then parse it window by window.
+// After parsing a window, we drop its pages from memory, so the peak
+// memory is close to the size of the parsed blocks. A compressed file
+// is decompressed into a window buffer instead.
+void Dataset::LoadText(const std::string& filename,
+                       Parser* parser,
+                       int num_threads) {
+  CHECK_NOTNULL(parser);
+  CHECK_GT(num_threads, 0);
+  CHECK(blocks_.empty());
+  uint64 file_size = 0;
+  if (DetectCodec(filename) == kNoCompression) {
+    file_size = LoadMappedText(filename, parser, num_threads);
+  } else {
+    file_size = LoadCompressedText(filename, parser, num_threads);
+  }
+  uint64 memory_size = 0;
+  for (size_t i = 0; i < arenas_.size(); ++i) {
+    memory_size += arenas_[i]->MemorySize();
+    blocks_.push_back(&arenas_[i]->block);
+  }
+  LOG(INFO) << (visitor_ ? "Scan " : "Load ") << num_parsed_
+            << " blocks from " << filename
+            << StringPrintf(", data size: %.1f MB, parsed size: %.1f MB"
+                            ", peak RSS: %.1f MB",
+                            file_size / 1048576.0,
+                            memory_size / 1048576.0,
+                            PeakRSS() / 1048576.0);
+}
+
+void Dataset::ScanText(const std::string& filename,
+                       Parser* parser,
+                       int num_threads,
+                       const BlockVisitor& visitor) {
+  Dataset dataset;
+  dataset.visitor_ = visitor;
+  dataset.LoadText(filename, parser, num_threads);
+}
+
+uint64 Dataset::LoadMappedText(const std::string& filename,
+                               Parser* parser,
+                               int num_threads) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(FATAL) << "Cannot open file: " << filename;
+  }
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0);
+  uint64 file_size = st.st_size;
+  char* buf = nullptr;
+  if (file_size > 0) {
+    void* ptr = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+      LOG(FATAL) << "Cannot mmap file: " << filename;
+    }
+    buf = reinterpret_cast<char*>(ptr);
+    madvise(buf, file_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  const uint64 page_size = sysconf(_SC_PAGESIZE);
+  uint64 pos = 0, dropped = 0;
+  std::vector<uint64> offsets;
+  while (SplitBlocks(filename, buf, file_size, pos, true, &offsets) > 0) {
+    ParseWindow(parser, buf, offsets, num_threads);
+    // Drop the parsed pages.
+    pos = offsets.back();
+    uint64 page_end = pos / page_size * page_size;
+    if (page_end > dropped) {
+      madvise(buf + dropped, page_end - dropped, MADV_DONTNEED);
+      dropped = page_end;
+    }
+  }
+  if (buf != nullptr) {
+    munmap(buf, file_size);
+  }
+  return file_size;
+}
+
+// The decompressed data is appended to the window buffer, and the
+// unparsed tail of the window (an incomplete block) is moved to the
+// front of the buffer before the next read. The stream decompresses
+// the next chunks in background while we are parsing.
+uint64 Dataset::LoadCompressedText(const std::string& filename,
+                                   Parser* parser,
+                                   int num_threads) {
+  scoped_ptr<InputStream> stream(OpenInputStream(filename));
+  std::vector<char> buf(kParseWindowSize + kStreamReadSize);
+  uint64 buf_size = 0, data_size = 0;
+  bool end_of_stream = false;
+  std::vector<uint64> offsets;
+  for (;;) {
+    // Fill the window.
+    while (!end_of_stream && buf_size < kParseWindowSize) {
+      if (buf.size() < buf_size + kStreamReadSize) {
+        buf.resize(buf_size + kStreamReadSize);
+      }
+      size_t read_size = stream->Read(buf.data() + buf_size, kStreamReadSize);
+      end_of_stream = read_size == 0;
+      buf_size += read_size;
+      data_size += read_size;
+    }
+    if (SplitBlocks(filename, buf.data(), buf_size, 0,
+                    end_of_stream, &offsets) > 0) {
+      ParseWindow(parser, buf.data(), offsets, num_threads);
+      uint64 pos = offsets.back();
+      memmove(buf.data(), buf.data() + pos, buf_size - pos);
+      buf_size -= pos;
+    } else if (end_of_stream) {
+      break;
+    } else {
+      // The window has no complete block, so we read more data.
+      if (buf.size() >= kMaxBlockBytes) {
+        LOG(FATAL) << "Too large block in file: " << filename;
+      }
+      buf.resize(buf.size() * 2);
+      size_t read_size = stream->Read(buf.data() + buf_size,
+                                      buf.size() - buf_size);
+      end_of_stream = read_size == 0;
+      buf_size += read_size;
+      data_size += read_size;
+    }
+  }
+  return data_size;
+}
+
+// Split each window into blocks and parse them in parallel.
+void Dataset::ParseWindow(Parser* parser,
+                          const char* buf,
+                          const std::vector<uint64>& offsets,
+                          int num_threads) {
+  size_t first = arenas_.size();
+  size_t num_blocks = offsets.size() - 1;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    arenas_.push_back(new ColumnArena);
+  }
+  int num_parse_threads =
+      std::min(static_cast<size_t>(num_threads), num_blocks);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_parse_threads; ++i) {
+    threads.push_back(std::thread(&Dataset::ParseBlocks, this,
+                                  parser, buf, std::cref(offsets), first,
+                                  i, num_parse_threads));
+  }
+  ParseBlocks(parser, buf, offsets, first, 0, num_parse_threads);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  num_parsed_ += num_blocks;
+  if (visitor_) {
+    for (size_t i = first; i < arenas_.size(); ++i) {
+      visitor_(arenas_[i]->block);
+      delete arenas_[i];
+    }
+    arenas_.resize(first);
+  }
+}
+
+// Each block starts with a block-length line, which gives the number of
+// lines (Y line and column lines) that follow it. The last line of the
+// file is the max feature length, which is not a block. We stop after
+// kParseWindowSize bytes. If the buffer is not the end of the file,
+// we also stop before the incomplete block at the end of the buffer.
+size_t Dataset::SplitBlocks(const std::string& filename,
+                            const char* buf,
+                            uint64 buf_size,
+                            uint64 pos,
+                            bool end_of_file,
+                            std::vector<uint64>* offsets) {
+  offsets->clear();
+  uint64 start = pos;
+  for (;;) {
+    offsets->push_back(pos);
+    if (pos - start >= kParseWindowSize) {
+      break;
+    }
+    const char* eol = reinterpret_cast<const char*>(
+        memchr(buf + pos, '\n', buf_size - pos));
+    if (eol == nullptr || eol + 1 == buf + buf_size) {
+      break;
+    }
+    int num_rows = TokenToInt(buf + pos, eol);
+    if (num_rows <= 0) {
+      LOG(FATAL) << "Invalid block-length line at offset " << pos
+                 << " of " << filename;
+    }
+    for (int i = 0; i < num_rows; ++i) {
+      if (eol == nullptr || eol + 1 == buf + buf_size) {
+        if (!end_of_file) {
+          return offsets->size() - 1;
+        }
+        LOG(FATAL) << "Incomplete block at offset " << offsets->back()
+                   << " of " << filename;
+      }
+      pos = eol + 1 - buf;
+      eol = reinterpret_cast<const char*>(
+          memchr(buf + pos, '\n', buf_size - pos));
+    }
+    if (eol == nullptr) {
+      if (!end_of_file) {
+        return offsets->size() - 1;
+      }
+      LOG(FATAL) << "Missing the max-length line of " << filename;
+    }
+    pos = eol + 1 - buf;
+  }
+  return offsets->size() - 1;
+}
+
+void Dataset::ParseBlocks(Parser* parser,
+                          const char* buf,
+                          const std::vector<uint64>& offsets,
+                          size_t first,
+                          int thread_id,
+                          int num_threads) {
+  for (size_t i = thread_id; i + 1 < offsets.size(); i += num_threads) {
+    parser->ParseBlock(buf + offsets[i],
+                       buf + offsets[i+1],
+                       arenas_[first + i]);
+  }
+}
+
+bool Dataset::LoadBinary(const std::string& filename) {
+  scoped_ptr<BinaryFile> binary_file(new BinaryFile);
+  if (!binary_file->Open(filename)) {
+    return false;
+  }
+  for (size_t i = 0; i < binary_file->NumBlocks(); ++i) {
+    blocks_.push_back(&binary_file->Block(i));
+  }
+  binary_files_.push_back(binary_file.release());
+  return true;
+}
+
+void Dataset::Append(Dataset* other) {
+  CHECK_NOTNULL(other);
+  arenas_.insert(arenas_.end(), other->arenas_.begin(), other->arenas_.end());
+  binary_files_.insert(binary_files_.end(),
+                       other->binary_files_.begin(),
+                       other->binary_files_.end());
+  blocks_.insert(blocks_.end(), other->blocks_.begin(), other->blocks_.end());
+  other->arenas_.clear();
+  other->binary_files_.clear();
+  other->blocks_.clear();
+}
+
+// The samples of a block in the row-major order. The entries of the
+// sample i are [row_ptr[i], row_ptr[i+1]) of col_ids and X (and fields,
+// which is empty if the block has no fields). The weights of the samples
+// are empty if the block has no weights.
+struct BlockRows {
+  std::vector<index_t> row_ptr;
+  std::vector<index_t> col_ids;
+  std::vector<index_t> fields;
+  std::vector<real_t> X;
+  std::vector<real_t> weights;
+};
+
+// An entry of a new block.
+struct ReblockEntry {
+  index_t id;
+  index_t field;
+  index_t sample;
+  real_t value;
+  bool operator<(const ReblockEntry& other) const {
+    return id < other.id || (id == other.id && sample < other.sample);
+  }
+};
+
+static void BlockToRows(const ColumnBlock& block, BlockRows* rows) {
+  // A column of a categorical field is slow to scan alone.
+  if (block.num_categorical > 0) {
+    ColumnArena arena;
+    DecodeBlock(block, &arena);
+    BlockToRows(arena.block, rows);
+    return;
+  }
+  rows->row_ptr.assign(block.num_samples + 1, 0);
+  index_t* row_ptr = rows->row_ptr.data();
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    ForEachEntry(block, j, [&](index_t i, real_t x) {
+      row_ptr[i + 1]++;
+    });
+  }
+  for (index_t i = 0; i < block.num_samples; ++i) {
+    rows->row_ptr[i + 1] += rows->row_ptr[i];
+  }
+  if (block.weights != nullptr) {
+    rows->weights.assign(block.weights, block.weights + block.num_samples);
+  } else {
+    rows->weights.clear();
+  }
+  rows->col_ids.resize(block.nnz);
+  rows->fields.resize(block.col_fields != nullptr ? block.nnz : 0);
+  rows->X.resize(block.nnz);
+  std::vector<index_t> pos(rows->row_ptr.begin(), rows->row_ptr.end() - 1);
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    ForEachEntry(block, j, [&](index_t i, real_t x) {
+      index_t p = pos[i]++;
+      rows->col_ids[p] = block.col_ids[j];
+      if (block.col_fields != nullptr) {
+        rows->fields[p] = block.col_fields[j];
+      }
+      rows->X[p] = x;
+    });
+  }
+}
+
+// Each sample of the new block is given by (source block, sample index).
+static void RowsToBlock(const std::vector<BlockRows>& rows,
+                        const std::vector<real_t>* labels,
+                        const std::pair<size_t, index_t>* samples,
+                        index_t num_samples,
+                        ColumnArena* arena) {
+  std::vector<ReblockEntry> entries;
+  bool has_weights = !rows.empty() && !rows[0].weights.empty();
+  arena->Y.resize(num_samples);
+  arena->weights.resize(has_weights ? num_samples : 0);
+  for (index_t i = 0; i < num_samples; ++i) {
+    const BlockRows& row = rows[samples[i].first];
+    index_t s = samples[i].second;
+    arena->Y[i] = labels[samples[i].first][s];
+    if (has_weights) {
+      arena->weights[i] = row.weights[s];
+    }
+    for (index_t k = row.row_ptr[s]; k < row.row_ptr[s+1]; ++k) {
+      ReblockEntry entry;
+      entry.id = row.col_ids[k];
+      entry.field = row.fields.empty() ? 0 : row.fields[k];
+      entry.sample = i;
+      entry.value = row.X[k];
+      entries.push_back(entry);
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+  bool has_fields = !rows.empty() && !rows[0].fields.empty();
+  arena->col_ids.clear();
+  arena->col_fields.clear();
+  arena->col_ptr.assign(1, 0);
+  arena->idx.resize(entries.size());
+  arena->X.resize(entries.size());
+  for (size_t k = 0; k < entries.size(); ++k) {
+    if (k == 0 || entries[k].id != entries[k-1].id) {
+      if (k > 0) {
+        arena->col_ptr.push_back(k);
+      }
+      arena->col_ids.push_back(entries[k].id);
+      if (has_fields) {
+        arena->col_fields.push_back(entries[k].field);
+      }
+    }
+    arena->idx[k] = entries[k].sample;
+    arena->X[k] = entries[k].value;
+  }
+  if (!entries.empty()) {
+    arena->col_ptr.push_back(entries.size());
+  }
+  arena->UpdateView();
+}
+
+// Run work(i) for i in [0, n) by num_threads threads. Each thread takes
+// the next i until all of them are done.
+static void ParallelFor(size_t n,
+                        int num_threads,
+                        const std::function<void(size_t)>& work) {
+  std::atomic<size_t> next(0);
+  std::function<void()> loop = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      work(i);
+    }
+  };
+  int num_workers = std::min(static_cast<size_t>(num_threads), n);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_workers; ++i) {
+    threads.push_back(std::thread(loop));
+  }
+  loop();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+}
+
+// The source blocks are transposed to rows in parallel, and then the
+// shuffled rows are transposed to the new blocks in parallel.
+Dataset* Dataset::Reblock(const Dataset& source,
+                          size_t begin,
+                          size_t end,
+                          std::mt19937_64* rng,
+                          int num_threads) {
+  CHECK_NOTNULL(rng);
+  CHECK_GT(num_threads, 0);
+  end = std::min(end, source.NumBlocks());
+  begin = std::min(begin, end);
+  size_t num_blocks = end - begin;
+  std::vector<BlockRows> rows(num_blocks);
+  std::vector<std::vector<real_t>> labels(num_blocks);
+  ParallelFor(num_blocks, num_threads, [&](size_t b) {
+    const ColumnBlock& block = source.Block(begin + b);
+    BlockToRows(block, &rows[b]);
+    labels[b].assign(block.Y, block.Y + block.num_samples);
+  });
+  std::vector<std::pair<size_t, index_t>> samples;
+  std::vector<size_t> first_sample(num_blocks + 1, 0);
+  for (size_t b = 0; b < num_blocks; ++b) {
+    index_t num_samples = source.Block(begin + b).num_samples;
+    for (index_t i = 0; i < num_samples; ++i) {
+      samples.push_back(std::make_pair(b, i));
+    }
+    first_sample[b + 1] = samples.size();
+  }
+  std::shuffle(samples.begin(), samples.end(), *rng);
+  Dataset* dataset = new Dataset;
+  for (size_t b = 0; b < num_blocks; ++b) {
+    dataset->arenas_.push_back(new ColumnArena);
+  }
+  ParallelFor(num_blocks, num_threads, [&](size_t b) {
+    RowsToBlock(rows, labels.data(), samples.data() + first_sample[b],
+                first_sample[b + 1] - first_sample[b], dataset->arenas_[b]);
+  });
+  for (size_t b = 0; b < num_blocks; ++b) {
+    dataset->blocks_.push_back(&dataset->arenas_[b]->block);
+  }
+  LOG(INFO) << "Reblock " << samples.size() << " samples into "
+            << num_blocks << " blocks";
+  return dataset;
+}
+
+// Each thread takes the next shard until all the shards are loaded.
+Dataset* Dataset::LoadShards(const std::vector<std::string>& shards,
+                             int num_threads,
+                             const ShardLoader& loader) {
+  CHECK(!shards.empty());
+  CHECK_GT(num_threads, 0);
+  if (shards.size() == 1) {
+    return loader(shards[0], num_threads);
+  }
+  std::vector<Dataset*> parts(shards.size(), nullptr);
+  int num_workers = std::min(static_cast<size_t>(num_threads), shards.size());
+  int threads_per_shard = std::max(1, num_threads / num_workers);
+  std::atomic<size_t> next_shard(0);
+  std::function<void()> work = [&]() {
+    for (size_t i = next_shard++; i < shards.size(); i = next_shard++) {
+      parts[i] = loader(shards[i], threads_per_shard);
+      CHECK_NOTNULL(parts[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_workers; ++i) {
+    threads.push_back(std::thread(work));
+  }
+  work();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  Dataset* dataset = new Dataset;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    dataset->Append(parts[i]);
+  }
+  STLDeleteElementsAndClear(&parts);
+  LOG(INFO) << "Load " << dataset->NumBlocks() << " blocks from "
+            << shards.size() << " shards";
+  return dataset;
+}
+
+//------------------------------------------------------------------------------
+// Implementation of BlockCursor
+//------------------------------------------------------------------------------
+
+BlockCursor::BlockCursor(const std::shared_ptr<const Dataset>& dataset,
+                         size_t begin,
+                         size_t end)
+  : dataset_(dataset) {
+  CHECK_NOTNULL(dataset_.get());
+  end_ = std::min(end, dataset_->NumBlocks());
+  begin_ = std::min(begin, end_);
+  pos_.store(begin_);
+}
+
+void BlockCursor::Shuffle(std::mt19937_64* rng) {
+  CHECK_NOTNULL(rng);
+  if (order_.empty()) {
+    order_.resize(end_ - begin_);
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = begin_ + i;
+    }
+  }
+  std::shuffle(order_.begin(), order_.end(), *rng);
+  Reset();
+}
+
+//------------------------------------------------------------------------------
+// The dataset registry
+//------------------------------------------------------------------------------
+
+// Each key has its own lock, so that loading a big file does not
+// block the Readers of other files.
+struct DatasetEntry {
+  Mutex mutex;
+  std::weak_ptr<const Dataset> dataset;
+};
+
+typedef std::map<std::string, std::shared_ptr<DatasetEntry> > DatasetRegistry;
+
+// A poor guy's singleton.
+static Mutex& GetRegistryMutex() {
+  static Mutex mutex;
+  return mutex;
+}
+
+static DatasetRegistry& GetRegistry() {
+  static DatasetRegistry registry;
+  return registry;
+}
+
+std::shared_ptr<const Dataset> AcquireDataset(const std::string& key,
+                                              const DatasetLoader& loader) {
+  std::shared_ptr<DatasetEntry> entry;
+  {
+    MutexLocker locker(&GetRegistryMutex());
+    std::shared_ptr<DatasetEntry>& slot = GetRegistry()[key];
+    if (slot.get() == nullptr) {
+      slot.reset(new DatasetEntry);
+    }
+    entry = slot;
+  }
+  MutexLocker locker(&entry->mutex);
+  std::shared_ptr<const Dataset> dataset = entry->dataset.lock();
+  if (dataset.get() != nullptr) {
+    LOG(INFO) << "Share dataset: " << key;
+    return dataset;
+  }
+  dataset.reset(loader());
+  CHECK_NOTNULL(dataset.get());
+  entry->dataset = dataset;
+  return dataset;
+}
+
+// Keep each negative sample of the block with probability rate, and
+// compact the sample indices of the columns. The empty columns are
+// dropped. The kept negative samples are weighted by 1 / rate. The
+// arrays are sized by counting first, so no memory is wasted.
+static void DownsampleBlock(const ColumnBlock& block,
+                            real_t rate,
+                            uint64 seed,
+                            ColumnArena* arena) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<real_t> uniform(0, 1);
+  // The new index of each sample, or -1 if it is dropped.
+  std::vector<int64> new_idx(block.num_samples, -1);
+  index_t num_kept = 0;
+  for (index_t i = 0; i < block.num_samples; ++i) {
+    if (block.Y[i] > 0 || uniform(rng) < rate) {
+      new_idx[i] = num_kept++;
+    }
+  }
+  arena->Y.resize(num_kept);
+  arena->weights.resize(num_kept);
+  for (index_t i = 0; i < block.num_samples; ++i) {
+    if (new_idx[i] >= 0) {
+      real_t weight = block.weights != nullptr ? block.weights[i] : 1;
+      arena->Y[new_idx[i]] = block.Y[i];
+      arena->weights[new_idx[i]] = block.Y[i] > 0 ? weight : weight / rate;
+    }
+  }
+  size_t nnz = 0;
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    ForEachEntry(block, j, [&](index_t i, real_t x) {
+      nnz += new_idx[i] >= 0;
+    });
+  }
+  arena->col_ids.clear();
+  arena->col_fields.clear();
+  arena->col_ptr.assign(1, 0);
+  arena->idx.clear();
+  arena->X.clear();
+  arena->col_ids.reserve(block.num_columns);
+  arena->col_ptr.reserve(block.num_columns + 1);
+  arena->idx.reserve(nnz);
+  arena->X.reserve(nnz);
+  for (index_t j = 0; j < block.num_columns; ++j) {
+    ForEachEntry(block, j, [&](index_t i, real_t x) {
+      if (new_idx[i] >= 0) {
+        arena->idx.push_back(new_idx[i]);
+        arena->X.push_back(x);
+      }
+    });
+    if (arena->idx.size() > arena->col_ptr.back()) {
+      arena->col_ids.push_back(block.col_ids[j]);
+      if (block.col_fields != nullptr) {
+        arena->col_fields.push_back(block.col_fields[j]);
+      }
+      arena->col_ptr.push_back(arena->idx.size());
+    }
+  }
+  arena->UpdateView();
+}
+
+// Each block is given its own seed, so the result does not depend on
+// the number of threads.
+Dataset* Dataset::Downsample(const Dataset& source,
+                             size_t begin,
+                             size_t end,
+                             real_t negative_rate,
+                             std::mt19937_64* rng,
+                             int num_threads) {
+  CHECK_NOTNULL(rng);
+  CHECK_GT(negative_rate, 0);
+  CHECK_LE(negative_rate, 1);
+  CHECK_GT(num_threads, 0);
+  end = std::min(end, source.NumBlocks());
+  begin = std::min(begin, end);
+  size_t num_blocks = end - begin;
+  std::vector<uint64> seeds(num_blocks);
+  for (size_t b = 0; b < num_blocks; ++b) {
+    seeds[b] = (*rng)();
+  }
+  std::vector<ColumnArena*> arenas(num_blocks);
+  ParallelFor(num_blocks, num_threads, [&](size_t b) {
+    arenas[b] = new ColumnArena;
+    DownsampleBlock(source.Block(begin + b), negative_rate,
+                    seeds[b], arenas[b]);
+  });
+  Dataset* dataset = new Dataset;
+  uint64 num_samples = 0, num_kept = 0;
+  for (size_t b = 0; b < num_blocks; ++b) {
+    num_samples += source.Block(begin + b).num_samples;
+    num_kept += arenas[b]->Y.size();
+    // All the samples of the block are dropped.
+    if (arenas[b]->Y.empty()) {
+      delete arenas[b];
+      continue;
+    }
+    dataset->arenas_.push_back(arenas[b]);
+    dataset->blocks_.push_back(&arenas[b]->block);
+  }
+  LOG(INFO) << "Downsample the negative samples by " << negative_rate
+            << ", keep " << num_kept << " of " << num_samples << " samples";
+  return dataset;
+}
+
+Dataset* Dataset::Compress(const Dataset& source,
+                           size_t begin,
+                           size_t end,
+                           int num_threads) {
+  CHECK_GT(num_threads, 0);
+  end = std::min(end, source.NumBlocks());
+  begin = std::min(begin, end);
+  size_t num_blocks = end - begin;
+  Dataset* dataset = new Dataset;
+  dataset->arenas_.resize(num_blocks);
+  dataset->blocks_.resize(num_blocks);
+  ParallelFor(num_blocks, num_threads, [&](size_t b) {
+    ColumnArena* arena = new ColumnArena;
+    EncodeBlock(source.Block(begin + b), arena);
+    dataset->arenas_[b] = arena;
+    dataset->blocks_[b] = &arena->block;
+  });
+  uint64 nnz = 0, packed_size = 0;
+  for (size_t b = 0; b < num_blocks; ++b) {
+    nnz += dataset->blocks_[b]->nnz;
+    packed_size += dataset->arenas_[b]->packed.size();
+  }
+  LOG(INFO) << "Encode the " << nnz << " entries of the columns in "
+            << packed_size << " bytes instead of "
+            << (sizeof(index_t) + sizeof(real_t)) * nnz << " bytes";
+  return dataset;
+}
+
+} // namespace f2m
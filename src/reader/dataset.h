@@ -0,0 +1,263 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the Dataset class, which is an immutable parsed copy
+of a data file, and the process-wide registry of the Datasets.
+*/
+
+#ifndef F2M_READER_DATASET_H_
+#define F2M_READER_DATASET_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/reader/binary_format.h"
+#include "src/reader/parser.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// The data path of the trainning set or the testing set can be a file,
+// a directory of shards, or a glob pattern of shards (e.g.,
+// "/data/20160801/part-*"). ListShards() returns the shards of the path
+// in the order of their names. In a directory, the hidden files and the
+// binary caches and metadata sidecars of other shards are ignored.
+//------------------------------------------------------------------------------
+std::vector<std::string> ListShards(const std::string& path);
+
+// Return true if the path is a directory or a glob pattern.
+bool IsShardedPath(const std::string& path);
+
+//------------------------------------------------------------------------------
+// Dataset holds all the column blocks of a data file (or all the shards
+// of a data path). The blocks are either parsed from the column-block
+// text file into ColumnArenas, or mapped from binary files. Once loaded,
+// a Dataset is never changed, so it can be scanned by many Readers (in
+// different threads) at the same time. Each Reader keeps its own position.
+//------------------------------------------------------------------------------
+class Dataset;
+
+// The shard loader creates and loads the Dataset of one shard using
+// num_threads threads.
+typedef std::function<Dataset*(const std::string& shard, int num_threads)>
+    ShardLoader;
+
+// The visitor of the blocks parsed by Dataset::ScanText().
+typedef std::function<void(const ColumnBlock& block)> BlockVisitor;
+
+class Dataset {
+ public:
+  Dataset() : num_parsed_(0) {  }
+  ~Dataset();
+
+  // Load the shards in parallel by num_threads threads, and concatenate
+  // their blocks in the order of the shards. When there are fewer
+  // shards than threads, the rest threads are given to the loaders.
+  static Dataset* LoadShards(const std::vector<std::string>& shards,
+                             int num_threads,
+                             const ShardLoader& loader);
+
+  // Parse the text file using num_threads threads. The file is mapped
+  // into memory and parsed window by window, and the pages of each
+  // window are dropped after parsing, so the peak memory is close to
+  // the size of the parsed blocks. The file can be compressed by gzip
+  // or zstd (see input_stream.h).
+  void LoadText(const std::string& filename, Parser* parser, int num_threads);
+
+  // Parse the text file like LoadText(), but pass each block to the
+  // visitor (in the order of the file) and release it as soon as its
+  // window is parsed, so the memory is bounded by one window. It is
+  // used to convert a text file that does not fit in memory.
+  static void ScanText(const std::string& filename,
+                       Parser* parser,
+                       int num_threads,
+                       const BlockVisitor& visitor);
+
+  // Map the binary file, and append its blocks. Return false if it is
+  // not a valid binary file.
+  bool LoadBinary(const std::string& filename);
+
+  // Move all the blocks of the other Dataset to the end of this one.
+  void Append(Dataset* other);
+
+  // Regroup the samples of the blocks [begin, end) of the source into
+  // new blocks, in a random order given by the rng. The k-th new block
+  // has as many samples as the k-th block of the range, so the sizes of
+  // the mini-batches are not changed. The blocks are transposed back to
+  // rows and then to columns in memory by num_threads threads, and the
+  // peak memory is about twice the size of the range.
+  static Dataset* Reblock(const Dataset& source,
+                          size_t begin,
+                          size_t end,
+                          std::mt19937_64* rng,
+                          int num_threads);
+
+  // Keep each negative sample (label <= 0) of the blocks [begin, end)
+  // of the source with probability negative_rate, which is drawn from
+  // the rng, and weight the kept ones by 1 / negative_rate, so that the
+  // weighted loss and gradients are unbiased. The samples stay in their
+  // blocks, whose sample indices are compacted, and a block that keeps
+  // no sample is dropped. The blocks are downsampled in memory by
+  // num_threads threads.
+  static Dataset* Downsample(const Dataset& source,
+                             size_t begin,
+                             size_t end,
+                             real_t negative_rate,
+                             std::mt19937_64* rng,
+                             int num_threads);
+
+  // Encode the columns of the blocks [begin, end) of the source (see
+  // column_codec.h) by num_threads threads. The sample indices and the
+  // values of a column usually shrink from 8 bytes to 1 or 2 bytes per
+  // entry, and the Loss decodes them on the fly. The source blocks must
+  // be plain.
+  static Dataset* Compress(const Dataset& source,
+                           size_t begin,
+                           size_t end,
+                           int num_threads);
+
+  // Number of blocks.
+  size_t NumBlocks() const { return blocks_.size(); }
+
+  // Return the i-th block.
+  const ColumnBlock& Block(size_t i) const { return *blocks_[i]; }
+
+ private:
+  std::vector<ColumnArena*> arenas_;         // Blocks parsed from text
+  std::vector<BinaryFile*> binary_files_;    // Blocks mapped from binary
+  std::vector<const ColumnBlock*> blocks_;   // Views of all the blocks
+  BlockVisitor visitor_;                     // Only used by ScanText()
+  size_t num_parsed_;                        // Number of parsed blocks
+
+  // Parse the mapped file. Return the size of the file.
+  uint64 LoadMappedText(const std::string& filename,
+                        Parser* parser,
+                        int num_threads);
+
+  // Parse the compressed file by a decompressing InputStream. Return
+  // the size of the decompressed data.
+  uint64 LoadCompressedText(const std::string& filename,
+                            Parser* parser,
+                            int num_threads);
+
+  // Find the blocks from pos, until the end of the buffer or the window
+  // size. The k-th block is [offsets[k], offsets[k+1]). Return the
+  // number of blocks. If end_of_file is false, the incomplete block at
+  // the end of the buffer is left for the next window.
+  size_t SplitBlocks(const std::string& filename,
+                     const char* buf,
+                     uint64 buf_size,
+                     uint64 pos,
+                     bool end_of_file,
+                     std::vector<uint64>* offsets);
+
+  // Parse the blocks of the window to new arenas by num_threads threads.
+  void ParseWindow(Parser* parser,
+                   const char* buf,
+                   const std::vector<uint64>& offsets,
+                   int num_threads);
+
+  // Parse the blocks of the window: thread_id, thread_id + num_threads,
+  // ... to arenas_[first + thread_id], ...
+  void ParseBlocks(Parser* parser,
+                   const char* buf,
+                   const std::vector<uint64>& offsets,
+                   size_t first,
+                   int thread_id,
+                   int num_threads);
+
+  DISALLOW_COPY_AND_ASSIGN(Dataset);
+};
+
+//------------------------------------------------------------------------------
+// BlockCursor iterates the blocks [begin, end) of a Dataset, and keeps
+// the Dataset alive. Each cursor has its own position, so many cursors
+// can scan the same Dataset independently. Next() is also thread-safe:
+// when several threads share one cursor, each block is returned to only
+// one of them, e.g., the workers of one epoch. We can use it like this:
+//
+//   BlockCursor* cursor = reader->NewCursor();
+//   const ColumnBlock* block = nullptr;
+//   while ((block = cursor->Next()) != nullptr) {
+//     // use the block ...
+//   }
+//
+// The blocks are returned in the order of the Dataset, unless the cursor
+// is shuffled, and then in the order of a permutation of the range. Only
+// the indices of the blocks are shuffled, and the blocks are not copied.
+//------------------------------------------------------------------------------
+class BlockCursor {
+ public:
+  BlockCursor(const std::shared_ptr<const Dataset>& dataset,
+              size_t begin,
+              size_t end);
+  ~BlockCursor() {  }
+
+  // Return the next block, or nullptr at the end of the range.
+  inline const ColumnBlock* Next() {
+    size_t pos = pos_.fetch_add(1, std::memory_order_relaxed);
+    if (pos >= end_) {
+      return nullptr;
+    }
+    return &dataset_->Block(order_.empty() ? pos : order_[pos - begin_]);
+  }
+
+  // Return to the first block. It must not be invoked at the same
+  // time with Next().
+  void Reset() { pos_.store(begin_, std::memory_order_relaxed); }
+
+  // Shuffle the order of the blocks by the rng, and return to the first
+  // block. Each call gives a new permutation of the last one, so the
+  // orders of the epochs are the same for the same seed of the rng. It
+  // must not be invoked at the same time with Next().
+  void Shuffle(std::mt19937_64* rng);
+
+  // Number of blocks in the range.
+  size_t NumBlocks() const { return end_ - begin_; }
+
+ private:
+  std::shared_ptr<const Dataset> dataset_;
+  size_t begin_;
+  size_t end_;
+  std::atomic<size_t> pos_;
+  std::vector<size_t> order_;   // Empty if not shuffled
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCursor);
+};
+
+// The loader creates and loads a new Dataset.
+typedef std::function<Dataset*()> DatasetLoader;
+
+// Return the Dataset of the key (e.g., "memory:/tmp/train.txt") from the
+// process-wide registry. If no one is using the Dataset of the key, we
+// create it by the loader. The Dataset is released as soon as the last
+// user (usually a Reader) releases it. Different keys can be loaded in
+// different threads at the same time.
+std::shared_ptr<const Dataset> AcquireDataset(const std::string& key,
+                                              const DatasetLoader& loader);
+
+} // namespace f2m
+
+#endif // F2M_READER_DATASET_H_
@@ -0,0 +1,416 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of input_stream.h.
+*/
+
+#include "src/reader/input_stream.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <zlib.h>
+#if defined(F2M_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "src/base/file_util.h"
+
+namespace f2m {
+
+static const size_t kCompressedChunkSize = 256 * 1024;  // 256 KB
+
+Codec DetectCodec(const std::string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  unsigned char magic[4];
+  size_t size = fread(magic, 1, 4, file);
+  Close(file);
+  if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return kGzip;
+  }
+  if (size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd) {
+    return kZstd;
+  }
+  return kNoCompression;
+}
+
+//------------------------------------------------------------------------------
+// PlainStream reads the file as it is.
+//------------------------------------------------------------------------------
+class PlainStream : public InputStream {
+ public:
+  explicit PlainStream(const std::string& filename) {
+    file_ = OpenFileOrDie(filename.c_str(), "r");
+  }
+  ~PlainStream() { Close(file_); }
+
+  virtual size_t Read(char* buf, size_t size) {
+    return fread(buf, 1, size, file_);
+  }
+
+  virtual void Rewind() { fseek(file_, 0, SEEK_SET); }
+
+  virtual bool Seek(uint64 offset) {
+    return fseek(file_, offset, SEEK_SET) == 0;
+  }
+
+ private:
+  FILE* file_;
+};
+
+//------------------------------------------------------------------------------
+// GzipStream decompresses a gzip (or zlib) file, which may have many
+// gzip members, e.g., the concatenation of gzip files.
+//------------------------------------------------------------------------------
+class GzipStream : public InputStream {
+ public:
+  explicit GzipStream(const std::string& filename)
+    : filename_(filename),
+      input_(kCompressedChunkSize),
+      end_of_input_(false),
+      in_member_(false) {
+    file_ = OpenFileOrDie(filename.c_str(), "r");
+    memset(&strm_, 0, sizeof(strm_));
+    // 15 + 32: the max window, and detect the gzip or zlib header.
+    CHECK_EQ(inflateInit2(&strm_, 15 + 32), Z_OK);
+  }
+  ~GzipStream() {
+    inflateEnd(&strm_);
+    Close(file_);
+  }
+
+  virtual size_t Read(char* buf, size_t size) {
+    strm_.next_out = reinterpret_cast<Bytef*>(buf);
+    strm_.avail_out = size;
+    while (strm_.avail_out > 0) {
+      if (strm_.avail_in == 0) {
+        if (end_of_input_) {
+          break;
+        }
+        strm_.next_in = reinterpret_cast<Bytef*>(input_.data());
+        strm_.avail_in = fread(input_.data(), 1, input_.size(), file_);
+        if (strm_.avail_in == 0) {
+          end_of_input_ = true;
+          // The last member has not ended.
+          if (in_member_) {
+            LOG(FATAL) << "Truncated gzip file: " << filename_;
+          }
+          break;
+        }
+      }
+      in_member_ = true;
+      int ret = inflate(&strm_, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        // Another member may follow.
+        in_member_ = false;
+        CHECK_EQ(inflateReset(&strm_), Z_OK);
+      } else if (ret != Z_OK) {
+        LOG(FATAL) << "Corrupted gzip file: " << filename_
+                   << " (" << (strm_.msg ? strm_.msg : "") << ")";
+      }
+    }
+    return size - strm_.avail_out;
+  }
+
+  virtual void Rewind() {
+    fseek(file_, 0, SEEK_SET);
+    CHECK_EQ(inflateReset(&strm_), Z_OK);
+    strm_.avail_in = 0;
+    end_of_input_ = false;
+    in_member_ = false;
+  }
+
+ private:
+  std::string filename_;
+  FILE* file_;
+  z_stream strm_;
+  std::vector<char> input_;
+  bool end_of_input_;
+  bool in_member_;
+};
+
+#if defined(F2M_USE_ZSTD)
+//------------------------------------------------------------------------------
+// ZstdStream decompresses a zstd file, which may have many frames.
+//------------------------------------------------------------------------------
+class ZstdStream : public InputStream {
+ public:
+  explicit ZstdStream(const std::string& filename)
+    : filename_(filename),
+      input_(ZSTD_DStreamInSize()),
+      in_frame_(false) {
+    file_ = OpenFileOrDie(filename.c_str(), "r");
+    dstream_ = ZSTD_createDStream();
+    CHECK_NOTNULL(dstream_);
+    Rewind();
+  }
+  ~ZstdStream() {
+    ZSTD_freeDStream(dstream_);
+    Close(file_);
+  }
+
+  virtual size_t Read(char* buf, size_t size) {
+    ZSTD_outBuffer out = { buf, size, 0 };
+    while (out.pos < out.size) {
+      if (in_.pos == in_.size) {
+        in_.size = fread(input_.data(), 1, input_.size(), file_);
+        in_.pos = 0;
+        if (in_.size == 0) {
+          if (in_frame_) {
+            LOG(FATAL) << "Truncated zstd file: " << filename_;
+          }
+          break;
+        }
+      }
+      size_t ret = ZSTD_decompressStream(dstream_, &out, &in_);
+      if (ZSTD_isError(ret)) {
+        LOG(FATAL) << "Corrupted zstd file: " << filename_
+                   << " (" << ZSTD_getErrorName(ret) << ")";
+      }
+      // ret == 0 means the end of a frame.
+      in_frame_ = ret != 0;
+    }
+    return out.pos;
+  }
+
+  virtual void Rewind() {
+    fseek(file_, 0, SEEK_SET);
+    ZSTD_initDStream(dstream_);
+    in_.src = input_.data();
+    in_.size = 0;
+    in_.pos = 0;
+    in_frame_ = false;
+  }
+
+ private:
+  std::string filename_;
+  FILE* file_;
+  ZSTD_DStream* dstream_;
+  std::vector<char> input_;
+  ZSTD_inBuffer in_;
+  bool in_frame_;
+};
+#endif
+
+InputStream* OpenInputStream(const std::string& filename) {
+  switch (DetectCodec(filename)) {
+    case kGzip:
+      return new PipelinedStream(new GzipStream(filename));
+    case kZstd:
+#if defined(F2M_USE_ZSTD)
+      return new PipelinedStream(new ZstdStream(filename));
+#else
+      LOG(FATAL) << "f2m is built without zstd, and cannot read: "
+                 << filename;
+#endif
+    default:
+      return new PlainStream(filename);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Implementation of PipelinedStream
+//------------------------------------------------------------------------------
+
+PipelinedStream::PipelinedStream(InputStream* source)
+  : source_(source) {
+  CHECK_NOTNULL(source);
+  Start();
+}
+
+PipelinedStream::~PipelinedStream() {
+  Stop();
+}
+
+void PipelinedStream::Start() {
+  for (int i = 0; i < kNumChunks; ++i) {
+    sizes_[i] = 0;
+    ready_[i] = false;
+  }
+  read_chunk_ = 0;
+  read_pos_ = 0;
+  stop_ = false;
+  thread_ = std::thread(&PipelinedStream::FillThread, this);
+}
+
+void PipelinedStream::Stop() {
+  if (thread_.joinable()) {
+    {
+      MutexLocker locker(&mutex_);
+      stop_ = true;
+      cond_.Broadcast();
+    }
+    thread_.join();
+  }
+}
+
+// The background thread fills the chunks in turn, and waits when all
+// the chunks are full. An empty chunk marks the end of the source.
+void PipelinedStream::FillThread() {
+  for (int chunk = 0; ; chunk = (chunk + 1) % kNumChunks) {
+    {
+      MutexLocker locker(&mutex_);
+      while (!stop_ && ready_[chunk]) {
+        cond_.Wait(&mutex_);
+      }
+      if (stop_) {
+        return;
+      }
+    }
+    std::vector<char>& data = chunks_[chunk];
+    data.resize(kChunkSize);
+    size_t size = 0;
+    while (size < kChunkSize) {
+      size_t read_size = source_->Read(data.data() + size, kChunkSize - size);
+      if (read_size == 0) {
+        break;
+      }
+      size += read_size;
+    }
+    {
+      MutexLocker locker(&mutex_);
+      sizes_[chunk] = size;
+      ready_[chunk] = true;
+      cond_.Broadcast();
+    }
+    if (size == 0) {
+      return;
+    }
+  }
+}
+
+size_t PipelinedStream::Read(char* buf, size_t size) {
+  size_t read_size = 0;
+  MutexLocker locker(&mutex_);
+  while (read_size < size) {
+    while (!ready_[read_chunk_]) {
+      cond_.Wait(&mutex_);
+    }
+    size_t chunk_size = sizes_[read_chunk_];
+    // The end of the source.
+    if (chunk_size == 0) {
+      break;
+    }
+    size_t copy_size = std::min(size - read_size, chunk_size - read_pos_);
+    memcpy(buf + read_size, chunks_[read_chunk_].data() + read_pos_,
+           copy_size);
+    read_size += copy_size;
+    read_pos_ += copy_size;
+    if (read_pos_ == chunk_size) {
+      ready_[read_chunk_] = false;
+      read_chunk_ = (read_chunk_ + 1) % kNumChunks;
+      read_pos_ = 0;
+      cond_.Broadcast();
+    }
+  }
+  return read_size;
+}
+
+void PipelinedStream::Rewind() {
+  Stop();
+  source_->Rewind();
+  Start();
+}
+
+//------------------------------------------------------------------------------
+// Implementation of LineReader
+//------------------------------------------------------------------------------
+
+LineReader::LineReader(InputStream* stream)
+  : stream_(stream),
+    buffer_(kBufferSize),
+    begin_(0),
+    end_(0),
+    offset_(0) {
+  CHECK_NOTNULL(stream);
+}
+
+bool LineReader::ReadLine(std::string* line) {
+  CHECK_NOTNULL(line);
+  line->clear();
+  if (!AppendLine(line)) {
+    return false;
+  }
+  line->pop_back();
+  return true;
+}
+
+bool LineReader::AppendLine(std::string* text) {
+  CHECK_NOTNULL(text);
+  size_t scan = begin_;
+  for (;;) {
+    const char* eol = reinterpret_cast<const char*>(
+        memchr(buffer_.data() + scan, '\n', end_ - scan));
+    if (eol != nullptr) {
+      scan = eol - buffer_.data();
+      break;
+    }
+    scan = end_;
+    // Move the unread bytes to the front, and grow the buffer for
+    // the long line.
+    if (begin_ > 0) {
+      memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+      scan -= begin_;
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buffer_.size()) {
+      buffer_.resize(buffer_.size() * 2);
+    }
+    size_t read_size = stream_->Read(buffer_.data() + end_,
+                                     buffer_.size() - end_);
+    if (read_size == 0) {
+      // The last line has no '\n'.
+      if (begin_ == end_) {
+        return false;
+      }
+      break;
+    }
+    end_ += read_size;
+  }
+  size_t next = std::min(scan + 1, end_);
+  size_t len = scan - begin_;
+  if (len > 0 && buffer_[begin_ + len - 1] == '\r') {
+    --len;
+  }
+  text->append(buffer_.data() + begin_, len);
+  text->push_back('\n');
+  offset_ += next - begin_;
+  begin_ = next;
+  return true;
+}
+
+bool LineReader::Seek(uint64 offset) {
+  if (!stream_->Seek(offset)) {
+    return false;
+  }
+  begin_ = end_ = 0;
+  offset_ = offset;
+  return true;
+}
+
+void LineReader::Rewind() {
+  stream_->Rewind();
+  begin_ = end_ = 0;
+  offset_ = 0;
+}
+
+} // namespace f2m
@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the InputStream classes, which read the data files
+that may be compressed by gzip or zstd. The codec is detected by the
+magic bytes of the file, and the data is decompressed on the fly, so
+the uncompressed data never lands on disk.
+*/
+
+#ifndef F2M_READER_INPUT_STREAM_H_
+#define F2M_READER_INPUT_STREAM_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/scoped_ptr.h"
+#include "src/thread/condition_variable.h"
+#include "src/thread/mutex.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// Compression codecs of the data files.
+//------------------------------------------------------------------------------
+enum Codec {
+  kNoCompression,
+  kGzip,
+  kZstd
+};
+
+// Detect the codec of the file by its magic bytes.
+Codec DetectCodec(const std::string& filename);
+
+//------------------------------------------------------------------------------
+// InputStream reads the uncompressed bytes of a file sequentially.
+// We can use it like this:
+//
+//   scoped_ptr<InputStream> stream(OpenInputStream("/tmp/train.txt.gz"));
+//   char buf[4096];
+//   size_t size = 0;
+//   while ((size = stream->Read(buf, 4096)) > 0) {
+//     // use buf[0, size) ...
+//   }
+//------------------------------------------------------------------------------
+class InputStream {
+ public:
+  InputStream() {  }
+  virtual ~InputStream() {  }
+
+  // Read at most size bytes to buf. Return the number of bytes we
+  // read, which is less than size only at the end of the stream.
+  virtual size_t Read(char* buf, size_t size) = 0;
+
+  // Return to the begining of the stream.
+  virtual void Rewind() = 0;
+
+  // Go to the offset of the uncompressed data. Return false if the
+  // stream cannot seek, e.g., it is compressed.
+  virtual bool Seek(uint64 offset) { return false; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InputStream);
+};
+
+// Open the file by the InputStream of its codec. A compressed file is
+// decompressed by a background thread while the caller is reading.
+InputStream* OpenInputStream(const std::string& filename);
+
+//------------------------------------------------------------------------------
+// PipelinedStream reads the source stream in a background thread into
+// a ring of chunks, so the source (e.g., the decompressor) and the
+// caller (e.g., the parser) run at the same time.
+//------------------------------------------------------------------------------
+class PipelinedStream : public InputStream {
+ public:
+  // Take the ownership of the source.
+  explicit PipelinedStream(InputStream* source);
+  ~PipelinedStream();
+
+  virtual size_t Read(char* buf, size_t size);
+
+  virtual void Rewind();
+
+ private:
+  static const int kNumChunks = 4;
+  static const size_t kChunkSize = 4 * 1024 * 1024;  // 4 MB
+
+  scoped_ptr<InputStream> source_;
+  std::vector<char> chunks_[kNumChunks];
+  size_t sizes_[kNumChunks];     // Bytes in each chunk, 0 at the end
+  bool ready_[kNumChunks];       // If the chunk has been filled
+  int read_chunk_;               // Chunk read by the caller
+  size_t read_pos_;              // Position in the read chunk
+  bool stop_;                    // Stop the background thread
+  Mutex mutex_;
+  ConditionVariable cond_;
+  std::thread thread_;
+
+  // The loop of the background thread.
+  void FillThread();
+
+  // Start and stop the background thread.
+  void Start();
+  void Stop();
+
+  DISALLOW_COPY_AND_ASSIGN(PipelinedStream);
+};
+
+//------------------------------------------------------------------------------
+// LineReader reads the lines of an InputStream. The '\n' (and '\r')
+// at the end of each line is removed.
+//------------------------------------------------------------------------------
+class LineReader {
+ public:
+  // Take the ownership of the stream.
+  explicit LineReader(InputStream* stream);
+  ~LineReader() {  }
+
+  // Read the next line. Return false at the end of the stream.
+  bool ReadLine(std::string* line);
+
+  // Append the next line and a '\n' to text, so that the lines of a
+  // block can be parsed in one buffer. Return false at the end of the
+  // stream.
+  bool AppendLine(std::string* text);
+
+  // Return the offset (in the uncompressed data) of the next line.
+  uint64 Tell() const { return offset_; }
+
+  // Go to the offset returned by Tell(). Return false if the stream
+  // cannot seek, and then the position is not changed.
+  bool Seek(uint64 offset);
+
+  // Return to the first line.
+  void Rewind();
+
+ private:
+  static const size_t kBufferSize = 1024 * 1024;  // 1 MB
+
+  scoped_ptr<InputStream> stream_;
+  std::vector<char> buffer_;
+  size_t begin_;                 // Unread bytes: buffer_[begin_, end_)
+  size_t end_;
+  uint64 offset_;                // Offset of buffer_[begin_]
+
+  DISALLOW_COPY_AND_ASSIGN(LineReader);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_INPUT_STREAM_H_
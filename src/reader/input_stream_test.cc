@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests input_stream.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <zlib.h>
+#if defined(F2M_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/scoped_ptr.h"
+#include "src/reader/input_stream.h"
+
+using std::string;
+using std::vector;
+
+namespace f2m {
+
+const string kPlainFile = "/tmp/test_input_stream.txt";
+const string kGzipFile = "/tmp/test_input_stream.txt.gz";
+const string kZstdFile = "/tmp/test_input_stream.txt.zst";
+
+// About 10 MB of lines, which is larger than the chunks of the
+// PipelinedStream and the buffer of the LineReader.
+string MakeData() {
+  string data;
+  for (int i = 0; i < 1000000; ++i) {
+    data += std::to_string(i) + " " + std::to_string(i * 7) + ":0.5\n";
+  }
+  // A long line and the last line without '\n'.
+  data += string(3 * 1024 * 1024, 'x') + "\r\n";
+  data += "end";
+  return data;
+}
+
+void WriteFile(const string& filename, const string& data) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, data.data(), data.size());
+  Close(file);
+}
+
+// Write the data as two gzip members.
+void WriteGzipFile(const string& filename, const string& data) {
+  size_t half = data.size() / 2;
+  string parts[2] = { data.substr(0, half), data.substr(half) };
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  Close(file);
+  for (int i = 0; i < 2; ++i) {
+    gzFile gz = gzopen(filename.c_str(), "ab");
+    ASSERT_TRUE(gz != NULL);
+    EXPECT_EQ(gzwrite(gz, parts[i].data(), parts[i].size()),
+              static_cast<int>(parts[i].size()));
+    gzclose(gz);
+  }
+}
+
+// Read all the data by the odd-size reads.
+string ReadAll(InputStream* stream) {
+  string data;
+  vector<char> buf(12345);
+  size_t size = 0;
+  while ((size = stream->Read(buf.data(), buf.size())) > 0) {
+    data.append(buf.data(), size);
+  }
+  return data;
+}
+
+TEST(INPUT_STREAM_TEST, ReadGzip) {
+  string data = MakeData();
+  WriteFile(kPlainFile, data);
+  WriteGzipFile(kGzipFile, data);
+  EXPECT_EQ(DetectCodec(kPlainFile), kNoCompression);
+  EXPECT_EQ(DetectCodec(kGzipFile), kGzip);
+  scoped_ptr<InputStream> plain(OpenInputStream(kPlainFile));
+  scoped_ptr<InputStream> gzip(OpenInputStream(kGzipFile));
+  EXPECT_TRUE(ReadAll(plain.get()) == data);
+  EXPECT_TRUE(ReadAll(gzip.get()) == data);
+  // Rewind in the middle of the stream.
+  char buf[16];
+  gzip->Rewind();
+  EXPECT_EQ(gzip->Read(buf, 16), 16);
+  gzip->Rewind();
+  EXPECT_TRUE(ReadAll(gzip.get()) == data);
+  EXPECT_EQ(gzip->Read(buf, 16), 0);
+  RemoveFile(kPlainFile.c_str());
+  RemoveFile(kGzipFile.c_str());
+}
+
+#if defined(F2M_USE_ZSTD)
+TEST(INPUT_STREAM_TEST, ReadZstd) {
+  string data = MakeData();
+  vector<char> compressed(ZSTD_compressBound(data.size()));
+  size_t size = ZSTD_compress(compressed.data(), compressed.size(),
+                              data.data(), data.size(), 1);
+  ASSERT_FALSE(ZSTD_isError(size));
+  // Two frames of the same data.
+  WriteFile(kZstdFile, string(compressed.data(), size) +
+                       string(compressed.data(), size));
+  EXPECT_EQ(DetectCodec(kZstdFile), kZstd);
+  scoped_ptr<InputStream> zstd(OpenInputStream(kZstdFile));
+  EXPECT_TRUE(ReadAll(zstd.get()) == data + data);
+  zstd->Rewind();
+  EXPECT_TRUE(ReadAll(zstd.get()) == data + data);
+  RemoveFile(kZstdFile.c_str());
+}
+#endif
+
+TEST(INPUT_STREAM_TEST, LineReader) {
+  string data = MakeData();
+  WriteFile(kPlainFile, data);
+  WriteGzipFile(kGzipFile, data);
+  const string* files[2] = { &kPlainFile, &kGzipFile };
+  for (int n = 0; n < 2; ++n) {
+    LineReader reader(OpenInputStream(*files[n]));
+    string line;
+    for (int i = 0; i < 1000000; ++i) {
+      ASSERT_TRUE(reader.ReadLine(&line));
+      if (i == 10) {
+        EXPECT_EQ(line, "10 70:0.5");
+      }
+    }
+    uint64 offset = reader.Tell();
+    ASSERT_TRUE(reader.ReadLine(&line));
+    EXPECT_EQ(line.size(), 3 * 1024 * 1024);
+    ASSERT_TRUE(reader.ReadLine(&line));
+    EXPECT_EQ(line, "end");
+    EXPECT_FALSE(reader.ReadLine(&line));
+    EXPECT_EQ(reader.Tell(), data.size());
+    // Only the plain file can seek.
+    EXPECT_EQ(reader.Seek(offset), n == 0);
+    if (n == 0) {
+      ASSERT_TRUE(reader.ReadLine(&line));
+      EXPECT_EQ(line.size(), 3 * 1024 * 1024);
+    }
+    reader.Rewind();
+    ASSERT_TRUE(reader.ReadLine(&line));
+    EXPECT_EQ(line, "0 0:0.5");
+    // AppendLine() keeps the lines and ends each one with '\n'.
+    string text = line + "\n";
+    ASSERT_TRUE(reader.AppendLine(&text));
+    ASSERT_TRUE(reader.AppendLine(&text));
+    EXPECT_EQ(text, "0 0:0.5\n1 7:0.5\n2 14:0.5\n");
+  }
+  RemoveFile(kPlainFile.c_str());
+  RemoveFile(kGzipFile.c_str());
+}
+
+} // namespace f2m
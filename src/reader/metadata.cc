@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of metadata.h.
+*/
+
+#include "src/reader/metadata.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <map>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/reader/binary_format.h"
+
+namespace f2m {
+
+bool ReadMetadata(const std::string& data_file, DatasetMeta* meta) {
+  CHECK_NOTNULL(meta);
+  std::string filename = data_file + kMetadataSuffix;
+  FILE* file = fopen(filename.c_str(), "r");
+  if (file == nullptr) {
+    return false;
+  }
+  std::map<std::string, int64> values;
+  char key[64];
+  int64 value = 0;
+  while (fscanf(file, "%63s %" SCNd64, key, &value) == 2) {
+    values[key] = value;
+  }
+  Close(file);
+  const char* keys[] = { "version", "source_size", "source_mtime",
+                         "max_feature", "num_blocks", "num_samples",
+                         "nnz", "num_field" };
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    if (values.find(keys[i]) == values.end()) {
+      LOG(WARNING) << "Missing " << keys[i] << " in " << filename;
+      return false;
+    }
+  }
+  if (values["version"] != kMetadataVersion) {
+    return false;
+  }
+  uint64 size = 0;
+  int64 mtime = 0;
+  GetFileStat(data_file, &size, &mtime);
+  if (static_cast<uint64>(values["source_size"]) != size ||
+      values["source_mtime"] != mtime) {
+    return false;
+  }
+  meta->max_feature = values["max_feature"];
+  meta->num_blocks = values["num_blocks"];
+  meta->num_samples = values["num_samples"];
+  meta->nnz = values["nnz"];
+  meta->num_field = values["num_field"];
+  return true;
+}
+
+// Write to a temp file and rename it, so that others never see an
+// incomplete sidecar.
+bool WriteMetadata(const std::string& data_file, const DatasetMeta& meta) {
+  std::string filename = data_file + kMetadataSuffix;
+  std::string tmp_filename = filename + ".tmp";
+  FILE* file = fopen(tmp_filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  uint64 size = 0;
+  int64 mtime = 0;
+  GetFileStat(data_file, &size, &mtime);
+  fprintf(file, "version %d\n", kMetadataVersion);
+  fprintf(file, "source_size %" PRIu64 "\n", size);
+  fprintf(file, "source_mtime %" PRId64 "\n", mtime);
+  fprintf(file, "max_feature %u\n", meta.max_feature);
+  fprintf(file, "num_blocks %" PRIu64 "\n", meta.num_blocks);
+  fprintf(file, "num_samples %" PRIu64 "\n", meta.num_samples);
+  fprintf(file, "nnz %" PRIu64 "\n", meta.nnz);
+  fprintf(file, "num_field %d\n", meta.num_field);
+  Close(file);
+  if (rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    RemoveFile(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace f2m
@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the DatasetMeta, which is stored in a sidecar file
+next to the data file, so that we do not need to scan the data file
+to get the max feature id at the beginning of each run.
+*/
+
+#ifndef F2M_READER_METADATA_H_
+#define F2M_READER_METADATA_H_
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// The metadata of "train.txt" is stored in "train.txt.meta", which is a
+// text file like this:
+//
+//   version 2
+//   source_size 1048576
+//   source_mtime 1467302400123456789
+//   max_feature 126
+//   num_blocks 66
+//   num_samples 6500
+//   nnz 150000
+//   num_field 0
+//
+// The size and the modify time (in nanoseconds) of the data file are
+// recorded, and the sidecar is ignored once the data file changes. The
+// sidecars of the version 1 have no num_field, and are written again.
+//------------------------------------------------------------------------------
+
+static const char kMetadataSuffix[] = ".meta";
+static const int kMetadataVersion = 2;
+
+struct DatasetMeta {
+  index_t max_feature = 0;   // The max feature id.
+  uint64 num_blocks = 0;     // Number of column blocks.
+  uint64 num_samples = 0;    // Number of samples of all the blocks.
+  uint64 nnz = 0;            // Number of entries (including the bias).
+  int num_field = 0;         // Number of fields, only used by ffm.
+};
+
+// Read the sidecar of data_file. Return false if the sidecar does not
+// exist, or it is out of date.
+bool ReadMetadata(const std::string& data_file, DatasetMeta* meta);
+
+// Write the sidecar of data_file. Return false if we cannot create it.
+bool WriteMetadata(const std::string& data_file, const DatasetMeta& meta);
+
+} // namespace f2m
+
+#endif // F2M_READER_METADATA_H_
@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests metadata.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "src/base/file_util.h"
+#include "src/reader/metadata.h"
+
+using std::string;
+
+namespace f2m {
+
+const string kDataFile = "/tmp/test_metadata.txt";
+
+void WriteDataFile(const string& data) {
+  FILE* file = OpenFileOrDie(kDataFile.c_str(), "w");
+  WriteDataToDisk(file, data.c_str(), data.size());
+  Close(file);
+}
+
+TEST(METADATA_TEST, ReadAndWrite) {
+  WriteDataFile("2\n1 0\n3 0:1 \n4\n");
+  DatasetMeta meta;
+  EXPECT_FALSE(ReadMetadata(kDataFile, &meta));
+  meta.max_feature = 3;
+  meta.num_blocks = 1;
+  meta.num_samples = 2;
+  meta.nnz = 3;
+  meta.num_field = 5;
+  EXPECT_TRUE(WriteMetadata(kDataFile, meta));
+  DatasetMeta new_meta;
+  EXPECT_TRUE(ReadMetadata(kDataFile, &new_meta));
+  EXPECT_EQ(new_meta.max_feature, 3);
+  EXPECT_EQ(new_meta.num_blocks, 1);
+  EXPECT_EQ(new_meta.num_samples, 2);
+  EXPECT_EQ(new_meta.nnz, 3);
+  EXPECT_EQ(new_meta.num_field, 5);
+  // The sidecar is out of date once the data file changes.
+  WriteDataFile("2\n1 0\n3 0:1 1:1 \n4\n");
+  EXPECT_FALSE(ReadMetadata(kDataFile, &new_meta));
+  // Cannot write the sidecar.
+  EXPECT_FALSE(WriteMetadata("/not_exist_dir/data.txt", meta));
+  RemoveFile(kDataFile.c_str());
+  RemoveFile((kDataFile + kMetadataSuffix).c_str());
+}
+
+} // namespace f2m
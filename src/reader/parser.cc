@@ -23,10 +23,14 @@ This file is the implementation of Parser.
 #include "src/reader/parser.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <functional>
 
 #include "src/base/common.h"
 #include "src/base/split_string.h"
 #include "src/data/data_structure.h"
+#include "src/reader/tokenizer.h"
 
 namespace f2m {
 
@@ -35,24 +39,38 @@ namespace f2m {
 //------------------------------------------------------------------------------
 CLASS_REGISTER_IMPLEMENT_REGISTRY(f2m_parser_registry, Parser);
 REGISTER_PARSER("libsvm", LibsvmParser);
-//REGISTER_PARSER("libffm", FFMParser);
-//REGISTER_PARSER("csv", CSVParser);
+REGISTER_PARSER("libffm", FFMParser);
+REGISTER_PARSER("csv", CSVParser);
 
 //------------------------------------------------------------------------------
-// LibsvmParser parses the following data format:
-// [y1 idx:value idx:value ...]
-// [y2 idx:value idx:value ...]
+// The Parsers read the column-block text, in which each block looks like:
+//
+//   3                        <- number of lines in this block
+//   1 0 1                    <- Y of each sample, which is the bias column
+//   3 0:0.5 2:0.25           <- one line for each column
+//   ...
+//
+// and they are different only in the column lines (see parser.h).
 //------------------------------------------------------------------------------
 
-// This can only be used for in-memory trainning now.
-void LibsvmParser::Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length) {
+// Parse the column lines of the blocks in the list one by one. The
+// block-length line and the Y line are parsed here, and the Y line
+// becomes the bias column.
+static void ParseLines(
+    const StringList& list,
+    const std::string& splitor,
+    DMatrix& matrix,
+    std::vector<index_t>& sampled_length,
+    const std::function<void(const StringList& items, SparseRow* row)>&
+        parse_column) {
   CHECK_GE(list.size(), 0);
   CHECK_GE(matrix.row_len, 0);
   size_t row_len = matrix.row_len;
   index_t row_pos = 0;
+  StringList m_items;           // To store items divided by the splitor
   for (size_t i = 0; i < row_len; ++i, ++row_pos) {
     m_items.clear();
-    SplitStringUsing(list[i], m_splitor.c_str(), &m_items);
+    SplitStringUsing(list[i], splitor.c_str(), &m_items);
     int len = m_items.size();
     if (len == 1) {
       int row_length = atoi(m_items[0].c_str());
@@ -60,98 +78,315 @@ void LibsvmParser::Parse(const StringList& list, DMatrix& matrix, std::vector<in
       matrix.row_len--;
       ++i;
       m_items.clear();
-      SplitStringUsing(list[i], m_splitor.c_str(), &m_items);
+      SplitStringUsing(list[i], splitor.c_str(), &m_items);
       int len_ = m_items.size();
-      matrix.row[row_pos]->Resize(len_);
-      matrix.row[row_pos]->id = 0;
+      SparseRow* bias = matrix.row[row_pos];
+      bias->Resize(len_);
+      bias->id = 0;
       std::vector<real_t>* tmp_y = new std::vector<real_t>(len_, 0.0);
       for (int j = 0; j < len_; ++j) {
         (*tmp_y)[j] = atof(m_items[j].c_str());
-        matrix.row[row_pos]->idx[j] = j;
-        matrix.row[row_pos]->X[j] = 1.0; 
+        bias->idx[j] = j;
+        bias->X[j] = 1.0;
+        if (bias->if_has_field) {
+          bias->field[j] = 0;
+        }
       }
       matrix.Y.push_back(tmp_y);
       continue;
     }
     CHECK_NOTNULL(matrix.row[row_pos]);
-    matrix.row[row_pos]->Resize(--len);
-    // add bias term.
-    matrix.row[row_pos]->id = atoi(m_items[0].c_str());
-    for (int j = 0; j < len; ++j) {
-      m_single_item.clear();
-      SplitStringUsing(m_items[j + 1], ":", &m_single_item);
-      CHECK_EQ(m_single_item.size(), 2);
-      matrix.row[row_pos]->idx[j] = atoi(m_single_item[0].c_str());
-      matrix.row[row_pos]->X[j] = atof(m_single_item[1].c_str());
+    parse_column(m_items, matrix.row[row_pos]);
+  }
+}
+
+// Return the position of the '\n' at the end of current line,
+// or the end of the buffer.
+static inline const char* LineEnd(const char* p, const char* end) {
+  if (p >= end) {
+    return end;
+  }
+  size_t len = static_cast<size_t>(end - p);
+  const char* eol = reinterpret_cast<const char*>(memchr(p, '\n', len));
+  return eol == nullptr ? end : eol;
+}
+
+// Clear the arena, and parse the block-length line and the Y line of
+// the block [begin, end). Return the number of lines of the block, and
+// *eol is the end of the Y line.
+static int ParseHead(const Tokenizer& tokenizer,
+                     const char* begin,
+                     const char* end,
+                     const char** eol,
+                     ColumnArena* arena) {
+  CHECK_NOTNULL(begin);
+  CHECK_NOTNULL(arena);
+  CHECK_LT(begin, end);
+  *eol = LineEnd(begin, end);
+  int num_rows = TokenToInt(begin, *eol);
+  CHECK_GT(num_rows, 0);
+  arena->Y.clear();
+  arena->col_ids.clear();
+  arena->col_fields.clear();
+  arena->col_ptr.assign(1, 0);
+  arena->idx.clear();
+  arena->X.clear();
+  arena->weights.clear();
+  arena->ClearCodecs();
+  arena->col_ids.reserve(num_rows);
+  arena->col_ptr.reserve(num_rows + 1);
+  const char* p = *eol + 1;
+  if (p >= end) {
+    LOG(FATAL) << "Incomplete block: " << std::string(begin, *eol - begin);
+  }
+  *eol = LineEnd(p, end);
+  for (const char* t = tokenizer.NextToken(p, *eol); p != t;
+       p = t, t = tokenizer.NextToken(p, *eol)) {
+    arena->Y.push_back(DecodeReal(p, t));
+  }
+  return num_rows;
+}
+
+// Allocate the entries of the bias column and nnz more entries, and
+// fill the bias column. Return the position of the next entry.
+static size_t AddBiasColumn(size_t nnz, ColumnArena* arena) {
+  index_t num_y = arena->Y.size();
+  arena->idx.resize(num_y + nnz);
+  arena->X.resize(num_y + nnz);
+  index_t* idx = arena->idx.data();
+  real_t* X = arena->X.data();
+  arena->col_ids.push_back(0);
+  for (index_t j = 0; j < num_y; ++j) {
+    idx[j] = j;
+    X[j] = 1.0;
+  }
+  arena->col_ptr.push_back(num_y);
+  return num_y;
+}
+
+// Move to the i-th line of the block, which starts after *eol.
+static inline const char* NextLine(const char** eol,
+                                   const char* end,
+                                   int i,
+                                   int num_rows) {
+  const char* p = *eol + 1;
+  if (p >= end) {
+    LOG(FATAL) << "Incomplete block: expect " << num_rows
+               << " lines but get " << i;
+  }
+  *eol = LineEnd(p, end);
+  return p;
+}
+
+// Parse the sample_idx:value entries of a column line from p to the
+// idx and X at pos. Return the position after the last entry.
+static inline size_t ParseEntries(const Tokenizer& tokenizer,
+                                  const char* p,
+                                  const char* eol,
+                                  size_t pos,
+                                  index_t* idx,
+                                  real_t* X) {
+  for (const char* t = tokenizer.NextToken(p, eol); p != t;
+       p = t, t = tokenizer.NextToken(p, eol)) {
+    const char* colon =
+        reinterpret_cast<const char*>(memchr(p, ':', t - p));
+    if (colon == nullptr || memchr(colon + 1, ':', t - colon - 1)) {
+      LOG(FATAL) << "Invalid format of entry: " << std::string(p, t - p);
     }
+    idx[pos] = DecodeIndex(p, colon);
+    X[pos] = DecodeReal(colon + 1, t);
+    ++pos;
   }
+  return pos;
 }
-/*
+
 //------------------------------------------------------------------------------
-// FFMParser parses the following data format:
-// [y1 field:idx:value field:idx:value ...]
-// [y2 field:idx:value field:idx:value ...]
+// LibsvmParser parses the column lines like:
+// [id idx:value idx:value ...]
 //------------------------------------------------------------------------------
-void FFMParser::Parse(const StringList& list, DMatrix& matrix) {
-  CHECK_GE(list.size(), 0);
-  CHECK_GE(matrix.row_len, 0);
-  size_t row_len = matrix.row_len;
-  for (size_t i = 0; i < row_len; ++i) {
-    m_items.clear();
-    SplitStringUsing(list[i], m_splitor.c_str(), &m_items);
-    int len = m_items.size();
-    matrix.Y[i] = atof(m_items[0].c_str());
-    CHECK_NOTNULL(matrix.row[i]);
-    // add bias term
-    matrix.row[i]->Resize(len);
-    matrix.row[i]->field[0] = 0;
-    matrix.row[i]->idx[0] = 0;
-    matrix.row[i]->X[0] = 1.0;
-    for (int j = 1; j < len; ++j) {
+
+// This can only be used for in-memory trainning now.
+void LibsvmParser::Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length) {
+  StringList m_single_item;     // To store every single item divided by ':'
+  ParseLines(list, m_splitor, matrix, sampled_length,
+    [&](const StringList& m_items, SparseRow* row) {
+      int len = m_items.size() - 1;
+      row->Resize(len);
+      row->id = atoi(m_items[0].c_str());
+      for (int j = 0; j < len; ++j) {
+        m_single_item.clear();
+        SplitStringUsing(m_items[j + 1], ":", &m_single_item);
+        CHECK_EQ(m_single_item.size(), 2);
+        row->idx[j] = atoi(m_single_item[0].c_str());
+        row->X[j] = atof(m_single_item[1].c_str());
+      }
+    });
+}
+
+// Parse the block in place. The Tokenizer finds the splitors using SIMD,
+// and the numbers are decoded by DecodeIndex() and DecodeReal(), which
+// give the same result as atoi() and atof() used by Parse().
+void LibsvmParser::ParseBlock(const char* begin,
+                              const char* end,
+                              ColumnArena* arena) {
+  Tokenizer tokenizer(m_splitor);
+  const char* eol = nullptr;
+  int num_rows = ParseHead(tokenizer, begin, end, &eol, arena);
+  // Each entry of the columns has one ':'.
+  size_t nnz = CountChar(eol, end, ':');
+  size_t pos = AddBiasColumn(nnz, arena);
+  index_t* idx = arena->idx.data();
+  real_t* X = arena->X.data();
+  for (int i = 1; i < num_rows; ++i) {
+    const char* p = NextLine(&eol, end, i, num_rows);
+    const char* t = tokenizer.NextToken(p, eol);
+    arena->col_ids.push_back(DecodeIndex(p, t));
+    pos = ParseEntries(tokenizer, t, eol, pos, idx, X);
+    arena->col_ptr.push_back(pos);
+  }
+  CHECK_EQ(pos, arena->idx.size());
+  arena->UpdateView();
+}
+
+//------------------------------------------------------------------------------
+// FFMParser parses the column lines like:
+// [field:id idx:value idx:value ...]
+//------------------------------------------------------------------------------
+
+// Split the field:id token [p, t). Return the position of the ':'.
+static inline const char* FieldColon(const char* p, const char* t) {
+  const char* colon = reinterpret_cast<const char*>(memchr(p, ':', t - p));
+  if (colon == nullptr || memchr(colon + 1, ':', t - colon - 1)) {
+    LOG(FATAL) << "Invalid format of column: " << std::string(p, t - p);
+  }
+  return colon;
+}
+
+// The field of a column is given to each of its entries.
+void FFMParser::Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length) {
+  StringList m_single_item;     // To store every single item divided by ':'
+  ParseLines(list, m_splitor, matrix, sampled_length,
+    [&](const StringList& m_items, SparseRow* row) {
+      int len = m_items.size() - 1;
+      row->Resize(len);
       m_single_item.clear();
-      SplitStringUsing(m_items[j], ":", &m_single_item);
-      CHECK_EQ(m_single_item.size(), 3);
-      matrix.row[i]->field[j] = atoi(m_single_item[0].c_str());
-      matrix.row[i]->idx[j] = atoi(m_single_item[1].c_str());
-      matrix.row[i]->X[j] = atof(m_single_item[2].c_str());
-    }
+      SplitStringUsing(m_items[0], ":", &m_single_item);
+      CHECK_EQ(m_single_item.size(), 2);
+      index_t field = atoi(m_single_item[0].c_str());
+      row->id = atoi(m_single_item[1].c_str());
+      for (int j = 0; j < len; ++j) {
+        m_single_item.clear();
+        SplitStringUsing(m_items[j + 1], ":", &m_single_item);
+        CHECK_EQ(m_single_item.size(), 2);
+        row->idx[j] = atoi(m_single_item[0].c_str());
+        row->X[j] = atof(m_single_item[1].c_str());
+        if (row->if_has_field) {
+          row->field[j] = field;
+        }
+      }
+    });
+}
+
+void FFMParser::ParseBlock(const char* begin,
+                           const char* end,
+                           ColumnArena* arena) {
+  Tokenizer tokenizer(m_splitor);
+  const char* eol = nullptr;
+  int num_rows = ParseHead(tokenizer, begin, end, &eol, arena);
+  // Each entry has one ':', and so does each field:id.
+  size_t nnz = CountChar(eol, end, ':') - (num_rows - 1);
+  size_t pos = AddBiasColumn(nnz, arena);
+  index_t* idx = arena->idx.data();
+  real_t* X = arena->X.data();
+  arena->col_fields.reserve(num_rows);
+  arena->col_fields.push_back(0);
+  for (int i = 1; i < num_rows; ++i) {
+    const char* p = NextLine(&eol, end, i, num_rows);
+    const char* t = tokenizer.NextToken(p, eol);
+    const char* colon = FieldColon(p, t);
+    arena->col_fields.push_back(DecodeIndex(p, colon));
+    arena->col_ids.push_back(DecodeIndex(colon + 1, t));
+    pos = ParseEntries(tokenizer, t, eol, pos, idx, X);
+    arena->col_ptr.push_back(pos);
   }
+  CHECK_EQ(pos, arena->idx.size());
+  arena->UpdateView();
 }
 
 //------------------------------------------------------------------------------
-// CSVParser parses the following data format:
-// [y1 value value value ...]
-// [y2 value value value ...]
+// CSVParser parses the dense column lines like:
+// [id value value value ...]
+// which give one value for each sample, and the zero values are dropped.
 //------------------------------------------------------------------------------
-void CSVParser::Parse(const StringList& list, DMatrix& matrix) {
-  CHECK_GE(list.size(), 0);
-  CHECK_GE(matrix.row_len, 0);
-  size_t row_len = matrix.row_len;
-  for (size_t i = 0; i < row_len; ++i) {
-    m_items.clear();
-    SplitStringUsing(list[i], m_splitor.c_str(), &m_items);
-    matrix.Y[i] = atof(m_items[0].c_str());
-    // Get real length of current row
-    int len = 0;
-    for (int j = 1; j < m_items.size(); ++j) {
-      if (atof(m_items[j].c_str()) != 0) {
-        ++len;
+void CSVParser::Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length) {
+  ParseLines(list, m_splitor, matrix, sampled_length,
+    [&](const StringList& m_items, SparseRow* row) {
+      // Get real length of current column
+      int len = 0;
+      for (size_t j = 1; j < m_items.size(); ++j) {
+        if (atof(m_items[j].c_str()) != 0) {
+          ++len;
+        }
       }
-    }
-    CHECK_NOTNULL(matrix.row[i]);
-    matrix.row[i]->Resize(len+1); // add a bias
-    matrix.row[i]->idx[0] = 0;
-    matrix.row[i]->X[0] = 1.0;
-    int k = 1;
-    for (int j = 1; j < m_items.size(); ++j) {
-      real_t value = atof(m_items[j].c_str());
+      row->Resize(len);
+      row->id = atoi(m_items[0].c_str());
+      int k = 0;
+      for (size_t j = 1; j < m_items.size(); ++j) {
+        real_t value = atof(m_items[j].c_str());
+        if (value != 0) {
+          row->idx[k] = j - 1;
+          row->X[k] = value;
+          ++k;
+        }
+      }
+    });
+}
+
+// The columns are dense, so the block has at most num_y entries for
+// each column. We allocate them once, and release the space of the zero
+// values at the end, since the Dataset keeps the arena of each block.
+// This copies the nonzeros once, which is cheaper than decoding all the
+// values twice to count them.
+void CSVParser::ParseBlock(const char* begin,
+                           const char* end,
+                           ColumnArena* arena) {
+  Tokenizer tokenizer(m_splitor);
+  const char* eol = nullptr;
+  int num_rows = ParseHead(tokenizer, begin, end, &eol, arena);
+  index_t num_y = arena->Y.size();
+  size_t pos = AddBiasColumn(static_cast<size_t>(num_y) * (num_rows - 1),
+                             arena);
+  index_t* idx = arena->idx.data();
+  real_t* X = arena->X.data();
+  for (int i = 1; i < num_rows; ++i) {
+    const char* p = NextLine(&eol, end, i, num_rows);
+    const char* t = tokenizer.NextToken(p, eol);
+    arena->col_ids.push_back(DecodeIndex(p, t));
+    index_t sample = 0;
+    for (p = t, t = tokenizer.NextToken(p, eol); p != t;
+         p = t, t = tokenizer.NextToken(p, eol), ++sample) {
+      if (sample >= num_y) {
+        LOG(FATAL) << "Too many values in column " << arena->col_ids.back()
+                   << ": expect " << num_y;
+      }
+      real_t value = DecodeReal(p, t);
       if (value != 0) {
-        matrix.row[i]->idx[k] = j;
-        matrix.row[i]->X[k] = value;
-        ++k;
+        idx[pos] = sample;
+        X[pos] = value;
+        ++pos;
       }
     }
+    if (sample != num_y) {
+      LOG(FATAL) << "Too few values in column " << arena->col_ids.back()
+                 << ": expect " << num_y << " but get " << sample;
+    }
+    arena->col_ptr.push_back(pos);
   }
-}*/
+  arena->idx.resize(pos);
+  arena->X.resize(pos);
+  arena->idx.shrink_to_fit();
+  arena->X.shrink_to_fit();
+  arena->UpdateView();
+}
 
 } // namespace f2m
@@ -41,6 +41,8 @@ typedef std::vector<std::string> StringList;
 // such as the LibsvmParser and the FFMParser.
 // Note that the Parser will add a bias (i.e., 1.0) term in the front of the
 // input data (in each line) by default.
+// One Parser is shared by all the Readers, which may parse data in their
+// own threads, so Parse() must not change the state of the Parser.
 //------------------------------------------------------------------------------
 class Parser {
  public:
@@ -53,10 +55,15 @@ class Parser {
 
   virtual void Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length) = 0;
 
+  // Parse one column block [begin, end), which starts at the
+  // block-length line and ends after the last column line, to the
+  // ColumnArena. Different blocks can be parsed in different threads.
+  virtual void ParseBlock(const char* begin,
+                          const char* end,
+                          ColumnArena* arena) = 0;
+
  protected:
   std::string m_splitor = " ";  // Identify the spliting character
-  StringList m_items;           // To store items divided by the splitor
-  StringList m_single_item;     // To store every single item divided by ':'
 
  private:
 
@@ -64,9 +71,9 @@ class Parser {
 };
 
 //------------------------------------------------------------------------------
-// LibsvmParser parses the following data format:
-// [y1 idx:value idx:value ...]
-// [y2 idx:value idx:value ...]
+// LibsvmParser parses the column blocks converted from the libsvm data,
+// whose column lines are like:
+// [id idx:value idx:value ...]
 //------------------------------------------------------------------------------
 class LibsvmParser : public Parser {
  public:
@@ -75,22 +82,32 @@ class LibsvmParser : public Parser {
 
   virtual void Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length);
 
+  virtual void ParseBlock(const char* begin,
+                          const char* end,
+                          ColumnArena* arena);
+
  private:
 
   DISALLOW_COPY_AND_ASSIGN(LibsvmParser);
 };
 
 //------------------------------------------------------------------------------
-// FFMParser parses the following data format:
-// [y1 field:idx:value field:idx:value ...]
-// [y2 field:idx:value field:idx:value ...]
+// FFMParser parses the column blocks converted from the libffm data,
+// whose column lines give the field of each column:
+// [field:id idx:value idx:value ...]
+// The fields are stored in col_fields of the ColumnArena, and the bias
+// column is in the field 0.
 //------------------------------------------------------------------------------
-/*class FFMParser : public Parser {
+class FFMParser : public Parser {
  public:
   FFMParser() {  }
   ~FFMParser() {  }
 
-  virtual void Parse(const StringList& list, DMatrix& matrix);
+  virtual void Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length);
+
+  virtual void ParseBlock(const char* begin,
+                          const char* end,
+                          ColumnArena* arena);
 
  private:
 
@@ -98,22 +115,28 @@ class LibsvmParser : public Parser {
 };
 
 //------------------------------------------------------------------------------
-// CSVParser parses the following data format:
-// [y1 value value value ...]
-// [y2 value value value ...]
+// CSVParser parses the column blocks converted from the csv data, whose
+// column lines are dense and give the value of each sample in order:
+// [id value value value ...]
+// The zero values are dropped, so the parsed block is the same as what
+// LibsvmParser gives for the same data.
 //------------------------------------------------------------------------------
 class CSVParser : public Parser {
  public:
-  CSVParser() { }
-  ~CSVParser() { }
+  CSVParser() {  }
+  ~CSVParser() {  }
 
-  virtual void Parse(const StringList& list, DMatrix& matrix);
+  virtual void Parse(const StringList& list, DMatrix& matrix, std::vector<index_t>& sampled_length);
+
+  virtual void ParseBlock(const char* begin,
+                          const char* end,
+                          ColumnArena* arena);
 
  private:
 
   DISALLOW_COPY_AND_ASSIGN(CSVParser);
 };
-*/
+
 //------------------------------------------------------------------------------
 // Class register
 //------------------------------------------------------------------------------
@@ -24,15 +24,22 @@ This file is the implementation of Reader.
 
 #include <vector>
 #include <string>
-#include <algorithm> // for random_shuffle
+#include <algorithm> // for shuffle
+#include <atomic>
+#include <functional>
 
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
 
 #include "src/base/common.h"
 #include "src/base/file_util.h"
 #include "src/base/scoped_ptr.h"
+#include "src/base/stringprintf.h"
+#include "src/reader/binary_format.h"
 
-static const uint32 kMaxLineSize = 100 * 1024; // 100 KB for one line of data
 
 namespace f2m {
 
@@ -41,20 +48,107 @@ namespace f2m {
 //------------------------------------------------------------------------------
 CLASS_REGISTER_IMPLEMENT_REGISTRY(f2m_reader_registry, Reader);
 REGISTER_READER("memory", InmemReader);
-//REGISTER_READER("disk", OndiskReader);
+REGISTER_READER("mmap", MmapReader);
+REGISTER_READER("disk", OndiskReader);
+REGISTER_READER("async", AsyncReader);
 
 //------------------------------------------------------------------------------
-// Implementation of InmemReader
+// Binary cache
 //------------------------------------------------------------------------------
 
-InmemReader::~InmemReader() {
-  if (file_ptr_ != nullptr) {
-    Close(file_ptr_);
+// Parse the text file window by window, and write each block to the
+// binary file. Return false if we cannot create the file.
+static bool ConvertToBinary(const std::string& text_file,
+                            const std::string& binary_file,
+                            Parser* parser,
+                            int num_threads) {
+  BinaryWriter writer;
+  if (!writer.Open(binary_file)) {
+    return false;
+  }
+  writer.SetSource(text_file);
+  Dataset::ScanText(text_file, parser, num_threads,
+                    [&writer](const ColumnBlock& block) {
+                      writer.WriteBlock(block);
+                    });
+  writer.Close();
+  LOG(INFO) << "Write binary cache: " << binary_file;
+  return true;
+}
+
+// The binary files of the shared datasets are kept in the POSIX shared
+// memory, which is a tmpfs on Linux.
+static const char kSharedMemoryDir[] = "/dev/shm/";
+
+// Return the file of the shard in the shared dataset, e.g.,
+// "/dev/shm/f2m.ctr.train.txt.3f2a9c0e1b7d5a64". The hash of the full
+// path tells apart the shards of the same name in different directories.
+static std::string SharedFileOf(const std::string& name,
+                                const std::string& shard) {
+  std::string full_path = shard;
+  char* path = realpath(shard.c_str(), nullptr);
+  if (path != nullptr) {
+    full_path = path;
+    free(path);
+  }
+  std::string base_name = full_path.substr(full_path.rfind('/') + 1);
+  return StringPrintf("%sf2m.%s.%s.%zx", kSharedMemoryDir, name.c_str(),
+                      base_name.c_str(), std::hash<std::string>()(full_path));
+}
+
+// Return the binary file of the shard, which is the shard itself, its
+// binary cache, or its file in the shared dataset of shared_name. If we
+// cannot write the binary file, we use a temp file, and *is_tmp_file is
+// set to true. The temp file should be removed as soon as it is opened.
+static std::string BinaryFileOf(const std::string& shard,
+                                const std::string& shared_name,
+                                Parser* parser,
+                                int num_threads,
+                                bool* is_tmp_file) {
+  static std::atomic<int> num_tmp_files(0);
+  *is_tmp_file = false;
+  if (IsBinaryFile(shard)) {
+    return shard;
+  }
+  std::string binary_file = shared_name.empty()
+                            ? shard + kBinaryCacheSuffix
+                            : SharedFileOf(shared_name, shard);
+  const char* reuse_message = shared_name.empty() ? "Reuse binary cache: "
+                                                  : "Attach shared dataset: ";
+  if (IsValidBinaryCache(binary_file, shard)) {
+    LOG(INFO) << reuse_message << binary_file;
+    return binary_file;
+  }
+  // Many processes (e.g., the jobs of one shared dataset) may start at
+  // the same time. The first one converts the shard while holding the
+  // lock of the shard, and the others wait and then reuse its result.
+  int lock = open(shard.c_str(), O_RDONLY);
+  if (lock != -1 && flock(lock, LOCK_EX) != 0) {
+    close(lock);
+    lock = -1;
   }
-  data_buf_.Release();
+  if (IsValidBinaryCache(binary_file, shard)) {
+    LOG(INFO) << reuse_message << binary_file;
+  } else if (!ConvertToBinary(shard, binary_file, parser, num_threads)) {
+    LOG(WARNING) << "Cannot create binary file: " << binary_file;
+    binary_file = StringPrintf("/tmp/f2m_cache_%d_%d_%zx", getpid(),
+                               num_tmp_files++,
+                               std::hash<std::string>()(shard));
+    CHECK(ConvertToBinary(shard, binary_file, parser, num_threads));
+    *is_tmp_file = true;
+  }
+  if (lock != -1) {
+    close(lock);
+  }
+  return binary_file;
 }
 
-// Pre-load all the data into memory buffer.
+//------------------------------------------------------------------------------
+// Implementation of InmemReader
+//------------------------------------------------------------------------------
+
+// Acquire the Dataset of the file, which is loaded by the first Reader
+// and shared by the others.
 void InmemReader::Initialize(const std::string& filename,
                              int num_samples,
                              Parser* parser,
@@ -65,122 +159,205 @@ void InmemReader::Initialize(const std::string& filename,
   filename_ = filename;
   num_samples_ = num_samples;
   parser_ = parser;
-  pos_ = 0;
-  file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
-  uint64 file_size = GetFileSize(file_ptr_);
-  scoped_array<char> buffer;
-  try {
-    buffer.reset(new char[file_size]);
-  } catch (std::bad_alloc&) {
-    LOG(FATAL) << "Cannot allocate enough memory for Reader.";
-  }
-  // Read all the data from file
-  uint64 read_size = fread(buffer.get(),
-                           1,
-                           file_size,
-                           file_ptr_);
-  CHECK_EQ(read_size, file_size);
-  // Initialize the DMatrix buffer
-  int num_lines = GetLineNumber(buffer.get(), read_size);
-  bool if_has_field = type == FFM ? true : false;
-  // Parse each line of data from buffer
-  StringList list(num_lines);
-  scoped_array<char> line(new char[kMaxLineSize]);
-  uint64 start_pos = 0;
-  for (int i = 0; i < num_lines; ++i) {
-    uint32 line_size = ReadLineFromMemory(line.get(),
-                                          buffer.get(),
-                                          start_pos,
-                                          file_size);
-    CHECK_NE(line_size, 0);
-    start_pos += line_size;
-    line[line_size - 1] = '\0';
-    if (line_size > 1 && line[line_size - 2] == '\r') {
-      // Handle some txt format in windows or DOS.
-      line[line_size - 2] = '\0';
-    }
-    list[i].assign(line.get());
-  }
-  // Parse StringList to DMatrix.
-  --num_lines;
-  int max_lines = atoi(list[num_lines].c_str());
-  data_samples_.Resize(max_lines);
-  data_samples_.Y.resize(1, NULL);
-  data_buf_.Resize(num_lines);
-  data_buf_.InitSparseRow(if_has_field);
-  sampled_length.clear();
-  parser_->Parse(list, data_buf_, sampled_length);
-}
-
-uint32 InmemReader::ReadLineFromMemory(char* line,
-                                       char* buf,
-                                       uint64 start_pos,
-                                       uint64 total_len) {
-  // End of file
-  if (start_pos >= total_len) {
-    return 0;
+  file_ptr_ = nullptr;
+  cursor_.reset();
+  dataset_.reset();
+  num_epochs_ = 0;
+  end_of_data_ = false;
+  // The downsampled or encoded blocks of the range are derived from
+  // the shared Dataset, and also shared by the Readers of the same
+  // range and settings, e.g., the Readers of the same fold.
+  own_blocks_ = negative_rate_ < 1 || compress_columns_;
+  if (own_blocks_) {
+    dataset_ = AcquireDataset(DerivedKey(),
+                              std::bind(&InmemReader::LoadDerived, this));
+  } else {
+    dataset_ = AcquireDataset(DatasetKey(),
+                              std::bind(&InmemReader::LoadDataset, this));
   }
-  uint64 end_pos = start_pos;
-  while (*(buf + end_pos) != '\n') { ++end_pos; }
-  uint32 read_size = end_pos - start_pos + 1;
-  if (read_size > kMaxLineSize) {
-    LOG(FATAL) << "Encountered a too-long line. Please check the data.";
+  rng_.seed(seed_);
+  cursor_.reset(NewCursor());
+  if (shuffle_) {
+    cursor_->Shuffle(&rng_);
   }
-  memcpy(line, buf + start_pos, read_size);
-  return read_size;
+  resizer_.Reset();
+  data_samples_.Resize(0);
 }
 
-int InmemReader::GetLineNumber(const char* buf, uint64 buf_size) {
-  int num = 0;
-  for (uint64 i = 0; i < buf_size; ++i) {
-    if (buf[i] == '\n') num++;
+// The shards of the data path are loaded in parallel.
+Dataset* InmemReader::LoadDataset() {
+  using namespace std::placeholders;
+  return Dataset::LoadShards(ListShards(filename_), num_threads_,
+                             std::bind(&InmemReader::LoadShard, this, _1, _2));
+}
+
+// The key has the block range and all the settings of the derived
+// blocks, so the Readers of the same key get the same blocks.
+std::string InmemReader::DerivedKey() const {
+  return StringPrintf("%s:%zu-%zu:%g:%llu:%d", DatasetKey().c_str(),
+                      begin_block_, end_block_, negative_rate_,
+                      static_cast<unsigned long long>(seed_),
+                      compress_columns_);
+}
+
+// The source Dataset is acquired from the registry, so it is parsed
+// only if no other Reader is using it, and it is released after the
+// blocks are derived if no other Reader is using it. The downsampling
+// has its own rng seeded by seed_, so the kept samples and the
+// shuffling orders do not depend on which Reader derives the blocks.
+Dataset* InmemReader::LoadDerived() {
+  std::shared_ptr<const Dataset> source =
+      AcquireDataset(DatasetKey(), std::bind(&InmemReader::LoadDataset, this));
+  size_t begin = begin_block_, end = end_block_;
+  scoped_ptr<Dataset> derived;
+  if (negative_rate_ < 1) {
+    std::mt19937_64 rng(seed_);
+    derived.reset(Dataset::Downsample(*source, begin, end, negative_rate_,
+                                      &rng, num_threads_));
+    begin = 0;
+    end = derived->NumBlocks();
+  }
+  if (compress_columns_) {
+    const Dataset& plain = derived.get() != nullptr ? *derived : *source;
+    derived.reset(Dataset::Compress(plain, begin, end, num_threads_));
   }
-  return num;
+  return derived.release();
+}
+
+Dataset* InmemReader::LoadShard(const std::string& shard, int num_threads) {
+  Dataset* dataset = new Dataset;
+  dataset->LoadText(shard, parser_, num_threads);
+  return dataset;
 }
 
 // Smaple data from memory buffer.
 int InmemReader::Samples(DMatrix* &matrix) {
-  static int now_block = 0;
-  int num_lines = sampled_length[now_block];
-  if (pos_ == data_buf_.row_len) {
-    now_block = 0;
-    matrix = NULL;
-    return 0;
+  const ColumnBlock* block = nullptr;
+  if (block_size_ > 0) {
+    block = resizer_.Next([this]() { return cursor_->Next(); });
+  } else {
+    block = cursor_->Next();
   }
-  data_samples_.Y[0] = data_buf_.Y[now_block];
-  for (int i = 0; i < num_lines; ++i) {
-    // Copy data between different DMatrix.
-    data_samples_.row[i] = data_buf_.row[pos_];
-    pos_++;
+  if (block == nullptr) {
+    end_of_data_ = true;
+    matrix = nullptr;
+    return 0;
   }
-  now_block++;
-  data_samples_.Setlength(num_lines);
+  data_samples_.SetBlock(block, &labels_);
   matrix = &data_samples_;
-  return num_lines;
+  return block->num_columns;
+}
+
+// Return to the begining of the data buffer, in a new order of the
+// blocks if shuffle_ is set. Only the epochs that reach the end of the
+// data are counted for the reblocking.
+void InmemReader::GoToHead() {
+  if (end_of_data_ && reblock_epochs_ > 0 &&
+      ++num_epochs_ % reblock_epochs_ == 0) {
+    Reblock();
+  }
+  end_of_data_ = false;
+  resizer_.Reset();
+  if (shuffle_) {
+    cursor_->Shuffle(&rng_);
+  } else {
+    cursor_->Reset();
+  }
 }
 
-// Return to the begining of the data buffer.
-void InmemReader::GoToHead() { pos_ = 0; }
+BlockCursor* InmemReader::NewCursor() {
+  CHECK_NOTNULL(dataset_.get());
+  // The reblocked (or downsampled) Dataset only has the blocks of the
+  // range.
+  if (own_blocks_) {
+    return new BlockCursor(dataset_, 0, kMaxBlocks);
+  }
+  return new BlockCursor(dataset_, begin_block_, end_block_);
+}
+
+// The cursor holds the old Dataset, which is released (if no other
+// Reader is using it) after the cursor is replaced.
+void InmemReader::Reblock() {
+  size_t begin = begin_block_, end = end_block_;
+  if (own_blocks_) {
+    begin = 0;
+    end = dataset_->NumBlocks();
+  }
+  dataset_.reset(Dataset::Reblock(*dataset_, begin, end,
+                                  &rng_, num_threads_));
+  own_blocks_ = true;
+  if (compress_columns_) {
+    dataset_.reset(Dataset::Compress(*dataset_, 0, dataset_->NumBlocks(),
+                                     num_threads_));
+  }
+  cursor_.reset(NewCursor());
+}
+
+//------------------------------------------------------------------------------
+// Implementation of MmapReader.
+//------------------------------------------------------------------------------
 
-// Using Min-max normalization
-void InmemReader::Normalize(real_t max, real_t min) {
-  for (size_t i = 0; i < data_buf_.row_len; ++i) {
-    SparseRow* row = data_buf_.row[i];
-    for (size_t j = 0; j < row->column_len; ++j) {
-      row->X[j] = (row->X[j] - min) / (max - min);
+// Map the binary file, or the binary cache of the text file.
+Dataset* MmapReader::LoadShard(const std::string& shard, int num_threads) {
+  bool is_tmp_file = false;
+  std::string binary_file = BinaryFileOf(shard, shared_name_, parser_,
+                                         num_threads, &is_tmp_file);
+  Dataset* dataset = new Dataset;
+  if (!dataset->LoadBinary(binary_file)) {
+    if (binary_file == shard || is_tmp_file) {
+      LOG(FATAL) << "Cannot open binary file: " << binary_file;
     }
+    // The cache passed the check of its header but is truncated or
+    // corrupt, so we convert the shard again.
+    LOG(WARNING) << "Rebuild invalid binary cache: " << binary_file;
+    RemoveFile(binary_file.c_str());
+    binary_file = BinaryFileOf(shard, shared_name_, parser_,
+                               num_threads, &is_tmp_file);
+    if (!dataset->LoadBinary(binary_file)) {
+      LOG(FATAL) << "Cannot open binary file: " << binary_file;
+    }
+  }
+  if (is_tmp_file) {
+    RemoveFile(binary_file.c_str());
   }
+  return dataset;
 }
 
 //------------------------------------------------------------------------------
 // Implementation of OndiskReader.
 //------------------------------------------------------------------------------
 
-/*OndiskReader::~OndiskReader() {
-  if (file_ptr_ != nullptr) {
-    Close(file_ptr_);
+OndiskReader::OndiskReader()
+  : next_buffer_(0),
+    used_buffer_(-1),
+    generation_(0),
+    stop_(false),
+    shard_(0),
+    now_block_(0),
+    shard_block_(0),
+    head_shard_(0),
+    head_offset_(0),
+    head_block_(0),
+    head_shard_block_(0) {
+  file_ptr_ = nullptr;
+  num_rows_[0] = num_rows_[1] = 0;
+  ready_[0] = ready_[1] = false;
+}
+
+OndiskReader::~OndiskReader() {
+  Stop();
+}
+
+void OndiskReader::Stop() {
+  if (thread_.joinable()) {
+    {
+      MutexLocker locker(&mutex_);
+      stop_ = true;
+      cond_.Broadcast();
+    }
+    thread_.join();
   }
-  data_samples_.Release();
+  lines_.reset();
 }
 
 void OndiskReader::Initialize(const std::string& filename,
@@ -190,52 +367,444 @@ void OndiskReader::Initialize(const std::string& filename,
   CHECK_NE(filename.empty(), true);
   CHECK_GT(num_samples, 0);
   CHECK_NOTNULL(parser);
+  // The reader can be initialized again by another file.
+  Stop();
   filename_ = filename;
   num_samples_ = num_samples;
   parser_ = parser;
-  file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
-  bool if_has_field = type == FFM ? true : false;
-  data_samples_.Resize(num_samples);
-  data_samples_.InitSparseRow(if_has_field);
+  shards_ = ListShards(filename_);
+  OpenShard(0);
+  stop_ = false;
+  generation_ = 0;
+  next_buffer_ = 0;
+  used_buffer_ = -1;
+  ready_[0] = ready_[1] = false;
+  now_block_ = 0;
+  shard_block_ = 0;
+  head_shard_ = 0;
+  head_offset_ = 0;
+  head_block_ = 0;
+  head_shard_block_ = 0;
+  resizer_.Reset();
+  data_samples_.Resize(0);
+  thread_ = std::thread(&OndiskReader::ReadThread, this);
 }
 
-// Sample data from disk file.
-int OndiskReader::Samples(DMatrix* &matrix) {
-  static scoped_array<char> line(new char[kMaxLineSize]);
-  static StringList list(num_samples_);
-  int num_lines = 0;
-  for (int i = 0; i < num_samples_; ++i) {
-    if (fgets(line.get(), kMaxLineSize, file_ptr_) == nullptr) {
-      // Either ferror or feof.
-      if (i == 0) {
-        matrix = nullptr;
-        return 0;
+void OndiskReader::OpenShard(size_t shard) {
+  lines_.reset(new LineReader(OpenInputStream(shards_[shard])));
+  shard_ = shard;
+}
+
+// Each block starts with a line of its length, and each shard ends
+// with a line of the max feature length, after which we go to the
+// next shard.
+bool OndiskReader::ReadBlockHead() {
+  text_.clear();
+  while (!lines_->AppendLine(&text_) || !lines_->AppendLine(&text_)) {
+    if (shard_ + 1 >= shards_.size()) {
+      return false;
+    }
+    OpenShard(shard_ + 1);
+    shard_block_ = now_block_;
+    text_.clear();
+  }
+  return true;
+}
+
+bool OndiskReader::SkipBlock() {
+  if (!ReadBlockHead()) {
+    return false;
+  }
+  int num_lines = atoi(text_.c_str());
+  for (int i = 2; i <= num_lines; ++i) {
+    if (!lines_->AppendLine(&text_)) {
+      LOG(FATAL) << "Incomplete block in file: " << shards_[shard_];
+    }
+  }
+  return true;
+}
+
+int OndiskReader::ReadBlock(ColumnArena* arena) {
+  // Skip the blocks before the block range, and remember where the
+  // range starts, so GoToHead() does not skip them again.
+  while (now_block_ < begin_block_) {
+    if (!SkipBlock()) {
+      return 0;
+    }
+    if (++now_block_ == begin_block_) {
+      head_shard_ = shard_;
+      head_offset_ = lines_->Tell();
+      head_block_ = now_block_;
+      head_shard_block_ = shard_block_;
+    }
+  }
+  if (now_block_ >= end_block_ || !ReadBlockHead()) {
+    return 0;
+  }
+  int num_lines = atoi(text_.c_str());
+  CHECK_GT(num_lines, 0);
+  for (int i = 2; i <= num_lines; ++i) {
+    if (!lines_->AppendLine(&text_)) {
+      LOG(FATAL) << "Incomplete block in file: " << shards_[shard_];
+    }
+  }
+  // The block is parsed in place, as Dataset::ParseBlocks() does.
+  parser_->ParseBlock(text_.data(), text_.data() + text_.size(), arena);
+  ++now_block_;
+  return arena->block.num_columns;
+}
+
+// The background thread fills the two buffers in turn. It waits when
+// both buffers are full, and waits for GoToHead() at the end of file.
+void OndiskReader::ReadThread() {
+  int buffer = 0;
+  uint64 generation = 0;
+  bool end_of_file = false;
+  for (;;) {
+    {
+      MutexLocker locker(&mutex_);
+      while (!stop_ && generation == generation_ &&
+             (ready_[buffer] || end_of_file)) {
+        cond_.Wait(&mutex_);
+      }
+      if (stop_) {
+        return;
+      }
+      if (generation != generation_) {
+        generation = generation_;
+        buffer = 0;
+        end_of_file = false;
+        // A compressed shard cannot seek, and we skip its blocks again.
+        if (shard_ != head_shard_) {
+          OpenShard(head_shard_);
+        }
+        shard_block_ = head_shard_block_;
+        if (lines_->Seek(head_offset_)) {
+          now_block_ = head_block_;
+        } else {
+          lines_->Rewind();
+          now_block_ = head_shard_block_;
+        }
       }
-      break;
     }
-    int read_len = strlen(line.get());
-    if (line[read_len - 1] != '\n') {
-      LOG(FATAL) << "Encountered a too-long line. Please check the data.";
-    } else {
-      line[read_len - 1] = '\0';
-      // Handle the txt format in DOS and windows.
-      if (read_len > 1 && line[read_len - 2] == '\r') {
-        line[read_len - 2] = '\0';
+    int num_rows = ReadBlock(&arena_[buffer]);
+    {
+      MutexLocker locker(&mutex_);
+      // GoToHead() has been invoked during the parsing.
+      if (generation != generation_) {
+        continue;
       }
+      num_rows_[buffer] = num_rows;
+      ready_[buffer] = true;
+      cond_.Broadcast();
+    }
+    if (num_rows == 0) {
+      end_of_file = true;
+    } else {
+      buffer ^= 1;
     }
-    list[i].assign(line.get());
-    num_lines++;
   }
-  // The last data block
-  if (num_lines != num_samples_) {
-    data_samples_.Setlength(num_lines);
+}
+
+const ColumnBlock* OndiskReader::NextBuffer() {
+  MutexLocker locker(&mutex_);
+  // The caller has finished the last block.
+  if (used_buffer_ != -1) {
+    ready_[used_buffer_] = false;
+    used_buffer_ = -1;
+    cond_.Broadcast();
   }
-  parser_->Parse(list, data_samples_);
+  while (!ready_[next_buffer_]) {
+    cond_.Wait(&mutex_);
+  }
+  if (num_rows_[next_buffer_] == 0) {
+    return nullptr;
+  }
+  used_buffer_ = next_buffer_;
+  next_buffer_ ^= 1;
+  return &arena_[used_buffer_].block;
+}
+
+// Sample data from disk file. The blocks (or the resized blocks) are
+// returned by the view of data_samples_.
+int OndiskReader::Samples(DMatrix* &matrix) {
+  const ColumnBlock* block = nullptr;
+  if (block_size_ > 0) {
+    block = resizer_.Next([this]() { return NextBuffer(); });
+  } else {
+    block = NextBuffer();
+  }
+  if (block == nullptr) {
+    matrix = nullptr;
+    return 0;
+  }
+  data_samples_.SetBlock(block, &labels_);
   matrix = &data_samples_;
-  return num_lines;
+  return block->num_columns;
 }
 
 // Return to the begining of the file.
-void OndiskReader::GoToHead() { fseek(file_ptr_, 0, SEEK_SET); }
-*/
+void OndiskReader::GoToHead() {
+  resizer_.Reset();
+  MutexLocker locker(&mutex_);
+  ++generation_;
+  ready_[0] = ready_[1] = false;
+  next_buffer_ = 0;
+  used_buffer_ = -1;
+  cond_.Broadcast();
+}
+
+//------------------------------------------------------------------------------
+// Implementation of AsyncReader.
+//------------------------------------------------------------------------------
+
+// The slot is not used by any block.
+static const size_t kNoBlock = static_cast<size_t>(-1);
+
+AsyncReader::AsyncReader()
+  : use_async_io_(true),
+    now_block_(0),
+    next_read_(0),
+    used_slot_(-1) {
+  file_ptr_ = nullptr;
+}
+
+AsyncReader::~AsyncReader() {
+  Close();
+}
+
+void AsyncReader::Close() {
+  while (io_.NumPending() > 0) {
+    WaitOne();
+  }
+  for (size_t i = 0; i < fds_.size(); ++i) {
+    close(fds_[i]);
+  }
+  fds_.clear();
+  is_direct_.clear();
+  blocks_.clear();
+  order_.clear();
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    free(buffers_[i]);
+  }
+  buffers_.clear();
+  capacity_.clear();
+  slot_block_.clear();
+  ready_.clear();
+  used_slot_ = -1;
+  cache_.Clear();
+}
+
+// Open the binary file of each shard, and read its offset table.
+void AsyncReader::Initialize(const std::string& filename,
+                             int num_samples,
+                             Parser* parser,
+                             ModelType type) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_GT(num_samples, 0);
+  CHECK_NOTNULL(parser);
+  // The reader can be initialized again by another file.
+  Close();
+  filename_ = filename;
+  num_samples_ = num_samples;
+  parser_ = parser;
+  std::vector<std::string> shards = ListShards(filename_);
+  std::vector<uint64> offsets, sizes;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    bool is_tmp_file = false;
+    std::string binary_file = BinaryFileOf(shards[i], "", parser_,
+                                           num_threads_, &is_tmp_file);
+    bool is_direct = false;
+    int fd = OpenForRead(binary_file, use_async_io_, &is_direct);
+    bool valid = fd != -1 && ReadBlockTable(binary_file, &offsets, &sizes);
+    // The cache can be truncated or corrupt (e.g., by a crash), so we
+    // build it again from the shard.
+    if (!valid && binary_file != shards[i] && !is_tmp_file) {
+      LOG(WARNING) << "Rebuild invalid binary cache: " << binary_file;
+      if (fd != -1) {
+        close(fd);
+      }
+      RemoveFile(binary_file.c_str());
+      binary_file = BinaryFileOf(shards[i], "", parser_,
+                                 num_threads_, &is_tmp_file);
+      fd = OpenForRead(binary_file, use_async_io_, &is_direct);
+      valid = fd != -1 && ReadBlockTable(binary_file, &offsets, &sizes);
+    }
+    if (!valid) {
+      LOG(FATAL) << "Cannot open binary file: " << binary_file;
+    }
+    // The opened file is still readable after it is removed.
+    if (is_tmp_file) {
+      RemoveFile(binary_file.c_str());
+    }
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      BlockLocation location;
+      location.file = fds_.size();
+      location.offset = offsets[k];
+      location.size = sizes[k];
+      blocks_.push_back(location);
+    }
+    fds_.push_back(fd);
+    is_direct_.push_back(is_direct);
+  }
+  io_.Initialize(queue_depth_, use_async_io_);
+  buffers_.assign(queue_depth_, nullptr);
+  capacity_.assign(queue_depth_, 0);
+  slot_block_.assign(queue_depth_, kNoBlock);
+  ready_.assign(queue_depth_, false);
+  cache_.Initialize(cache_size_);
+  LOG(INFO) << "Read " << blocks_.size() << " blocks from " << filename_
+            << (io_.IsAsync() ? " by io_uring" : " by pread")
+            << ", queue depth: " << queue_depth_
+            << ", block cache: " << (cache_size_ >> 20) << " MB";
+  data_samples_.Resize(0);
+  resizer_.Reset();
+  rng_.seed(seed_);
+  StartEpoch();
+}
+
+// The order of the blocks [begin, end) is shuffled in place, so the
+// orders of the epochs only depend on seed_.
+void AsyncReader::StartEpoch() {
+  size_t begin = std::min(begin_block_, blocks_.size());
+  size_t end = std::min(end_block_, blocks_.size());
+  if (shuffle_ && begin < end) {
+    if (order_.empty()) {
+      order_.resize(end - begin);
+      for (size_t i = 0; i < order_.size(); ++i) {
+        order_[i] = begin + i;
+      }
+    }
+    std::shuffle(order_.begin(), order_.end(), rng_);
+  }
+  now_block_ = next_read_ = begin;
+  ReadAhead();
+}
+
+// The reads of O_DIRECT are extended to the aligned boundaries, so
+// the block starts at the offset % kDirectIOAlignment of the buffer.
+uint64 AsyncReader::Lead(size_t block) const {
+  const BlockLocation& location = blocks_[block];
+  return is_direct_[location.file] ? location.offset % kDirectIOAlignment
+                                   : 0;
+}
+
+void AsyncReader::ReadBlock(size_t pos) {
+  size_t block = BlockAt(pos);
+  const BlockLocation& location = blocks_[block];
+  uint64 begin = location.offset - Lead(block);
+  uint64 size = location.offset + location.size - begin;
+  if (is_direct_[location.file]) {
+    size = (size + kDirectIOAlignment - 1) /
+           kDirectIOAlignment * kDirectIOAlignment;
+  }
+  size_t slot = pos % queue_depth_;
+  CHECK_EQ(slot_block_[slot], kNoBlock);
+  if (capacity_[slot] < size) {
+    free(buffers_[slot]);
+    buffers_[slot] = AllocateAligned(size);
+    capacity_[slot] = size;
+  }
+  slot_block_[slot] = block;
+  ready_[slot] = false;
+  io_.Read(fds_[location.file], pos, buffers_[slot], begin, size);
+}
+
+// The cached blocks are not read again.
+void AsyncReader::ReadAhead() {
+  size_t end = std::min(end_block_, blocks_.size());
+  while (next_read_ < end && next_read_ < now_block_ + queue_depth_) {
+    if (!cache_.Contains(BlockAt(next_read_))) {
+      ReadBlock(next_read_);
+    }
+    ++next_read_;
+  }
+}
+
+void AsyncReader::WaitOne() {
+  uint64 bytes = 0;
+  size_t pos = io_.Wait(&bytes);
+  size_t block = BlockAt(pos);
+  if (bytes < Lead(block) + blocks_[block].size) {
+    LOG(FATAL) << "Incomplete block " << block << " in " << filename_;
+  }
+  ready_[pos % queue_depth_] = true;
+}
+
+// The buffer of the block returned by the last Samples() is moved to
+// the cache, or reused by the next read of the slot.
+void AsyncReader::ReleaseBlock() {
+  if (used_slot_ == -1) {
+    return;
+  }
+  if (cache_.Insert(slot_block_[used_slot_], buffers_[used_slot_],
+                    capacity_[used_slot_])) {
+    buffers_[used_slot_] = nullptr;
+    capacity_[used_slot_] = 0;
+  }
+  slot_block_[used_slot_] = kNoBlock;
+  used_slot_ = -1;
+}
+
+const ColumnBlock* AsyncReader::NextBlock() {
+  ReleaseBlock();
+  ReadAhead();
+  if (now_block_ >= std::min(end_block_, blocks_.size())) {
+    return nullptr;
+  }
+  size_t block = BlockAt(now_block_);
+  const char* buf = cache_.Lookup(block);
+  if (buf == nullptr) {
+    size_t slot = now_block_ % queue_depth_;
+    // The block has been evicted after ReadAhead().
+    if (slot_block_[slot] != block) {
+      ReadBlock(now_block_);
+    }
+    while (!ready_[slot]) {
+      WaitOne();
+    }
+    buf = buffers_[slot];
+    used_slot_ = slot;
+  }
+  // The file can be changed after its offset table is read.
+  if (!IsValidBinaryBlock(buf + Lead(block), blocks_[block].size)) {
+    LOG(FATAL) << "Invalid block " << block << " of " << filename_;
+  }
+  BinaryBlockView(buf + Lead(block), &block_);
+  ++now_block_;
+  return &block_;
+}
+
+int AsyncReader::Samples(DMatrix* &matrix) {
+  const ColumnBlock* block = nullptr;
+  if (block_size_ > 0) {
+    block = resizer_.Next([this]() { return NextBlock(); });
+  } else {
+    block = NextBlock();
+  }
+  if (block == nullptr) {
+    matrix = nullptr;
+    return 0;
+  }
+  data_samples_.SetBlock(block, &labels_);
+  matrix = &data_samples_;
+  return block->num_columns;
+}
+
+// The reads in flight cannot be cancelled, so we wait for them.
+void AsyncReader::GoToHead() {
+  resizer_.Reset();
+  ReleaseBlock();
+  while (io_.NumPending() > 0) {
+    WaitOne();
+  }
+  slot_block_.assign(queue_depth_, kNoBlock);
+  StartEpoch();
+}
+
+bool AsyncReader::TakeCacheStats(uint64* num_hits, uint64* num_misses) {
+  cache_.TakeStats(num_hits, num_misses);
+  return cache_size_ > 0;
+}
+
 } // namespace f2m
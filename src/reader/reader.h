@@ -24,6 +24,8 @@ data from data source.
 #ifndef F2M_READER_READER_H_
 #define F2M_READER_READER_H_
 
+#include <memory>
+#include <random>
 #include <string>
 #include <vector>
 #include <thread>
@@ -32,6 +34,11 @@ data from data source.
 #include "src/base/class_register.h"
 #include "src/base/scoped_ptr.h"
 #include "src/data/data_structure.h"
+#include "src/reader/async_io.h"
+#include "src/reader/block_cache.h"
+#include "src/reader/block_resizer.h"
+#include "src/reader/dataset.h"
+#include "src/reader/input_stream.h"
 #include "src/reader/parser.h"
 #include "src/thread/condition_variable.h"
 #include "src/thread/mutex.h"
@@ -69,7 +76,18 @@ namespace f2m {
 //------------------------------------------------------------------------------
 class Reader {
  public:
-  Reader() {  }
+  Reader()
+    : num_threads_(1),
+      queue_depth_(16),
+      cache_size_(0),
+      shuffle_(false),
+      seed_(0),
+      reblock_epochs_(0),
+      negative_rate_(1.0),
+      compress_columns_(false),
+      block_size_(0),
+      begin_block_(0),
+      end_block_(kMaxBlocks) {  }
   virtual ~Reader() {  }
 
   // We need to invoke this method before we sample data.
@@ -85,8 +103,104 @@ class Reader {
   // Return to the begining of the data source.
   virtual void GoToHead() = 0;
 
-  // Normalize data (only used in in-memory Reader)
-  virtual void Normalize(real_t max, real_t min) { }
+  // Return true if Initialize() has been invoked.
+  bool IsInitialized() const { return !filename_.empty(); }
+
+  // Return a new cursor over the blocks of the Reader, which is owned
+  // by the caller. The cursor does not change the position of the Reader
+  // and can be used in another thread. Return NULL if the Reader streams
+  // the data and cannot scan it independently (the OndiskReader). Note
+  // that one Reader must not be sampled by many threads at the same time.
+  virtual BlockCursor* NewCursor() { return nullptr; }
+
+  // Number of threads used to parse the data. Only used by the
+  // in-memory Reader, and we need to invoke it before Initialize().
+  void SetNumThreads(int num_threads) {
+    CHECK_GT(num_threads, 0);
+    num_threads_ = num_threads;
+  }
+
+  // Number of block reads in flight. Only used by the AsyncReader, and
+  // we need to invoke it before Initialize().
+  void SetQueueDepth(int queue_depth) {
+    CHECK_GT(queue_depth, 0);
+    queue_depth_ = queue_depth;
+  }
+
+  // Memory budget (in bytes) of the block cache. Only used by the
+  // AsyncReader, and we need to invoke it before Initialize().
+  void SetCacheSize(uint64 cache_size) { cache_size_ = cache_size; }
+
+  // Name of the shared dataset. The binary blocks are published to the
+  // shared memory once, and mapped read-only by all the processes of the
+  // same name. Only used by the MmapReader, and we need to invoke it
+  // before Initialize().
+  void SetSharedName(const std::string& name) { shared_name_ = name; }
+
+  // Return the blocks in a new random order after each GoToHead(). The
+  // orders only depend on the seed, so the trainning is reproducible.
+  // Not used by the OndiskReader, which streams the file. We need to
+  // invoke it before Initialize().
+  void SetShuffle(bool shuffle, uint64 seed) {
+    shuffle_ = shuffle;
+    seed_ = seed;
+  }
+
+  // Regroup the samples into new blocks every num_epochs epochs (0
+  // means never), so the mini-batches are different between epochs.
+  // The random order is also given by the seed of SetShuffle(). Only
+  // used by the in-memory Reader, and we need to invoke it before
+  // Initialize().
+  void SetReblockEpochs(int num_epochs) {
+    CHECK_GE(num_epochs, 0);
+    reblock_epochs_ = num_epochs;
+  }
+
+  // Keep only negative_rate of the negative samples (label <= 0) when
+  // the data is loaded, and weight the kept ones (see
+  // Dataset::Downsample()), so the memory and the time of each epoch
+  // shrink while the loss stays calibrated. The random choice is also
+  // given by the seed of SetShuffle(). Only used by the in-memory
+  // Reader, and we need to invoke it before Initialize().
+  void SetNegativeRate(real_t negative_rate) {
+    CHECK_GT(negative_rate, 0);
+    CHECK_LE(negative_rate, 1);
+    negative_rate_ = negative_rate;
+  }
+
+  // Encode the columns of the blocks in memory (see column_codec.h)
+  // when the data is loaded, so the memory and the memory bandwidth of
+  // each epoch shrink. Only used by the in-memory Reader, and we need to
+  // invoke it before Initialize().
+  void SetCompressColumns(bool compress) {
+    compress_columns_ = compress;
+  }
+
+  // Split or merge the stored blocks on the fly, so that Samples()
+  // returns blocks of block_size samples (0 means the stored blocks).
+  // See block_resizer.h. The cursors of NewCursor() and the block range
+  // still use the stored blocks. We need to invoke it at the begining
+  // of the data, e.g., after Initialize() or GoToHead().
+  void SetBlockSize(index_t block_size) {
+    block_size_ = block_size;
+    if (block_size > 0) {
+      resizer_.Initialize(block_size);
+    }
+  }
+
+  // Return the number of hits and misses of the block cache since the
+  // last call. Return false if the Reader has no block cache.
+  virtual bool TakeCacheStats(uint64* num_hits, uint64* num_misses) {
+    return false;
+  }
+
+  // Only sample the blocks [begin, end) of the data source, e.g., one
+  // fold of cross-validation. We need to invoke it before Initialize().
+  void SetBlockRange(size_t begin, size_t end) {
+    CHECK_LE(begin, end);
+    begin_block_ = begin;
+    end_block_ = end;
+  }
 
  protected:
   std::string filename_;    // Indicate the input file
@@ -94,21 +208,55 @@ class Reader {
   FILE* file_ptr_;          // Maintain current file pointer
   DMatrix data_samples_;    // Data sample
   Parser* parser_;          // Parse StringList to DMatrix
+  int num_threads_;         // Number of threads for parsing
+  int queue_depth_;         // Number of block reads in flight
+  uint64 cache_size_;       // Memory budget of the block cache
+  std::string shared_name_; // Name of the shared dataset
+  bool shuffle_;            // Shuffle the blocks of each epoch
+  uint64 seed_;             // Seed of the shuffling
+  std::mt19937_64 rng_;     // Seeded by seed_ in Initialize()
+  int reblock_epochs_;      // Reblock every N epochs
+  real_t negative_rate_;    // Fraction of the negative samples to keep
+  bool compress_columns_;   // Encode the columns in memory
+  index_t block_size_;      // Samples of each returned block
+  BlockResizer resizer_;    // Used if block_size_ > 0
+  size_t begin_block_;      // First block to sample
+  size_t end_block_;        // End of the blocks to sample
+
+  static const size_t kMaxBlocks = static_cast<size_t>(-1);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Reader);
 };
 
 //------------------------------------------------------------------------------
-// Sampling data from memory buffer.
-// At each begining of sample we random shuffle the data.
+// Sampling data from memory buffer. The data path can be a file, a
+// directory or a glob pattern of shards. The blocks live in a Dataset
+// (see dataset.h), which is parsed by num_threads_ threads at the first
+// time (the shards are parsed in parallel) and then shared by all the
+// InmemReaders of the same path, e.g., the Readers of the
+// cross-validation folds. So an InmemReader is only a
+// BlockCursor over the immutable blocks, and each of them has its own
+// position. Samples() returns the flat view of the block. If shuffle_
+// is set, the cursor is shuffled at each begining of the data, which
+// only permutes the indices of the blocks.
+//
+// Every reblock_epochs_ epochs, the samples of the block range are
+// regrouped into new blocks (see Dataset::Reblock()), which are owned
+// by this Reader only. So the memory of the Reader grows by the size of
+// its block range, even if the Dataset is mapped from a shared file.
+// The downsampled blocks (if negative_rate_ < 1) and the encoded blocks
+// (if compress_columns_ is set) of the block range are derived from the
+// shared Dataset when the Reader is initialized, and are also shared by
+// the Readers of the same range and settings (see DerivedKey()).
 //------------------------------------------------------------------------------
 class InmemReader : public Reader {
  public:
-  InmemReader() {  }
-  ~InmemReader();
+  InmemReader()
+    : num_epochs_(0), end_of_data_(false), own_blocks_(false) {  }
+  ~InmemReader() {  }
 
-  // Pre-load all the data into memory buffer.
+  // Acquire the shared Dataset of the file.
   virtual void Initialize(const std::string& filename,
                           int num_samples,
                           Parser* parser,
@@ -120,50 +268,261 @@ class InmemReader : public Reader {
   // Return to the begining of the data buffer.
   virtual void GoToHead();
 
-  // Normalize
-  virtual void Normalize(real_t max, real_t min);
+  // Return a new cursor over the same blocks.
+  virtual BlockCursor* NewCursor();
 
  protected:
-  DMatrix data_buf_;             // Data buffer
-  int pos_;                      // Position for samplling
-  std::vector<index_t> sampled_length;
-  //std::vector<index_t> order_;   // Used in shuffle
+  std::shared_ptr<const Dataset> dataset_;   // Data buffer
+  scoped_ptr<BlockCursor> cursor_;           // Position for samplling
+  std::vector<real_t> labels_;               // Y of current block
+  int num_epochs_;                           // Number of finished epochs
+  bool end_of_data_;                         // Samples() has returned 0
+  bool own_blocks_;                          // dataset_ is the range only
 
- private:
-  // Counting the '\n' character
-  int GetLineNumber(const char* buf, uint64 buf_size);
+  // The key of the Dataset in the registry.
+  virtual std::string DatasetKey() const { return "memory:" + filename_; }
+
+  // Create and load a new Dataset from all the shards of the data
+  // path. Invoked only when no other Reader is using the Dataset of
+  // the same key.
+  Dataset* LoadDataset();
+
+  // Create and load the Dataset of one shard.
+  virtual Dataset* LoadShard(const std::string& shard, int num_threads);
 
-  // Read every line from memory buffer
-  uint32 ReadLineFromMemory(char* line,
-                            char* buf,
-                            uint64 start_pos,
-                            uint64 total_len);
+  // The key of the downsampled or encoded blocks of the block range.
+  std::string DerivedKey() const;
 
+  // Create the downsampled or encoded blocks of the block range from
+  // the Dataset of DatasetKey().
+  Dataset* LoadDerived();
+
+  // Replace dataset_ by a Dataset of new blocks of the block range.
+  void Reblock();
+
+ private:
   DISALLOW_COPY_AND_ASSIGN(InmemReader);
 };
 
 //------------------------------------------------------------------------------
-// Samplling data from disk file.
+// Sampling data from a binary column-block file (see binary_format.h),
+// which is mapped into memory. The blocks are returned as zero-copy views.
+// If the input is a text file, we parse it at the first time and write a
+// binary cache (filename + ".bin") next to it. Later runs reuse the cache
+// as long as the size and mtime of the text file match. Each shard of a
+// sharded data path has its own binary cache. Like the InmemReader, the
+// mapped files are shared by the Readers of the same data path.
+//
+// The mapped pages are also shared by the processes that map the same
+// file. Given a shared name (see SetSharedName()), the binary file is
+// written to the POSIX shared memory (/dev/shm/f2m.<name>.<shard>.<hash>)
+// instead, so the jobs with different hyper-parameters on the same data
+// cost one copy of the data in memory, and the first job parses it
+// while the others wait and attach to it. The files are kept after the
+// jobs exit, and can be removed by "rm /dev/shm/f2m.<name>.*".
+//------------------------------------------------------------------------------
+class MmapReader : public InmemReader {
+ public:
+  MmapReader() {  }
+  ~MmapReader() {  }
+
+ protected:
+  virtual std::string DatasetKey() const { return "mmap:" + filename_; }
+
+  // Map the binary file (or its binary cache) into memory.
+  virtual Dataset* LoadShard(const std::string& shard, int num_threads);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MmapReader);
+};
+
+//------------------------------------------------------------------------------
+// Samplling data from a binary column-block file (or the binary cache of
+// a text file, like the MmapReader) on disk, for the data that does not
+// fit in memory. The blocks are read by io_uring (see async_io.h) with
+// O_DIRECT, so they bypass the page cache, and queue_depth_ blocks are
+// read ahead in the order of the epoch while the caller is using the
+// current one. If io_uring is not available, we fall back to pread().
+// If shuffle_ is set, the epoch order is a permutation of the blocks,
+// and we read ahead in that order.
+// The text file is converted window by window, so it does not need to
+// fit in memory.
+//
+// The blocks that have been used are kept in a BlockCache of
+// cache_size_ bytes (see block_cache.h), and the least recently used
+// ones are evicted and read again from the file when needed. So the
+// memory is about cache_size_ plus queue_depth_ blocks no matter how
+// big the file is.
+//
+// The DMatrix returned by Samples() is valid until the next call of
+// Samples() or GoToHead().
+//------------------------------------------------------------------------------
+class AsyncReader : public Reader {
+ public:
+  AsyncReader();
+  ~AsyncReader();
+
+  // Open the binary files and start reading the first blocks.
+  virtual void Initialize(const std::string& filename,
+                          int num_samples,
+                          Parser* parser,
+                          ModelType type = LR);
+
+  // Return the next block from the cache, or once it has been read.
+  virtual int Samples(DMatrix* &matrix);
+
+  // Return to the begining of the block range.
+  virtual void GoToHead();
+
+  // Hits and misses of the block cache.
+  virtual bool TakeCacheStats(uint64* num_hits, uint64* num_misses);
+
+  // Use pread() and the page cache instead of io_uring and O_DIRECT.
+  // We need to invoke it before Initialize().
+  void DisableAsyncIO() { use_async_io_ = false; }
+
+ protected:
+  // Where a block is in the binary files.
+  struct BlockLocation {
+    int file;
+    uint64 offset;
+    uint64 size;
+  };
+
+  bool use_async_io_;                   // io_uring and O_DIRECT
+  AsyncIO io_;
+  BlockCache cache_;
+  std::vector<int> fds_;                // Binary files of the shards
+  std::vector<bool> is_direct_;         // If the file uses O_DIRECT
+  std::vector<BlockLocation> blocks_;   // Blocks of all the files
+  std::vector<size_t> order_;           // Blocks of the epoch if shuffled
+  // The block at the position i of the epoch is read into the slot
+  // i % queue_depth_.
+  std::vector<char*> buffers_;          // Buffer of each slot
+  std::vector<uint64> capacity_;        // Size of each buffer
+  std::vector<size_t> slot_block_;      // Block read into the slot
+  std::vector<bool> ready_;             // If the slot has been read
+  size_t now_block_;                    // Position returned by Samples()
+  size_t next_read_;                    // Next position to read ahead
+  int used_slot_;                       // Slot used by the caller
+  ColumnBlock block_;                   // View of current block
+  std::vector<real_t> labels_;          // Y of current block
+
+ private:
+  // Return the block at the position of the epoch.
+  size_t BlockAt(size_t pos) const {
+    return order_.empty() ? pos : order_[pos - begin_block_];
+  }
+
+  // Offset of the block in its buffer.
+  uint64 Lead(size_t block) const;
+
+  // Start reading the block at the position into its slot.
+  void ReadBlock(size_t pos);
+
+  // Read the blocks that are not in the cache, until we reach
+  // queue_depth_ blocks after now_block_.
+  void ReadAhead();
+
+  // Shuffle the blocks if needed, and read ahead from the first one.
+  void StartEpoch();
+
+  // Return the next stored block, or nullptr at the end of the range.
+  const ColumnBlock* NextBlock();
+
+  // Wait for a read to complete.
+  void WaitOne();
+
+  // Move the block used by the caller to the cache.
+  void ReleaseBlock();
+
+  // Wait for all the reads, and close the files.
+  void Close();
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncReader);
+};
+
+//------------------------------------------------------------------------------
+// Samplling data from disk file, which is in the column-block text format
+// (block-length line, Y line, and column lines), and may be compressed
+// by gzip or zstd (see input_stream.h). The shards of a sharded data
+// path are read one after another. The file is streamed
+// block by block, and a background thread parses the next block while
+// the caller is using the current one. So we only keep two blocks in
+// memory no matter how big the file is.
+//
+// The DMatrix returned by Samples() is valid until the next call of
+// Samples() or GoToHead(). The lines of the blocks out of the block
+// range are skipped without parsing.
 //------------------------------------------------------------------------------
-/*class OndiskReader : public Reader {
+class OndiskReader : public Reader {
  public:
-  OndiskReader() {  }
+  OndiskReader();
   ~OndiskReader();
 
+  // Open the file and start the background thread.
   virtual void Initialize(const std::string& filename,
                           int num_samples,
                           Parser* parser,
                           ModelType type = LR);
 
-  // Sample data from disk file.
+  // Return the block parsed by the background thread.
   virtual int Samples(DMatrix* &matrix);
 
   // Return to the begining of the file.
   virtual void GoToHead();
 
+ protected:
+  std::vector<real_t> labels_;   // Y of the returned block
+  ColumnArena arena_[2];         // Double buffer of the blocks
+  int num_rows_[2];              // Number of rows in each buffer
+  bool ready_[2];                // If the buffer has been parsed
+  int next_buffer_;              // Buffer returned by next Samples()
+  int used_buffer_;              // Buffer used by the caller
+  uint64 generation_;            // Increased by each GoToHead()
+  bool stop_;                    // Stop the background thread
+  Mutex mutex_;
+  ConditionVariable cond_;
+  std::thread thread_;
+  // Only used by the background thread
+  std::vector<std::string> shards_;  // Shards of the data path
+  size_t shard_;                 // Current shard
+  scoped_ptr<LineReader> lines_; // Lines of current shard
+  std::string text_;             // Lines of current block
+  size_t now_block_;             // Index of the next block
+  size_t shard_block_;           // Index of the first block of the shard
+  size_t head_shard_;            // Shard of the first block in range
+  uint64 head_offset_;           // Offset of the first block in the shard
+  size_t head_block_;            // Index of the block at head_offset_
+  size_t head_shard_block_;      // Index of the first block of head_shard_
+
  private:
+  // The loop of the background thread.
+  void ReadThread();
+
+  // Open the shard for reading.
+  void OpenShard(size_t shard);
+
+  // Read the block-length line and the Y line of the next block to
+  // text_. Return false at the end of the last shard.
+  bool ReadBlockHead();
+
+  // Read the lines of one block to text_, and parse them to the arena.
+  // Return the number of columns, or 0 at the end of file.
+  int ReadBlock(ColumnArena* arena);
+
+  // Skip the lines of one block. Return false at the end of file.
+  bool SkipBlock();
+
+  // Return the next block parsed by the background thread, or nullptr
+  // at the end of file.
+  const ColumnBlock* NextBuffer();
+
+  // Stop the background thread and close the file.
+  void Stop();
+
   DISALLOW_COPY_AND_ASSIGN(OndiskReader);
-};*/
+};
 
 //------------------------------------------------------------------------------
 // Class register
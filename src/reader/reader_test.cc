@@ -22,14 +22,23 @@ This file tests reader.h
 
 #include "gtest/gtest.h"
 
-#include <unistd.h> // for usleep()
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
 
+#include <algorithm>
 #include <string>
+#include <thread>
 #include <vector>
-#include <chrono>  // for std::chrono
 
 #include "src/base/file_util.h"
+#include "src/base/scoped_ptr.h"
+#include "src/base/stl-util.h"
+#include "src/reader/binary_format.h"
 #include "src/reader/reader.h"
+#include "src/data/column_codec.h"
 #include "src/data/data_structure.h"
 
 using std::vector;
@@ -37,159 +46,806 @@ using std::string;
 
 namespace f2m {
 
-const string kTestfilename = "/tmp/test_reader";
-const string kStr = "0 1:0.123 2:0.123 3:0.123\n";
-const string kStrFFM = "1 1:1:0.123 2:2:0.123 3:3:0.123\n";
+const string kTestfilename = "/tmp/test_reader.txt";
 const index_t kFeatureNum = 3;
-const index_t kNumLines = 100000;
-const index_t kNumSamples = 10000;
-const int iteration_num = 300;
+const index_t kNumBlocks = 10;
+const index_t kNumSamples = 1000;
+const int iteration_num = 25;
 
 Parser* parser_lr = new LibsvmParser;
-Parser* parser_ffm = new FFMParser;
 
+// Write the column blocks [begin, end). Each block has the bias column
+// and kFeatureNum feature columns, and the Y of block k is k.
+void WriteBlocks(const string& filename, index_t begin, index_t end) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t k = begin; k < end; ++k) {
+    string block = std::to_string(kFeatureNum + 1) + "\n";
+    for (index_t i = 0; i < kNumSamples; ++i) {
+      block += std::to_string(k) + " ";
+    }
+    block += "\n";
+    for (index_t j = 1; j <= kFeatureNum; ++j) {
+      block += std::to_string(j) + " ";
+      for (index_t i = 0; i < kNumSamples; ++i) {
+        block += std::to_string(i) + ":0.123 ";
+      }
+      block += "\n";
+    }
+    WriteDataToDisk(file, block.c_str(), block.size());
+  }
+  string last_line = std::to_string(kFeatureNum + 1) + "\n";
+  WriteDataToDisk(file, last_line.c_str(), last_line.size());
+  Close(file);
+}
+
+// Write kNumBlocks column blocks.
 class ReaderTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
-    string lr_file = kTestfilename + "_LR.txt";
-    string ffm_file = kTestfilename + "_ffm.txt";
-    FILE* file_lr = OpenFileOrDie(lr_file.c_str(), "w");
-    for (index_t i = 0; i < kNumLines; ++i) {
-      uint32 write_len = fwrite(kStr.c_str(), 1, kStr.size(), file_lr);
-      EXPECT_EQ(write_len, kStr.size());
-    }
-    Close(file_lr);
-    FILE* file_ffm = OpenFileOrDie(ffm_file.c_str(), "w");
-    for (index_t i = 0; i < kNumLines; ++i) {
-      uint32 write_len = fwrite(kStrFFM.c_str(), 1, kStrFFM.size(), file_ffm);
-      EXPECT_EQ(write_len, kStrFFM.size());
-
-    }
-    Close(file_ffm);
+    WriteBlocks(kTestfilename, 0, kNumBlocks);
   }
   virtual void TearDown() {
-    string lr_file = kTestfilename + "_LR.txt";
-    string ffm_file = kTestfilename + "_ffm.txt";
-    RemoveFile(lr_file.c_str());
-    RemoveFile(ffm_file.c_str());
+    RemoveFile(kTestfilename.c_str());
   }
 };
 
-void CheckLR(const DMatrix* matrix) {
-  EXPECT_EQ(matrix->row_len, kNumSamples);
-  // check the first element
-  EXPECT_EQ(matrix->Y[0], (real_t)0);
-  EXPECT_EQ(matrix->row[0]->X[0], (real_t)1.0);
-  EXPECT_EQ(matrix->row[0]->X[1], (real_t)0.123);
-  EXPECT_EQ(matrix->row[0]->X[kFeatureNum], (real_t)0.123);
-  EXPECT_EQ(matrix->row[0]->idx[0], (index_t)0);
-  EXPECT_EQ(matrix->row[0]->idx[1], (index_t)1);
-  EXPECT_EQ(matrix->row[0]->idx[kFeatureNum], (index_t)(kFeatureNum));
-  // check the last element
-  EXPECT_EQ(matrix->Y[kNumSamples-1], (real_t)0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[0], (real_t)1.0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[1], (real_t)0.123);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[kFeatureNum], (real_t)0.123);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[0], (index_t)0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[1], (index_t)1);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[kFeatureNum], (index_t)(kFeatureNum));
-}
-
-void CheckFFM(const DMatrix* matrix) {
-  EXPECT_EQ(matrix->row_len, kNumSamples);
-  // check the first element
-  EXPECT_EQ(matrix->Y[0], (real_t)1);
-  EXPECT_EQ(matrix->row[0]->X[0], (real_t)1.0);
-  EXPECT_EQ(matrix->row[0]->X[1], (real_t)0.123);
-  EXPECT_EQ(matrix->row[0]->X[kFeatureNum], (real_t)0.123);
-  EXPECT_EQ(matrix->row[0]->idx[0], (index_t)0);
-  EXPECT_EQ(matrix->row[0]->idx[1], (index_t)1);
-  EXPECT_EQ(matrix->row[0]->idx[kFeatureNum], (index_t)(kFeatureNum));
-  EXPECT_EQ(matrix->row[0]->field[0], (index_t)0);
-  EXPECT_EQ(matrix->row[0]->field[1], (index_t)1);
-  EXPECT_EQ(matrix->row[0]->field[kFeatureNum], (index_t)(kFeatureNum));
-  // check the last element
-  EXPECT_EQ(matrix->Y[kNumSamples-1], (real_t)1);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[0], (real_t)1.0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[1], (real_t)0.123);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->X[kFeatureNum], (real_t)0.123);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[0], (index_t)0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[1], (index_t)1);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->idx[kFeatureNum], (index_t)(kFeatureNum));
-  EXPECT_EQ(matrix->row[kNumSamples-1]->field[0], (index_t)0);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->field[1], (index_t)1);
-  EXPECT_EQ(matrix->row[kNumSamples-1]->field[kFeatureNum], (index_t)(kFeatureNum));
+void CheckBlock(const DMatrix* matrix, index_t k) {
+  EXPECT_EQ(matrix->row_len, kFeatureNum + 1);
+  EXPECT_EQ(matrix->Y[0]->size(), kNumSamples);
+  EXPECT_EQ((*matrix->Y[0])[0], (real_t)k);
+  EXPECT_EQ((*matrix->Y[0])[kNumSamples-1], (real_t)k);
+  // bias
+  ColumnRef col = matrix->Column(0);
+  EXPECT_EQ(col.id, (index_t)0);
+  EXPECT_EQ(col.len, kNumSamples);
+  EXPECT_EQ(col.X[0], (real_t)1.0);
+  EXPECT_EQ(col.idx[kNumSamples-1], kNumSamples-1);
+  // the last column
+  col = matrix->Column(kFeatureNum);
+  EXPECT_EQ(col.id, kFeatureNum);
+  EXPECT_EQ(col.len, kNumSamples);
+  EXPECT_EQ(col.X[kNumSamples-1], (real_t)0.123);
+  EXPECT_EQ(col.idx[kNumSamples-1], kNumSamples-1);
 }
 
-TEST_F(ReaderTest, SampleFromMemory) {
-  string lr_file = kTestfilename + "_LR.txt";
-  string ffm_file = kTestfilename + "_ffm.txt";
-  // lr
-  InmemReader reader_lr;
-  reader_lr.Initialize(lr_file, kNumSamples, parser_lr, LR);
-  DMatrix* matrix = NULL;
-  int i = 0;
-  for (; i < iteration_num; ++i) {
-    int record_num = reader_lr.Samples(matrix);
+void SampleAll(Reader* reader) {
+  DMatrix* matrix = nullptr;
+  index_t k = 0;
+  for (int i = 0; i < iteration_num; ++i) {
+    int record_num = reader->Samples(matrix);
     if (record_num == 0) {
-      --i;
-      reader_lr.GoToHead();
+      EXPECT_EQ(k, kNumBlocks);
+      EXPECT_TRUE(matrix == nullptr);
+      k = 0;
+      reader->GoToHead();
       continue;
     }
-    EXPECT_EQ(record_num, kNumSamples);
-    CheckLR(matrix);
+    EXPECT_EQ(record_num, kFeatureNum + 1);
+    CheckBlock(matrix, k++);
   }
-  EXPECT_EQ(i, iteration_num);
-  // ffm
-  matrix = nullptr;
-  InmemReader reader_ffm;
-  reader_ffm.Initialize(ffm_file, kNumSamples, parser_ffm, FFM);
-  for (i = 0; i < iteration_num; ++i) {
-    int record_num = reader_ffm.Samples(matrix);
-    if (record_num == 0) {
-      --i;
-      reader_ffm.GoToHead();
-      continue;
+}
+
+TEST_F(ReaderTest, SampleFromMemory) {
+  InmemReader reader;
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  SampleAll(&reader);
+}
+
+TEST_F(ReaderTest, ParseInParallel) {
+  for (int num_threads = 2; num_threads <= 16; num_threads *= 2) {
+    InmemReader reader;
+    reader.SetNumThreads(num_threads);
+    reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    SampleAll(&reader);
+  }
+  // ParseBlock() gives the same blocks as Parse().
+  InmemReader mem_reader;
+  mem_reader.SetNumThreads(3);
+  mem_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  OndiskReader disk_reader;
+  disk_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  DMatrix* mem_matrix = nullptr;
+  DMatrix* disk_matrix = nullptr;
+  while (mem_reader.Samples(mem_matrix)) {
+    EXPECT_EQ(disk_reader.Samples(disk_matrix), mem_matrix->row_len);
+    const ColumnBlock* a = mem_matrix->block;
+    const ColumnBlock* b = disk_matrix->block;
+    EXPECT_EQ(a->num_columns, b->num_columns);
+    EXPECT_EQ(a->nnz, b->nnz);
+    EXPECT_EQ(vector<real_t>(a->Y, a->Y + a->num_samples),
+              vector<real_t>(b->Y, b->Y + b->num_samples));
+    EXPECT_EQ(vector<index_t>(a->col_ptr, a->col_ptr + a->num_columns + 1),
+              vector<index_t>(b->col_ptr, b->col_ptr + b->num_columns + 1));
+    EXPECT_EQ(vector<index_t>(a->idx, a->idx + a->nnz),
+              vector<index_t>(b->idx, b->idx + b->nnz));
+    EXPECT_EQ(vector<real_t>(a->X, a->X + a->nnz),
+              vector<real_t>(b->X, b->X + b->nnz));
+  }
+  EXPECT_EQ(disk_reader.Samples(disk_matrix), 0);
+}
+
+TEST_F(ReaderTest, ShareDataset) {
+  const char* format_names[] = { "memory", "mmap" };
+  for (int n = 0; n < 2; ++n) {
+    scoped_ptr<Reader> reader_1(CREATE_READER(format_names[n]));
+    scoped_ptr<Reader> reader_2(CREATE_READER(format_names[n]));
+    reader_1->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    reader_2->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    // Both Readers return the same blocks, but each has its own position.
+    DMatrix* matrix_1 = nullptr;
+    DMatrix* matrix_2 = nullptr;
+    EXPECT_EQ(reader_1->Samples(matrix_1), kFeatureNum + 1);
+    EXPECT_EQ(reader_1->Samples(matrix_1), kFeatureNum + 1);
+    EXPECT_EQ(reader_2->Samples(matrix_2), kFeatureNum + 1);
+    CheckBlock(matrix_1, 1);
+    CheckBlock(matrix_2, 0);
+    EXPECT_EQ(reader_2->Samples(matrix_2), kFeatureNum + 1);
+    EXPECT_EQ(matrix_1->block, matrix_2->block);
+    reader_2->GoToHead();
+    SampleAll(reader_2.get());
+  }
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+TEST_F(ReaderTest, SharedDataset) {
+  // Only the first process parses the data.
+  MmapReader reader;
+  reader.SetSharedName("reader_test");
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  SampleAll(&reader);
+  EXPECT_NE(access((kTestfilename + kBinaryCacheSuffix).c_str(), F_OK), 0);
+  vector<string> files = ListShards("/dev/shm/f2m.reader_test.*");
+  ASSERT_EQ(files.size(), 1);
+  struct stat st;
+  ASSERT_EQ(stat(files[0].c_str(), &st), 0);
+  // The other processes attach to the same file.
+  for (int i = 0; i < 2; ++i) {
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+      MmapReader child_reader;
+      child_reader.SetSharedName("reader_test");
+      child_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+      DMatrix* matrix = nullptr;
+      int num_blocks = 0;
+      while (child_reader.Samples(matrix) != 0) {
+        if ((*matrix->Y[0])[0] != num_blocks++) {
+          _exit(1);
+        }
+      }
+      _exit(num_blocks == kNumBlocks ? 0 : 2);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+  }
+  struct stat st_after;
+  ASSERT_EQ(stat(files[0].c_str(), &st_after), 0);
+  EXPECT_EQ(st.st_ino, st_after.st_ino);
+  RemoveFile(files[0].c_str());
+}
+
+TEST_F(ReaderTest, SampleBlockRange) {
+  const char* format_names[] = { "memory", "mmap", "disk", "async" };
+  for (int n = 0; n < 4; ++n) {
+    scoped_ptr<Reader> reader(CREATE_READER(format_names[n]));
+    reader->SetBlockRange(3, 7);
+    reader->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    for (int i = 0; i < 2; ++i) {
+      for (index_t k = 3; k < 7; ++k) {
+        EXPECT_EQ(reader->Samples(matrix), kFeatureNum + 1);
+        CheckBlock(matrix, k);
+      }
+      EXPECT_EQ(reader->Samples(matrix), 0);
+      reader->GoToHead();
     }
-    EXPECT_EQ(record_num, kNumSamples);
-    CheckFFM(matrix);
+    // The range is clipped by the end of file.
+    scoped_ptr<Reader> tail(CREATE_READER(format_names[n]));
+    tail->SetBlockRange(kNumBlocks - 1, kNumBlocks + 5);
+    tail->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    EXPECT_EQ(tail->Samples(matrix), kFeatureNum + 1);
+    CheckBlock(matrix, kNumBlocks - 1);
+    EXPECT_EQ(tail->Samples(matrix), 0);
   }
-  EXPECT_EQ(i, iteration_num);
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+// Sum the labels of the blocks returned by the cursor.
+void SumLabels(BlockCursor* cursor, real_t* sum, int* num_blocks) {
+  const ColumnBlock* block = nullptr;
+  while ((block = cursor->Next()) != nullptr) {
+    *sum += block->Y[0];
+    ++*num_blocks;
+  }
+}
+
+TEST_F(ReaderTest, ScanByCursors) {
+  InmemReader reader;
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  DMatrix* matrix = nullptr;
+  EXPECT_EQ(reader.Samples(matrix), kFeatureNum + 1);
+  // Each thread scans all the blocks by its own cursor.
+  const int kNumThreads = 4;
+  const real_t kSum = kNumBlocks * (kNumBlocks - 1) / 2;
+  std::vector<BlockCursor*> cursors(kNumThreads);
+  std::vector<real_t> sums(kNumThreads, 0);
+  std::vector<int> counts(kNumThreads, 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    cursors[i] = reader.NewCursor();
+    threads.push_back(std::thread(SumLabels, cursors[i],
+                                  &sums[i], &counts[i]));
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i].join();
+    EXPECT_EQ(sums[i], kSum);
+    EXPECT_EQ(counts[i], kNumBlocks);
+  }
+  STLDeleteElementsAndClear(&cursors);
+  threads.clear();
+  // The threads share one cursor, and each block is returned once.
+  scoped_ptr<BlockCursor> shared(reader.NewCursor());
+  for (int i = 0; i < kNumThreads; ++i) {
+    sums[i] = counts[i] = 0;
+    threads.push_back(std::thread(SumLabels, shared.get(),
+                                  &sums[i], &counts[i]));
+  }
+  real_t sum = 0;
+  int count = 0;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads[i].join();
+    sum += sums[i];
+    count += counts[i];
+  }
+  EXPECT_EQ(sum, kSum);
+  EXPECT_EQ(count, kNumBlocks);
+  // The cursors do not move the reader.
+  EXPECT_EQ(reader.Samples(matrix), kFeatureNum + 1);
+  CheckBlock(matrix, 1);
+  // The OndiskReader has no cursor.
+  OndiskReader disk_reader;
+  disk_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  EXPECT_TRUE(disk_reader.NewCursor() == nullptr);
+}
+
+TEST_F(ReaderTest, SampleCompressed) {
+  // Compress the test file by gzip.
+  const string gzip_file = kTestfilename + ".gz";
+  FILE* file = OpenFileOrDie(kTestfilename.c_str(), "r");
+  std::vector<char> data(GetFileSize(file));
+  ReadDataFromDisk(file, data.data(), data.size());
+  Close(file);
+  gzFile gz = gzopen(gzip_file.c_str(), "wb");
+  ASSERT_TRUE(gz != NULL);
+  gzwrite(gz, data.data(), data.size());
+  gzclose(gz);
+  const char* format_names[] = { "memory", "mmap", "disk" };
+  for (int n = 0; n < 3; ++n) {
+    scoped_ptr<Reader> reader(CREATE_READER(format_names[n]));
+    reader->Initialize(gzip_file, kNumSamples, parser_lr, LR);
+    SampleAll(reader.get());
+    // The OndiskReader skips the blocks again after GoToHead().
+    scoped_ptr<Reader> range_reader(CREATE_READER(format_names[n]));
+    range_reader->SetBlockRange(2, 4);
+    range_reader->Initialize(gzip_file, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    for (int i = 0; i < 2; ++i) {
+      range_reader->GoToHead();
+      EXPECT_EQ(range_reader->Samples(matrix), kFeatureNum + 1);
+      CheckBlock(matrix, 2);
+      EXPECT_EQ(range_reader->Samples(matrix), kFeatureNum + 1);
+      CheckBlock(matrix, 3);
+      EXPECT_EQ(range_reader->Samples(matrix), 0);
+    }
+  }
+  RemoveFile((gzip_file + kBinaryCacheSuffix).c_str());
+  RemoveFile(gzip_file.c_str());
+}
+
+TEST_F(ReaderTest, SampleShards) {
+  // Three shards, a hidden file, a sub-directory, and the binary cache
+  // of a shard, which is not a shard.
+  const string dir = "/tmp/test_reader_shards";
+  mkdir(dir.c_str(), 0755);
+  mkdir((dir + "/sub").c_str(), 0755);
+  WriteBlocks(dir + "/part-0", 0, 4);
+  WriteBlocks(dir + "/part-1", 4, 5);
+  WriteBlocks(dir + "/part-2", 5, kNumBlocks);
+  WriteBlocks(dir + "/.hidden", 0, 1);
+  const string paths[] = { dir, dir + "/", dir + "/part-*" };
+  for (int p = 0; p < 3; ++p) {
+    vector<string> shards = ListShards(paths[p]);
+    ASSERT_EQ(shards.size(), 3);
+    EXPECT_EQ(shards[1], dir + "/part-1");
+    EXPECT_TRUE(IsShardedPath(paths[p]));
+  }
+  EXPECT_FALSE(IsShardedPath(kTestfilename));
+  const char* format_names[] = { "memory", "mmap", "disk", "async" };
+  for (int n = 0; n < 4; ++n) {
+    for (int p = 0; p < 3; ++p) {
+      scoped_ptr<Reader> reader(CREATE_READER(format_names[n]));
+      reader->SetNumThreads(2);
+      reader->Initialize(paths[p], kNumSamples, parser_lr, LR);
+      SampleAll(reader.get());
+    }
+    // The block range crosses the shards.
+    scoped_ptr<Reader> reader(CREATE_READER(format_names[n]));
+    reader->SetBlockRange(3, 8);
+    reader->Initialize(dir, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    for (int i = 0; i < 2; ++i) {
+      for (index_t k = 3; k < 8; ++k) {
+        EXPECT_EQ(reader->Samples(matrix), kFeatureNum + 1);
+        CheckBlock(matrix, k);
+      }
+      EXPECT_EQ(reader->Samples(matrix), 0);
+      reader->GoToHead();
+    }
+  }
+  // The mmap reader has written the binary caches of the shards.
+  EXPECT_EQ(ListShards(dir).size(), 3);
+  const char* files[] = { "part-0", "part-1", "part-2", ".hidden",
+                          "part-0.bin", "part-1.bin", "part-2.bin" };
+  for (int i = 0; i < 7; ++i) {
+    RemoveFile((dir + "/" + files[i]).c_str());
+  }
+  rmdir((dir + "/sub").c_str());
+  rmdir(dir.c_str());
 }
 
 TEST_F(ReaderTest, SampleFromDisk) {
-  string lr_file = kTestfilename + "_LR.txt";
-  string ffm_file = kTestfilename + "_ffm.txt";
-  // lr
-  OndiskReader reader_lr;
-  reader_lr.Initialize(lr_file, kNumSamples, parser_lr, LR);
+  OndiskReader reader;
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  SampleAll(&reader);
+  // Go to head in the middle of the file.
   DMatrix* matrix = nullptr;
-  int i = 0;
-  for (; i < iteration_num; ++i) {
-    int record_num = reader_lr.Samples(matrix);
-    if (record_num == 0) {
-      --i;
-      reader_lr.GoToHead();
-      continue;
+  for (int n = 0; n < 3; ++n) {
+    reader.GoToHead();
+    for (index_t k = 0; k <= n; ++k) {
+      EXPECT_EQ(reader.Samples(matrix), kFeatureNum + 1);
+      CheckBlock(matrix, k);
     }
-    EXPECT_EQ(record_num, kNumSamples);
-    CheckLR(matrix);
   }
-  EXPECT_EQ(i, iteration_num);
-  // ffm
-  OndiskReader reader_ffm;
-  reader_ffm.Initialize(ffm_file, kNumSamples, parser_ffm, FFM);
-  for (i = 0; i < iteration_num; ++i) {
-    int record_num = reader_ffm.Samples(matrix);
-    if (record_num == 0) {
-      --i;
-      reader_ffm.GoToHead();
-      continue;
+  // Initialize again.
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  SampleAll(&reader);
+}
+
+TEST_F(ReaderTest, SampleAsync) {
+  // Both io_uring with O_DIRECT and the fallback of pread().
+  for (int k = 0; k < 2; ++k) {
+    for (int queue_depth = 1; queue_depth <= 32; queue_depth *= 4) {
+      AsyncReader reader;
+      reader.SetQueueDepth(queue_depth);
+      if (k == 1) {
+        reader.DisableAsyncIO();
+      }
+      reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+      SampleAll(&reader);
+      // Go to head in the middle of the file.
+      DMatrix* matrix = nullptr;
+      for (int n = 0; n < 3; ++n) {
+        reader.GoToHead();
+        for (index_t b = 0; b <= n; ++b) {
+          EXPECT_EQ(reader.Samples(matrix), kFeatureNum + 1);
+          CheckBlock(matrix, b);
+        }
+      }
     }
-    EXPECT_EQ(record_num, kNumSamples);
-    CheckFFM(matrix);
   }
-  EXPECT_EQ(i, iteration_num);
+  // The same blocks as the mapped binary cache.
+  MmapReader mmap_reader;
+  mmap_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  AsyncReader async_reader;
+  async_reader.SetQueueDepth(3);
+  async_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  DMatrix* mmap_matrix = nullptr;
+  DMatrix* async_matrix = nullptr;
+  while (mmap_reader.Samples(mmap_matrix)) {
+    EXPECT_EQ(async_reader.Samples(async_matrix), mmap_matrix->row_len);
+    const ColumnBlock* a = mmap_matrix->block;
+    const ColumnBlock* b = async_matrix->block;
+    EXPECT_EQ(a->nnz, b->nnz);
+    EXPECT_EQ(memcmp(a->col_ptr, b->col_ptr,
+                     sizeof(index_t) * (a->num_columns + 1)), 0);
+    EXPECT_EQ(memcmp(a->idx, b->idx, sizeof(index_t) * a->nnz), 0);
+    EXPECT_EQ(memcmp(a->X, b->X, sizeof(real_t) * a->nnz), 0);
+  }
+  EXPECT_EQ(async_reader.Samples(async_matrix), 0);
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+TEST_F(ReaderTest, SampleWithBlockCache) {
+  // The cache keeps all the blocks, about 3 blocks (of 36 KB), or
+  // nothing.
+  const uint64 cache_sizes[] = { 1 << 30, 3 * 45 * 1024, 0 };
+  for (int c = 0; c < 3; ++c) {
+    AsyncReader reader;
+    reader.SetQueueDepth(2);
+    reader.SetCacheSize(cache_sizes[c]);
+    reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    SampleAll(&reader);
+    uint64 num_hits = 0, num_misses = 0;
+    EXPECT_EQ(reader.TakeCacheStats(&num_hits, &num_misses),
+              cache_sizes[c] > 0);
+    EXPECT_EQ(num_hits + num_misses, iteration_num - 2);
+    if (c == 0) {
+      // Only the first epoch reads the file.
+      EXPECT_EQ(num_misses, kNumBlocks);
+    } else if (c == 1) {
+      // The least recently used blocks of a scan are always evicted.
+      EXPECT_EQ(num_hits, 0);
+    }
+    // Go to head in the middle of the file.
+    DMatrix* matrix = nullptr;
+    for (int n = 0; n < 3; ++n) {
+      reader.GoToHead();
+      for (index_t b = 0; b <= n + 4; ++b) {
+        EXPECT_EQ(reader.Samples(matrix), kFeatureNum + 1);
+        CheckBlock(matrix, b);
+      }
+    }
+  }
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+// Return the labels of the blocks of each epoch.
+vector<vector<index_t>> EpochOrders(Reader* reader, int num_epochs) {
+  vector<vector<index_t>> orders(num_epochs);
+  DMatrix* matrix = nullptr;
+  for (int e = 0; e < num_epochs; ++e) {
+    while (reader->Samples(matrix)) {
+      index_t k = (*matrix->Y[0])[0];
+      CheckBlock(matrix, k);
+      orders[e].push_back(k);
+    }
+    reader->GoToHead();
+  }
+  return orders;
+}
+
+TEST_F(ReaderTest, ShuffleBlocks) {
+  const int kNumEpochs = 4;
+  InmemReader memory_reader;
+  memory_reader.SetShuffle(true, 2016);
+  memory_reader.SetBlockRange(2, kNumBlocks);
+  memory_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  vector<vector<index_t>> orders = EpochOrders(&memory_reader, kNumEpochs);
+  // Each epoch is a permutation of the range, and the epochs have
+  // different orders.
+  for (int e = 0; e < kNumEpochs; ++e) {
+    vector<index_t> sorted = orders[e];
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(sorted.size(), kNumBlocks - 2);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      EXPECT_EQ(sorted[i], i + 2);
+    }
+  }
+  EXPECT_NE(orders[0], orders[1]);
+  // The other readers of the same seed give the same orders.
+  MmapReader mmap_reader;
+  mmap_reader.SetShuffle(true, 2016);
+  mmap_reader.SetBlockRange(2, kNumBlocks);
+  mmap_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  EXPECT_EQ(EpochOrders(&mmap_reader, kNumEpochs), orders);
+  AsyncReader async_reader;
+  async_reader.SetShuffle(true, 2016);
+  async_reader.SetBlockRange(2, kNumBlocks);
+  async_reader.SetQueueDepth(3);
+  async_reader.SetCacheSize(3 * 45 * 1024);
+  async_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  EXPECT_EQ(EpochOrders(&async_reader, kNumEpochs), orders);
+  // The new cursors are not shuffled.
+  scoped_ptr<BlockCursor> cursor(memory_reader.NewCursor());
+  for (index_t k = 2; k < kNumBlocks; ++k) {
+    const ColumnBlock* block = cursor->Next();
+    ASSERT_TRUE(block != nullptr);
+    EXPECT_EQ(block->Y[0], (real_t)k);
+  }
+  EXPECT_TRUE(cursor->Next() == nullptr);
+  // Another seed gives other orders.
+  InmemReader other_reader;
+  other_reader.SetShuffle(true, 2017);
+  other_reader.SetBlockRange(2, kNumBlocks);
+  other_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  EXPECT_NE(EpochOrders(&other_reader, kNumEpochs), orders);
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+TEST_F(ReaderTest, ResizeBlocks) {
+  const char* kReaderNames[] = { "memory", "mmap", "disk", "async" };
+  const index_t kBlockSizes[] = { 300, 1000, 1500, 25000 };
+  for (int r = 0; r < 4; ++r) {
+    for (int b = 0; b < 4; ++b) {
+      scoped_ptr<Reader> reader(CREATE_READER(kReaderNames[r]));
+      reader->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+      reader->SetBlockSize(kBlockSizes[b]);
+      DMatrix* matrix = nullptr;
+      for (int e = 0; e < 2; ++e) {
+        index_t num_samples = 0;
+        while (reader->Samples(matrix)) {
+          const ColumnBlock* block = matrix->block;
+          EXPECT_EQ(block->num_samples,
+                    std::min(kBlockSizes[b],
+                             kNumBlocks * kNumSamples - num_samples));
+          EXPECT_EQ(block->num_columns, kFeatureNum + 1);
+          for (index_t c = 0; c < block->num_columns; ++c) {
+            EXPECT_EQ(block->col_ptr[c+1] - block->col_ptr[c],
+                      block->num_samples);
+          }
+          for (index_t i = 0; i < block->num_samples; ++i) {
+            EXPECT_EQ((*matrix->Y[0])[i],
+                      (real_t)((num_samples + i) / kNumSamples));
+          }
+          num_samples += block->num_samples;
+        }
+        EXPECT_EQ(num_samples, kNumBlocks * kNumSamples);
+        reader->GoToHead();
+      }
+    }
+  }
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+// Write num_blocks blocks of block_size samples. The Y of a sample is
+// its id, and the column j has the value id if id % (j + 1) == 0.
+void WriteSampleIds(const string& filename,
+                    index_t num_blocks,
+                    index_t block_size) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t k = 0; k < num_blocks; ++k) {
+    string block = std::to_string(kFeatureNum + 1) + "\n";
+    for (index_t i = 0; i < block_size; ++i) {
+      block += std::to_string(k * block_size + i) + " ";
+    }
+    block += "\n";
+    for (index_t j = 1; j <= kFeatureNum; ++j) {
+      block += std::to_string(j);
+      for (index_t i = 0; i < block_size; ++i) {
+        index_t id = k * block_size + i;
+        if (id % (j + 1) == 0) {
+          block += " " + std::to_string(i) + ":" + std::to_string(id);
+        }
+      }
+      block += "\n";
+    }
+    WriteDataToDisk(file, block.c_str(), block.size());
+  }
+  string last_line = std::to_string(kFeatureNum + 1) + "\n";
+  WriteDataToDisk(file, last_line.c_str(), last_line.size());
+  Close(file);
+}
+
+TEST(DatasetTest, ReblockSamples) {
+  const string kFilename = "/tmp/test_reblock.txt";
+  const index_t kBlockSize = 50;
+  WriteSampleIds(kFilename, 6, kBlockSize);
+  InmemReader reader;
+  reader.SetNumThreads(3);
+  reader.SetReblockEpochs(2);
+  reader.SetBlockRange(1, 5);
+  reader.Initialize(kFilename, kNumSamples, parser_lr, LR);
+  DMatrix* matrix = nullptr;
+  for (int e = 0; e < 6; ++e) {
+    vector<index_t> ids;
+    bool mixed = false;
+    while (reader.Samples(matrix)) {
+      const ColumnBlock* block = matrix->block;
+      ASSERT_EQ(block->num_samples, kBlockSize);
+      vector<index_t> num_entries(kBlockSize, 0);
+      for (index_t c = 0; c < block->num_columns; ++c) {
+        index_t j = block->col_ids[c];
+        for (index_t k = block->col_ptr[c]; k < block->col_ptr[c+1]; ++k) {
+          index_t id = block->Y[block->idx[k]];
+          EXPECT_EQ(block->X[k], j == 0 ? (real_t)1.0 : (real_t)id);
+          EXPECT_EQ(id % (j + 1), 0);
+          if (k > block->col_ptr[c]) {
+            EXPECT_LT(block->idx[k-1], block->idx[k]);
+          }
+          num_entries[block->idx[k]]++;
+        }
+      }
+      for (index_t i = 0; i < kBlockSize; ++i) {
+        index_t id = block->Y[i];
+        index_t expected = 1;
+        for (index_t j = 1; j <= kFeatureNum; ++j) {
+          expected += id % (j + 1) == 0;
+        }
+        EXPECT_EQ(num_entries[i], expected);
+        ids.push_back(id);
+        mixed |= id / kBlockSize != (index_t)block->Y[0] / kBlockSize;
+      }
+    }
+    reader.GoToHead();
+    // The samples of the range are regrouped after the epoch 1 and 3.
+    EXPECT_EQ(mixed, e >= 2);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids.size(), 4 * kBlockSize);
+    for (size_t i = 0; i < ids.size(); ++i) {
+      EXPECT_EQ(ids[i], kBlockSize + i);
+    }
+  }
+  RemoveFile(kFilename.c_str());
+}
+
+TEST(DatasetTest, CompressColumns) {
+  const string kFilename = "/tmp/test_compress.txt";
+  const index_t kBlockSize = 50;
+  WriteSampleIds(kFilename, 6, kBlockSize);
+  // The stored blocks, the reblocked ones, and the resized ones.
+  for (int r = 0; r < 3; ++r) {
+    InmemReader reader;
+    reader.SetNumThreads(2);
+    reader.SetCompressColumns(true);
+    reader.SetReblockEpochs(r == 1 ? 1 : 0);
+    reader.Initialize(kFilename, kNumSamples, parser_lr, LR);
+    reader.SetBlockSize(r == 2 ? 75 : 0);
+    DMatrix* matrix = nullptr;
+    for (int e = 0; e < 3; ++e) {
+      vector<index_t> ids;
+      while (reader.Samples(matrix)) {
+        const ColumnBlock* block = matrix->block;
+        EXPECT_EQ(block->col_codecs != nullptr, r != 2);
+        for (index_t c = 0; c < block->num_columns; ++c) {
+          index_t j = block->col_ids[c];
+          index_t len = 0;
+          int64 last = -1;
+          ForEachEntry(*block, c, [&](index_t i, real_t x) {
+            index_t id = block->Y[i];
+            EXPECT_EQ(x, j == 0 ? (real_t)1.0 : (real_t)id);
+            EXPECT_EQ(id % (j + 1), 0);
+            EXPECT_LT(last, (int64)i);
+            last = i;
+            ++len;
+          });
+          EXPECT_EQ(len, block->col_ptr[c+1] - block->col_ptr[c]);
+        }
+        for (index_t i = 0; i < block->num_samples; ++i) {
+          ids.push_back(block->Y[i]);
+        }
+      }
+      reader.GoToHead();
+      std::sort(ids.begin(), ids.end());
+      ASSERT_EQ(ids.size(), 6 * kBlockSize);
+      for (size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(ids[i], i);
+      }
+    }
+  }
+  RemoveFile(kFilename.c_str());
+}
+
+// Each sample i of the blocks has the label (i % 4 == 0), and the
+// value i + 1 in the column 1, and in the column 2 if i is even.
+void WriteLabeledSamples(const string& filename,
+                         index_t num_blocks,
+                         index_t block_size) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t k = 0; k < num_blocks; ++k) {
+    string labels, col_1 = "1", col_2 = "2";
+    for (index_t i = 0; i < block_size; ++i) {
+      index_t id = k * block_size + i;
+      labels += id % 4 == 0 ? "1 " : "0 ";
+      col_1 += " " + std::to_string(i) + ":" + std::to_string(id + 1);
+      if (id % 2 == 0) {
+        col_2 += " " + std::to_string(i) + ":" + std::to_string(id + 1);
+      }
+    }
+    string block = "3\n" + labels + "\n" + col_1 + "\n" + col_2 + "\n";
+    WriteDataToDisk(file, block.c_str(), block.size());
+  }
+  WriteDataToDisk(file, "3\n", 2);
+  Close(file);
+}
+
+TEST(DatasetTest, DownsampleNegatives) {
+  const string kFilename = "/tmp/test_downsample.txt";
+  const index_t kBlockSize = 400;
+  const real_t kRate = 0.25;
+  WriteLabeledSamples(kFilename, 5, kBlockSize);
+  vector<index_t> first_ids;
+  for (int n = 0; n < 2; ++n) {
+    InmemReader reader;
+    reader.SetNumThreads(n + 2);
+    reader.SetShuffle(false, 7);
+    reader.SetNegativeRate(kRate);
+    reader.Initialize(kFilename, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    vector<index_t> ids;
+    index_t num_positives = 0;
+    real_t total_weight = 0;
+    while (reader.Samples(matrix)) {
+      const ColumnBlock* block = matrix->block;
+      ASSERT_TRUE(block->weights != nullptr);
+      ASSERT_EQ(block->num_columns, 3);
+      // Every sample is in the bias column and the column 1, and the
+      // sample indices are compacted.
+      EXPECT_EQ(block->col_ptr[1], block->num_samples);
+      EXPECT_EQ(block->col_ptr[2], 2 * block->num_samples);
+      for (index_t i = 0; i < block->num_samples; ++i) {
+        index_t id = block->X[block->col_ptr[1] + i] - 1;
+        EXPECT_EQ(block->idx[block->col_ptr[1] + i], i);
+        EXPECT_EQ(block->Y[i], id % 4 == 0 ? 1 : 0);
+        EXPECT_EQ(block->weights[i], id % 4 == 0 ? 1 : 1 / kRate);
+        num_positives += id % 4 == 0;
+        ids.push_back(id);
+      }
+      for (index_t k = block->col_ptr[2]; k < block->col_ptr[3]; ++k) {
+        index_t id = block->X[k] - 1;
+        EXPECT_EQ(id % 2, 0);
+        EXPECT_EQ(block->X[block->col_ptr[1] + block->idx[k]], block->X[k]);
+      }
+      total_weight += TotalWeight(*block);
+    }
+    // All the positive samples are kept.
+    EXPECT_EQ(num_positives, 5 * kBlockSize / 4);
+    EXPECT_NEAR(ids.size(), 5 * kBlockSize * (0.25 + 0.75 * kRate),
+                5 * kBlockSize * 0.05);
+    EXPECT_NEAR(total_weight, 5 * kBlockSize, 5 * kBlockSize * 0.2);
+    // The same seed keeps the same samples with any number of threads.
+    if (n == 0) {
+      first_ids = ids;
+    } else {
+      EXPECT_EQ(ids, first_ids);
+    }
+  }
+  RemoveFile(kFilename.c_str());
+}
+
+// Count the shards parsed by the Readers.
+class CountingReader : public InmemReader {
+ public:
+  static int num_loads;
+
+ protected:
+  virtual Dataset* LoadShard(const string& shard, int num_threads) {
+    ++num_loads;
+    return InmemReader::LoadShard(shard, num_threads);
+  }
+};
+
+int CountingReader::num_loads = 0;
+
+TEST_F(ReaderTest, ShareDerivedDataset) {
+  CountingReader::num_loads = 0;
+  // The Reader of all the samples, e.g., the one of the validation.
+  CountingReader all_reader;
+  all_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  // The downsampled and encoded folds are derived from the same parsed
+  // Dataset.
+  const int kNumFolds = 5;
+  for (int k = 0; k < kNumFolds; ++k) {
+    CountingReader fold_reader;
+    fold_reader.SetBlockRange(kNumBlocks * k / kNumFolds,
+                              kNumBlocks * (k + 1) / kNumFolds);
+    fold_reader.SetNegativeRate(0.5);
+    fold_reader.SetCompressColumns(true);
+    fold_reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    ASSERT_NE(fold_reader.Samples(matrix), 0);
+    EXPECT_TRUE(matrix->block->col_codecs != nullptr);
+  }
+  EXPECT_EQ(CountingReader::num_loads, 1);
+  // The Readers of the same range and settings share the derived
+  // blocks, and the Readers of another seed do not.
+  const uint64 kSeeds[] = { 7, 7, 8 };
+  const ColumnBlock* blocks[3];
+  scoped_ptr<CountingReader> readers[3];
+  for (int r = 0; r < 3; ++r) {
+    readers[r].reset(new CountingReader);
+    readers[r]->SetShuffle(false, kSeeds[r]);
+    readers[r]->SetBlockRange(2, 4);
+    readers[r]->SetNegativeRate(0.5);
+    readers[r]->Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+    DMatrix* matrix = nullptr;
+    ASSERT_NE(readers[r]->Samples(matrix), 0);
+    blocks[r] = matrix->block;
+  }
+  EXPECT_EQ(blocks[0], blocks[1]);
+  EXPECT_NE(blocks[0], blocks[2]);
+  EXPECT_EQ(CountingReader::num_loads, 1);
 }
 
 Reader* CreateReader(const char* format_name) {
@@ -199,6 +855,8 @@ Reader* CreateReader(const char* format_name) {
 TEST(READER_TEST, CreateReader) {
   EXPECT_TRUE(CreateReader("memory") != NULL);
   EXPECT_TRUE(CreateReader("disk") != NULL);
+  EXPECT_TRUE(CreateReader("mmap") != NULL);
+  EXPECT_TRUE(CreateReader("async") != NULL);
   EXPECT_TRUE(CreateReader("") == NULL);
   EXPECT_TRUE(CreateReader("unknow_name") == NULL);
 }
@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the entry of the row2column program, which converts the
+row-based data to the column-based data. For example:
+
+  row2column --input=train.txt --output=train_col.txt --block_size=1000
+*/
+
+#include <algorithm>
+#include <thread>
+
+#include "gflags/gflags.h"
+
+#include "src/base/common.h"
+#include "src/reader/transposer.h"
+
+DEFINE_string(input, "", "Filename of the row-based data.");
+
+DEFINE_string(output, "", "Filename of the column-based data.");
+
+DEFINE_int32(block_size, 1000, "Number of samples in each column block. "
+                               "It should be the same as the batch_size "
+                               "used in trainning. Default = 1000.");
+
+DEFINE_string(format, "libsvm", "Format of the input file, including: "
+                                "'libsvm', 'libffm' and 'csv'.");
+
+DEFINE_int32(num_threads, 0, "Number of threads used to transpose blocks. "
+                             "By default we use all the cores.");
+
+DEFINE_bool(binary, false, "Write the binary format (see binary_format.h) "
+                           "instead of the text format.");
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, false);
+
+  if (FLAGS_input.empty() || FLAGS_output.empty()) {
+    LOG(ERROR) << "Usage: row2column --input=train.txt "
+               << "--output=train_col.txt [--block_size=1000] "
+               << "[--format=libsvm] [--num_threads=4] [--binary]";
+    return -1;
+  }
+  if (FLAGS_block_size <= 0) {
+    LOG(ERROR) << "block_size must be greater than zero.";
+    return -1;
+  }
+
+  int num_threads = FLAGS_num_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  f2m::Transposer transposer;
+  transposer.Initialize(FLAGS_block_size,
+                        num_threads,
+                        FLAGS_format,
+                        FLAGS_binary);
+  uint64 num_samples = transposer.Transpose(FLAGS_input, FLAGS_output);
+
+  LOG(INFO) << "Convert " << num_samples << " samples from "
+            << FLAGS_input << " to " << FLAGS_output;
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the Tokenizer class.
+*/
+
+#include "src/reader/tokenizer.h"
+
+#include <string.h>
+
+namespace f2m {
+
+Tokenizer::Tokenizer(const std::string& splitor) {
+  memset(is_splitor_, 0, sizeof(is_splitor_));
+  for (size_t i = 0; i < splitor.size(); ++i) {
+    is_splitor_[static_cast<unsigned char>(splitor[i])] = true;
+  }
+  // Handle some txt format in windows or DOS.
+  is_splitor_[static_cast<unsigned char>('\r')] = true;
+  num_simd_splitors_ = 0;
+#if defined(__SSE2__)
+  int num_splitors = 0;
+  for (int c = 0; c < 256; ++c) {
+    if (is_splitor_[c]) {
+      ++num_splitors;
+    }
+  }
+  if (num_splitors <= kMaxSimdSplitors) {
+    for (int c = 0; c < 256; ++c) {
+      if (is_splitor_[c]) {
+        simd_splitors_[num_simd_splitors_++] =
+            _mm_set1_epi8(static_cast<char>(c));
+      }
+    }
+  }
+#endif
+}
+
+size_t CountChar(const char* begin, const char* end, char c) {
+  size_t count = 0;
+  const char* p = begin;
+#if defined(__SSE2__)
+  const __m128i target = _mm_set1_epi8(c);
+  while (p + 16 <= end) {
+    // Each byte of sum counts up to 255 matches.
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < 255 && p + 16 <= end; ++i, p += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      sum = _mm_sub_epi8(sum, _mm_cmpeq_epi8(chunk, target));
+    }
+    __m128i total = _mm_sad_epu8(sum, _mm_setzero_si128());
+    count += _mm_cvtsi128_si32(total) +
+             _mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == c) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+} // namespace f2m
@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the Tokenizer class and the number decoders, which
+are used to parse the text data in place without any memory allocation.
+*/
+
+#ifndef F2M_READER_TOKENIZER_H_
+#define F2M_READER_TOKENIZER_H_
+
+#include <stdlib.h>
+
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// Tokenizer splits a line into tokens by the splitors (and '\r').
+// When there are no more than kMaxSimdSplitors splitors, we compare
+// 16 bytes at a time using SSE2. We can use it like this:
+//
+//   Tokenizer tokenizer(" ");
+//   const char* t = tokenizer.NextToken(p, eol);
+//   while (p != t) {
+//     // [p, t) is a token
+//     p = t;
+//     t = tokenizer.NextToken(p, eol);
+//   }
+//------------------------------------------------------------------------------
+class Tokenizer {
+ public:
+  explicit Tokenizer(const std::string& splitor);
+  ~Tokenizer() {  }
+
+  // Skip the splitors from p, and then return the end of the token,
+  // which is the first splitor after p or eol.
+  inline const char* NextToken(const char* &p, const char* eol) const {
+    while (p != eol && is_splitor_[static_cast<unsigned char>(*p)]) {
+      ++p;
+    }
+    const char* end = p;
+#if defined(__SSE2__)
+    if (num_simd_splitors_ > 0) {
+      // Never load bytes after eol.
+      while (end + 16 <= eol) {
+        __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(end));
+        __m128i hit = _mm_cmpeq_epi8(chunk, simd_splitors_[0]);
+        for (int i = 1; i < num_simd_splitors_; ++i) {
+          hit = _mm_or_si128(hit, _mm_cmpeq_epi8(chunk, simd_splitors_[i]));
+        }
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+          return end + __builtin_ctz(mask);
+        }
+        end += 16;
+      }
+    }
+#endif
+    while (end != eol && !is_splitor_[static_cast<unsigned char>(*end)]) {
+      ++end;
+    }
+    return end;
+  }
+
+ private:
+  static const int kMaxSimdSplitors = 4;
+
+  bool is_splitor_[256];
+  int num_simd_splitors_;
+#if defined(__SSE2__)
+  __m128i simd_splitors_[kMaxSimdSplitors];
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(Tokenizer);
+};
+
+// Count the character c in [begin, end).
+size_t CountChar(const char* begin, const char* end, char c);
+
+// Return atoi() and atof() of the token [begin, end). The text is
+// parsed in place (e.g., in a mmap of the file), where the token is not
+// followed by a '\0', so we call them on a copy of the token. They are
+// only the fallbacks of the decoders below, and a short token does not
+// allocate any memory.
+inline int TokenToInt(const char* begin, const char* end) {
+  return atoi(std::string(begin, end).c_str());
+}
+
+inline double TokenToReal(const char* begin, const char* end) {
+  return atof(std::string(begin, end).c_str());
+}
+
+// Decode the unsigned integer [begin, end). The result is the same
+// as atoi() of the token, and we fall back to atoi() if the token is
+// not a plain number of up to 9 digits.
+inline index_t DecodeIndex(const char* begin, const char* end) {
+  if (begin == end || end - begin > 9) {
+    return TokenToInt(begin, end);
+  }
+  index_t value = 0;
+  for (const char* p = begin; p != end; ++p) {
+    unsigned digit = static_cast<unsigned char>(*p) - '0';
+    if (digit > 9) {
+      return TokenToInt(begin, end);
+    }
+    value = value * 10 + digit;
+  }
+  return value;
+}
+
+// Decode the real number [begin, end) as [+-]digits[.digits]. If the
+// mantissa is not greater than 2^53 and there are no more than 22
+// fraction digits, both the mantissa and 10^k are exact doubles, and
+// one division gives the correctly rounded result, which is the same
+// as what atof() returns. Otherwise (exponent, inf, nan, too many
+// digits, ...), we fall back to atof() of the token.
+inline real_t DecodeReal(const char* begin, const char* end) {
+  static const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  const char* start = p;
+  uint64 mantissa = 0;
+  int num_digits = 0;
+  int num_fraction = -1;
+  for (; p != end; ++p) {
+    unsigned digit = static_cast<unsigned char>(*p) - '0';
+    if (digit <= 9) {
+      // Leading zeros are not counted.
+      if (mantissa != 0 || digit != 0) {
+        ++num_digits;
+      }
+      mantissa = mantissa * 10 + digit;
+      if (num_fraction >= 0) {
+        ++num_fraction;
+      }
+    } else if (*p == '.' && num_fraction < 0) {
+      num_fraction = 0;
+    } else {
+      break;
+    }
+  }
+  // Other characters, no digit, or not exact.
+  if (p != end ||
+      p - start == (num_fraction >= 0 ? 1 : 0) ||
+      num_digits > 19 ||
+      mantissa > (1ULL << 53) ||
+      num_fraction > 22) {
+    return TokenToReal(begin, end);
+  }
+  double value = static_cast<double>(mantissa);
+  if (num_fraction > 0) {
+    value /= kPow10[num_fraction];
+  }
+  return negative ? -value : value;
+}
+
+} // namespace f2m
+
+#endif // F2M_READER_TOKENIZER_H_
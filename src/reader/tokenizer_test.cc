@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests tokenizer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/reader/tokenizer.h"
+
+using std::string;
+using std::vector;
+
+namespace f2m {
+
+vector<string> Tokens(const Tokenizer& tokenizer, const string& line) {
+  vector<string> tokens;
+  const char* p = line.data();
+  const char* eol = p + line.size();
+  for (const char* t = tokenizer.NextToken(p, eol); p != t;
+       p = t, t = tokenizer.NextToken(p, eol)) {
+    tokens.push_back(string(p, t - p));
+  }
+  return tokens;
+}
+
+TEST(TOKENIZER_TEST, NextToken) {
+  Tokenizer tokenizer(" ");
+  vector<string> tokens = Tokens(tokenizer,
+      "  12 0:0.5 1:1   1234567890123456789:3 abc\r");
+  ASSERT_EQ(tokens.size(), 5);
+  EXPECT_EQ(tokens[0], "12");
+  EXPECT_EQ(tokens[2], "1:1");
+  EXPECT_EQ(tokens[3], "1234567890123456789:3");
+  EXPECT_EQ(tokens[4], "abc");
+  EXPECT_TRUE(Tokens(tokenizer, "   ").empty());
+  // More splitors than kMaxSimdSplitors.
+  Tokenizer many(",;| \t");
+  tokens = Tokens(many, "a,b;c|d e\tf,,0123456789abcdefghij");
+  ASSERT_EQ(tokens.size(), 7);
+  EXPECT_EQ(tokens[5], "f");
+  EXPECT_EQ(tokens[6], "0123456789abcdefghij");
+}
+
+TEST(TOKENIZER_TEST, CountChar) {
+  string str;
+  size_t count = 0;
+  std::mt19937 rng(0);
+  for (int i = 0; i < 10000; ++i) {
+    char c = "0123:. "[rng() % 7];
+    str.push_back(c);
+    count += c == ':';
+  }
+  EXPECT_EQ(CountChar(str.data(), str.data() + str.size(), ':'), count);
+  EXPECT_EQ(CountChar(str.data() + 3, str.data() + 3, ':'), 0);
+  EXPECT_EQ(CountChar(str.data() + 1, str.data() + 20, ':'),
+            std::count(str.begin() + 1, str.begin() + 20, ':'));
+}
+
+TEST(TOKENIZER_TEST, DecodeIndex) {
+  const char* str[] = { "0", "7", "12", "999999999", "1234567890",
+                        "+5", "-3", "12a", "" };
+  for (size_t i = 0; i < sizeof(str) / sizeof(str[0]); ++i) {
+    EXPECT_EQ(DecodeIndex(str[i], str[i] + strlen(str[i])),
+              (index_t)atoi(str[i])) << str[i];
+  }
+}
+
+void ExpectSameAsAtof(const string& str) {
+  real_t a = DecodeReal(str.data(), str.data() + str.size());
+  real_t b = atof(str.c_str());
+  EXPECT_EQ(memcmp(&a, &b, sizeof(real_t)), 0) << str;
+}
+
+TEST(TOKENIZER_TEST, DecodeReal) {
+  const char* str[] = { "0", "1", "-1", "+1", "0.5", "-0", "-0.0", "1.",
+                        ".5", "-.5", ".", "-", "", "0.123", "1e-5", "2E3",
+                        "inf", "-nan", "0x1p3", "1.5abc", "0000000001.25",
+                        "123456789012345678901234567890",
+                        "0.1234567890123456789012345",
+                        "9007199254740993", "3.4028235e38", "1e-50" };
+  for (size_t i = 0; i < sizeof(str) / sizeof(str[0]); ++i) {
+    ExpectSameAsAtof(str[i]);
+  }
+  // Random values printed in the formats of the data files.
+  std::mt19937_64 rng(2016);
+  char buf[64];
+  for (int i = 0; i < 100000; ++i) {
+    double value = (rng() % 2000001) / 1000.0 - 1000.0;
+    snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(rng() % 10), value);
+    ExpectSameAsAtof(buf);
+    snprintf(buf, sizeof(buf), "%.*g", static_cast<int>(rng() % 18 + 1),
+             std::ldexp(static_cast<double>(rng() >> 11), -40));
+    ExpectSameAsAtof(buf);
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(rng() >> (rng() % 64)));
+    ExpectSameAsAtof(buf);
+  }
+}
+
+// The fallbacks stop at the end of the token, even if the text after
+// it could continue the number.
+TEST(TOKENIZER_TEST, DecodeUnterminated) {
+  const char buf[] = "+1234 12345678901 1e5 0x1p3";
+  EXPECT_EQ(DecodeIndex(buf, buf + 3), 12);
+  EXPECT_EQ(DecodeIndex(buf + 6, buf + 16), 1234567890);
+  EXPECT_EQ(DecodeReal(buf + 18, buf + 20), 1.0);
+  EXPECT_EQ(DecodeReal(buf + 22, buf + 24), 0.0);
+  EXPECT_EQ(TokenToInt(buf + 1, buf + 3), 12);
+  EXPECT_EQ(TokenToReal(buf + 18, buf + 21), 1e5);
+}
+
+} // namespace f2m
@@ -0,0 +1,371 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file is the implementation of the Transposer class.
+*/
+
+#include "src/reader/transposer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/reader/binary_format.h"
+#include "src/reader/metadata.h"
+#include "src/reader/tokenizer.h"
+
+namespace f2m {
+
+void Transposer::Initialize(index_t block_size,
+                            int num_threads,
+                            const std::string& format,
+                            bool binary) {
+  CHECK_GT(block_size, 0);
+  CHECK_GT(num_threads, 0);
+  if (format != "libsvm" && format != "libffm" && format != "csv") {
+    LOG(FATAL) << "Unknown file format: " << format;
+  }
+  is_ffm_ = format == "libffm";
+  is_csv_ = format == "csv";
+  block_size_ = block_size;
+  num_threads_ = num_threads;
+  binary_ = binary;
+}
+
+size_t Transposer::ReadBlock(FILE* file, Block* block) {
+  char* line = nullptr;
+  size_t line_size = 0;
+  ssize_t len = 0;
+  if (block->lines.size() < block_size_) {
+    block->lines.resize(block_size_);
+  }
+  block->num_lines = 0;
+  while (block->num_lines < block_size_ &&
+         (len = getline(&line, &line_size, file)) != -1) {
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+      --len;
+    }
+    if (len == 0) {
+      continue;
+    }
+    block->lines[block->num_lines++].assign(line, len);
+  }
+  free(line);
+  return block->num_lines;
+}
+
+// Skip the blanks and return the end of the token, which also ends at
+// the sep (e.g., the ',' of a csv line).
+static inline const char* NextToken(const char* &p, char sep = ' ') {
+  while (*p == ' ' || *p == '\t') {
+    ++p;
+  }
+  const char* end = p;
+  while (*end != '\0' && *end != ' ' && *end != '\t' && *end != sep) {
+    ++end;
+  }
+  return end;
+}
+
+// The j-th value of a csv line is the feature j. An empty value (e.g.,
+// "1,,2") is zero.
+void Transposer::TransposeCSVLine(index_t sample,
+                                  const char* p,
+                                  char sep,
+                                  std::vector<Entry>* entries) {
+  for (index_t id = 1; ; ++id) {
+    if (sep != ' ') {
+      while (*p == ' ' || *p == '\t') {
+        ++p;
+      }
+      if (*p != sep) {
+        break;
+      }
+      ++p;
+    }
+    const char* end = NextToken(p, sep);
+    if (sep == ' ' && p == end) {
+      break;
+    }
+    if (p != end && DecodeReal(p, end) != 0) {
+      Entry entry;
+      entry.id = id;
+      entry.field = 0;
+      entry.sample = sample;
+      entry.value = p;
+      entry.value_len = end - p;
+      entries->push_back(entry);
+    }
+    p = end;
+  }
+}
+
+// Only the dense columns of csv have zeros.
+void Transposer::AppendZeros(index_t end,
+                                index_t* sample,
+                                std::string* columns) {
+  if (!is_csv_) {
+    return;
+  }
+  for (; *sample < end; ++*sample) {
+    columns->append("0 ");
+  }
+}
+
+void Transposer::TransposeBlock(Block* block) {
+  std::vector<Entry>& entries = block->entries;
+  entries.clear();
+  block->text.clear();
+  block->max_length = 1;
+  // Parse the rows
+  std::string labels;
+  block->Y.clear();
+  for (size_t i = 0; i < block->num_lines; ++i) {
+    const char* p = block->lines[i].c_str();
+    // The values of a csv line are separated by commas or blanks.
+    char sep = is_csv_ && strchr(p, ',') != nullptr ? ',' : ' ';
+    const char* end = NextToken(p, sep);
+    // Label
+    if (binary_) {
+      block->Y.push_back(DecodeReal(p, end));
+    } else {
+      if (i != 0) {
+        labels.append(" ");
+      }
+      labels.append(p, end - p);
+    }
+    p = end;
+    if (is_csv_) {
+      TransposeCSVLine(i, p, sep, &entries);
+      continue;
+    }
+    // Features
+    for (end = NextToken(p); p != end; p = end, end = NextToken(p)) {
+      const char* colon =
+          reinterpret_cast<const char*>(memchr(p, ':', end - p));
+      Entry entry;
+      entry.field = 0;
+      if (colon != nullptr && is_ffm_) {
+        entry.field = strtoul(p, nullptr, 10);
+        p = colon + 1;
+        colon = reinterpret_cast<const char*>(memchr(p, ':', end - p));
+      }
+      if (colon == nullptr) {
+        LOG(FATAL) << "Invalid format of line: " << block->lines[i];
+      }
+      entry.id = strtoul(p, nullptr, 10);
+      entry.sample = i;
+      entry.value = colon + 1;
+      entry.value_len = end - entry.value;
+      if (entry.id == 0) {
+        LOG(FATAL) << "Feature id 0 is reserved for the bias, "
+                   << "the feature id must start from 1.";
+      }
+      if (DecodeReal(entry.value, end) == 0) {
+        continue;
+      }
+      entries.push_back(entry);
+    }
+  }
+  // Group the entries by column. The stable sort keeps the sample order
+  // in each column.
+  std::stable_sort(entries.begin(), entries.end(),
+    [](const Entry& a, const Entry& b) { return a.id < b.id; });
+  // If a feature appears twice in a row, we keep the last one.
+  size_t nnz = 0;
+  for (size_t k = 0; k < entries.size(); ++k) {
+    if (k + 1 < entries.size() &&
+        entries[k+1].id == entries[k].id &&
+        entries[k+1].sample == entries[k].sample) {
+      continue;
+    }
+    entries[nnz++] = entries[k];
+  }
+  entries.resize(nnz);
+  // A feature of libffm must be in one field.
+  for (size_t k = 1; k < entries.size(); ++k) {
+    if (entries[k].id == entries[k-1].id &&
+        entries[k].field != entries[k-1].field) {
+      LOG(FATAL) << "Feature " << entries[k].id << " is in both field "
+                 << entries[k-1].field << " and field " << entries[k].field;
+    }
+  }
+  block->nnz = block->num_lines + nnz;
+  if (!entries.empty()) {
+    block->max_length = entries.back().id + 1;
+  }
+  // Write the columns. The first column is the bias.
+  if (binary_) {
+    block->col_ids.assign(1, 0);
+    block->col_fields.assign(is_ffm_ ? 1 : 0, 0);
+    block->col_ptr.assign(1, 0);
+    block->idx.resize(block->num_lines);
+    block->X.assign(block->num_lines, 1.0);
+    for (size_t i = 0; i < block->num_lines; ++i) {
+      block->idx[i] = i;
+    }
+    block->col_ptr.push_back(block->idx.size());
+    for (size_t k = 0; k < entries.size(); ++k) {
+      if (entries[k].id != block->col_ids.back()) {
+        block->col_ids.push_back(entries[k].id);
+        if (is_ffm_) {
+          block->col_fields.push_back(entries[k].field);
+        }
+        block->col_ptr.push_back(block->idx.size());
+      }
+      block->idx.push_back(entries[k].sample);
+      block->X.push_back(DecodeReal(entries[k].value,
+                                    entries[k].value + entries[k].value_len));
+      block->col_ptr.back() = block->idx.size();
+    }
+  } else {
+    std::string columns;
+    index_t num_columns = 0;
+    index_t sample = 0;
+    for (size_t k = 0; k < entries.size(); ++k) {
+      if (k == 0 || entries[k].id != entries[k-1].id) {
+        if (k != 0) {
+          AppendZeros(block->num_lines, &sample, &columns);
+          columns.append("\n");
+        }
+        if (is_ffm_) {
+          columns.append(std::to_string(entries[k].field));
+          columns.append(":");
+        }
+        columns.append(std::to_string(entries[k].id));
+        columns.append(" ");
+        ++num_columns;
+        sample = 0;
+      }
+      if (is_csv_) {
+        // The dense column gives a value for each sample.
+        AppendZeros(entries[k].sample, &sample, &columns);
+        ++sample;
+      } else {
+        columns.append(std::to_string(entries[k].sample));
+        columns.append(":");
+      }
+      columns.append(entries[k].value, entries[k].value_len);
+      columns.append(" ");
+    }
+    if (num_columns > 0) {
+      AppendZeros(block->num_lines, &sample, &columns);
+      columns.append("\n");
+    }
+    block->text.append(std::to_string(num_columns + 1));
+    block->text.append("\n");
+    block->text.append(labels);
+    block->text.append("\n");
+    block->text.append(columns);
+  }
+}
+
+uint64 Transposer::Transpose(const std::string& input_file,
+                             const std::string& output_file) {
+  FILE* input = OpenFileOrDie(input_file.c_str(), "r");
+  FILE* output = nullptr;
+  BinaryWriter writer;
+  if (binary_) {
+    if (!writer.Open(output_file)) {
+      LOG(FATAL) << "Cannot open file: " << output_file;
+    }
+  } else {
+    output = OpenFileOrDie(output_file.c_str(), "w");
+  }
+  std::vector<Block> blocks(num_threads_);
+  uint64 num_samples = 0;
+  index_t max_length = 1;
+  DatasetMeta meta;
+  bool end = false;
+  while (!end) {
+    // Read one block for each thread.
+    size_t num_blocks = 0;
+    for (; num_blocks < blocks.size(); ++num_blocks) {
+      if (ReadBlock(input, &blocks[num_blocks]) < block_size_) {
+        end = true;
+        if (blocks[num_blocks].num_lines > 0) {
+          ++num_blocks;
+        }
+        break;
+      }
+    }
+    // Transpose the blocks in parallel.
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_blocks; ++i) {
+      threads.push_back(std::thread(&Transposer::TransposeBlock,
+                                    this, &blocks[i]));
+    }
+    if (num_blocks > 0) {
+      TransposeBlock(&blocks[0]);
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].join();
+    }
+    // Write the blocks in order.
+    for (size_t i = 0; i < num_blocks; ++i) {
+      Block& block = blocks[i];
+      num_samples += block.num_lines;
+      max_length = std::max(max_length, block.max_length);
+      meta.num_blocks++;
+      meta.nnz += block.nnz;
+      if (binary_) {
+        ColumnBlock view;
+        view.num_samples = block.Y.size();
+        view.num_columns = block.col_ids.size();
+        view.nnz = block.idx.size();
+        view.Y = block.Y.data();
+        view.col_ids = block.col_ids.data();
+        view.col_ptr = block.col_ptr.data();
+        view.idx = block.idx.data();
+        view.X = block.X.data();
+        view.col_fields = is_ffm_ ? block.col_fields.data() : nullptr;
+        view.weights = nullptr;
+        view.col_codecs = nullptr;
+        view.col_offsets = nullptr;
+        view.packed = nullptr;
+        view.num_categorical = 0;
+        view.categorical = nullptr;
+        writer.WriteBlock(view);
+      } else {
+        WriteDataToDisk(output, block.text.data(), block.text.size());
+      }
+    }
+  }
+  if (binary_) {
+    writer.Close();
+  } else {
+    std::string last_line = std::to_string(max_length) + "\n";
+    WriteDataToDisk(output, last_line.data(), last_line.size());
+    Close(output);
+  }
+  Close(input);
+  meta.max_feature = max_length - 1;
+  meta.num_samples = num_samples;
+  if (!WriteMetadata(output_file, meta)) {
+    LOG(WARNING) << "Cannot write the metadata of " << output_file;
+  }
+  return num_samples;
+}
+
+} // namespace f2m
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file defines the Transposer class, which converts the row-based
+data (libsvm, libffm or csv) to the column-based blocks used by f2m.
+*/
+
+#ifndef F2M_READER_TRANSPOSER_H_
+#define F2M_READER_TRANSPOSER_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace f2m {
+
+//------------------------------------------------------------------------------
+// Transposer streams a row-based file and writes every block_size rows
+// as a column block. The text output is the same as tools/row2column.py:
+//
+//   3                     <- number of lines in this block
+//   1 0 1                 <- Y of each sample
+//   3 0:0.5 2:0.25        <- column id, then sample_idx:value
+//   7 1:1.5
+//   ...                   <- more blocks
+//   8                     <- max feature id + 1
+//
+// and the binary output is the format defined in binary_format.h.
+// Columns are sorted by id, and zero values are dropped. The feature
+// id 0 is reserved for the bias, so the input ids must start from 1.
+// For the libffm format, each column line starts with field:id instead
+// of id, and a feature must be in only one field. For the csv format,
+// whose lines are [y,value,value,...] (or separated by blanks), the j-th
+// value is the feature j, and each column line is dense:
+//
+//   3 0.5 0 0.25          <- column id, then the value of each sample
+//
+// which is parsed by the CSVParser without any sample index.
+//
+// Blocks are transposed in parallel. Each thread holds one block, so
+// we keep at most num_threads blocks in memory. We can use it like this:
+//
+//   Transposer transposer;
+//   transposer.Initialize(block_size = 1000,
+//                         num_threads = 4,
+//                         format = "libsvm",
+//                         binary = false);
+//   transposer.Transpose("/tmp/train.txt", "/tmp/train_col.txt");
+//
+// The metadata of the output (see metadata.h) is written next to it.
+//------------------------------------------------------------------------------
+class Transposer {
+ public:
+  Transposer() : block_size_(1000), num_threads_(1),
+                 is_ffm_(false), is_csv_(false), binary_(false) {  }
+  ~Transposer() {  }
+
+  // format can be 'libsvm', 'libffm' or 'csv'.
+  void Initialize(index_t block_size,
+                  int num_threads,
+                  const std::string& format,
+                  bool binary);
+
+  // Convert input_file to output_file. Return the number of samples.
+  uint64 Transpose(const std::string& input_file,
+                   const std::string& output_file);
+
+ protected:
+  // A non-zero entry of a block.
+  struct Entry {
+    index_t id;
+    index_t field;
+    index_t sample;
+    const char* value;
+    uint32 value_len;
+  };
+
+  // One block of rows and its column-based result.
+  struct Block {
+    std::vector<std::string> lines;
+    size_t num_lines;
+    index_t max_length;
+    uint64 nnz;
+    std::vector<Entry> entries;
+    // Text output
+    std::string text;
+    // Binary output
+    std::vector<real_t> Y;
+    std::vector<index_t> col_ids;
+    std::vector<index_t> col_fields;
+    std::vector<index_t> col_ptr;
+    std::vector<index_t> idx;
+    std::vector<real_t> X;
+  };
+
+  index_t block_size_;
+  int num_threads_;
+  bool is_ffm_;
+  bool is_csv_;
+  bool binary_;
+
+  // Read at most block_size_ lines. Return the number of lines.
+  size_t ReadBlock(FILE* file, Block* block);
+
+  // Transpose the rows of a block.
+  void TransposeBlock(Block* block);
+
+  // Add the non-zero values of a csv line, which start from p, to the
+  // entries of the sample.
+  void TransposeCSVLine(index_t sample,
+                        const char* p,
+                        char sep,
+                        std::vector<Entry>* entries);
+
+  // Append a zero for each sample in [*sample, end) of a dense column
+  // of the csv format. It does nothing for the other formats.
+  void AppendZeros(index_t end, index_t* sample, std::string* columns);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Transposer);
+};
+
+} // namespace f2m
+
+#endif // F2M_READER_TRANSPOSER_H_
@@ -0,0 +1,224 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests transposer.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/reader/binary_format.h"
+#include "src/reader/metadata.h"
+#include "src/reader/parser.h"
+#include "src/reader/transposer.h"
+
+using std::string;
+using std::vector;
+
+namespace f2m {
+
+const string kRowFile = "/tmp/test_transposer_row.txt";
+const string kColumnFile = "/tmp/test_transposer_col.txt";
+
+void WriteString(const string& filename, const string& data) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, data.c_str(), data.size());
+  Close(file);
+}
+
+string ReadString(const string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  string data(GetFileSize(file), ' ');
+  ReadDataFromDisk(file, &data[0], data.size());
+  Close(file);
+  return data;
+}
+
+// The same output as tools/row2column.py with block_size = 2.
+const string kRows = "1 3:0.5 1:2\n"
+                     "0 2:1 3:0\n"
+                     "\n"
+                     "1 3:1.5\n";
+const string kColumns = "4\n"
+                        "1 0\n"
+                        "1 0:2 \n"
+                        "2 1:1 \n"
+                        "3 0:0.5 \n"
+                        "2\n"
+                        "1\n"
+                        "3 0:1.5 \n"
+                        "4\n";
+
+// The libffm data of kRows gives each column line a field.
+const string kFFMColumns = "4\n"
+                           "1 0\n"
+                           "1:1 0:2 \n"
+                           "0:2 1:1 \n"
+                           "0:3 0:0.5 \n"
+                           "2\n"
+                           "1\n"
+                           "1:3 0:1.5 \n"
+                           "4\n";
+
+// The csv lines can be separated by commas or blanks, and an empty
+// value is zero.
+const string kCSVRows = "1,0.5,0,2\n"
+                        "0, ,1.5,\n"
+                        "1 0 0 3\n";
+const string kCSVColumns = "4\n"
+                           "1 0\n"
+                           "1 0.5 0 \n"
+                           "2 0 1.5 \n"
+                           "3 2 0 \n"
+                           "2\n"
+                           "1\n"
+                           "3 3 \n"
+                           "4\n";
+
+TEST(TRANSPOSER_TEST, Text) {
+  WriteString(kRowFile, kRows);
+  for (int num_threads = 1; num_threads <= 3; ++num_threads) {
+    Transposer transposer;
+    transposer.Initialize(2, num_threads, "libsvm", false);
+    EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+    EXPECT_EQ(ReadString(kColumnFile), kColumns);
+  }
+  // libffm
+  WriteString(kRowFile, "1 0:3:0.5 1:1:2\n"
+                        "0 0:2:1 1:3:0\n"
+                        "1 1:3:1.5\n");
+  Transposer transposer;
+  transposer.Initialize(2, 2, "libffm", false);
+  EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+  EXPECT_EQ(ReadString(kColumnFile), kFFMColumns);
+  // metadata
+  DatasetMeta meta;
+  EXPECT_TRUE(ReadMetadata(kColumnFile, &meta));
+  EXPECT_EQ(meta.max_feature, 3);
+  EXPECT_EQ(meta.num_blocks, 2);
+  EXPECT_EQ(meta.num_samples, 3);
+  EXPECT_EQ(meta.nnz, 7);
+  RemoveFile(kRowFile.c_str());
+  RemoveFile(kColumnFile.c_str());
+  RemoveFile((kColumnFile + kMetadataSuffix).c_str());
+}
+
+TEST(TRANSPOSER_TEST, ParseFieldsAndDenseColumns) {
+  // libffm
+  WriteString(kRowFile, "1 0:3:0.5 1:1:2\n"
+                        "0 0:2:1 1:3:0\n"
+                        "1 1:3:1.5\n");
+  Transposer transposer;
+  transposer.Initialize(2, 1, "libffm", false);
+  EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+  string text = ReadString(kColumnFile);
+  FFMParser ffm_parser;
+  ColumnArena arena;
+  ffm_parser.ParseBlock(text.data(), text.data() + text.find("\n2\n"),
+                        &arena);
+  const ColumnBlock& block = arena.block;
+  EXPECT_EQ(block.num_samples, 2);
+  EXPECT_EQ(block.num_columns, 4);
+  EXPECT_EQ(block.nnz, 5);
+  ASSERT_TRUE(block.col_fields != nullptr);
+  EXPECT_EQ(vector<index_t>(block.col_ids, block.col_ids + 4),
+            vector<index_t>({0, 1, 2, 3}));
+  EXPECT_EQ(vector<index_t>(block.col_fields, block.col_fields + 4),
+            vector<index_t>({0, 1, 0, 0}));
+  EXPECT_EQ(block.X[4], (real_t)0.5);
+  // csv
+  WriteString(kRowFile, kCSVRows);
+  transposer.Initialize(2, 1, "csv", false);
+  EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+  text = ReadString(kColumnFile);
+  EXPECT_EQ(text, kCSVColumns);
+  CSVParser csv_parser;
+  csv_parser.ParseBlock(text.data(), text.data() + text.find("\n2\n"),
+                        &arena);
+  // The same block as the libsvm one.
+  EXPECT_EQ(block.num_columns, 4);
+  EXPECT_EQ(block.nnz, 5);
+  EXPECT_TRUE(block.col_fields == nullptr);
+  EXPECT_EQ(vector<index_t>(block.col_ptr, block.col_ptr + 5),
+            vector<index_t>({0, 2, 3, 4, 5}));
+  EXPECT_EQ(vector<index_t>(block.idx, block.idx + 5),
+            vector<index_t>({0, 1, 0, 1, 0}));
+  EXPECT_EQ(vector<real_t>(block.X, block.X + 5),
+            vector<real_t>({1, 1, 0.5, 1.5, 2}));
+  // The zero values do not hold space in the arena.
+  EXPECT_EQ(arena.idx.capacity(), 5);
+  EXPECT_EQ(arena.X.capacity(), 5);
+  RemoveFile(kRowFile.c_str());
+  RemoveFile(kColumnFile.c_str());
+  RemoveFile((kColumnFile + kMetadataSuffix).c_str());
+}
+
+TEST(TRANSPOSER_TEST, Binary) {
+  WriteString(kRowFile, kRows);
+  Transposer transposer;
+  transposer.Initialize(2, 2, "libsvm", true);
+  EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+  BinaryFile file;
+  EXPECT_TRUE(file.Open(kColumnFile));
+  EXPECT_EQ(file.NumBlocks(), 2);
+  EXPECT_EQ(file.Header().num_samples, 3);
+  EXPECT_EQ(file.Header().max_feature, 3);
+  const ColumnBlock& block = file.Block(0);
+  EXPECT_EQ(block.num_samples, 2);
+  EXPECT_EQ(block.num_columns, 4);
+  EXPECT_EQ(block.nnz, 5);
+  EXPECT_EQ(block.Y[0], (real_t)1);
+  EXPECT_EQ(block.Y[1], (real_t)0);
+  // bias
+  EXPECT_EQ(block.col_ids[0], 0);
+  EXPECT_EQ(block.col_ptr[1], 2);
+  EXPECT_EQ(block.X[1], (real_t)1.0);
+  // column 3
+  EXPECT_EQ(block.col_ids[3], 3);
+  EXPECT_EQ(block.col_ptr[3], 4);
+  EXPECT_EQ(block.idx[4], 0);
+  EXPECT_EQ(block.X[4], (real_t)0.5);
+  EXPECT_EQ(file.Block(1).num_columns, 2);
+  EXPECT_EQ(file.Block(1).X[1], (real_t)1.5);
+  EXPECT_TRUE(block.col_fields == nullptr);
+  DatasetMeta meta;
+  EXPECT_TRUE(ReadMetadata(kColumnFile, &meta));
+  EXPECT_EQ(meta.nnz, file.Header().nnz);
+  file.Close();
+  // The fields of libffm are stored after X.
+  WriteString(kRowFile, "1 0:3:0.5 1:1:2\n"
+                        "0 0:2:1 1:3:0\n"
+                        "1 1:3:1.5\n");
+  transposer.Initialize(2, 2, "libffm", true);
+  EXPECT_EQ(transposer.Transpose(kRowFile, kColumnFile), 3);
+  EXPECT_TRUE(file.Open(kColumnFile));
+  ASSERT_TRUE(file.Block(0).col_fields != nullptr);
+  EXPECT_EQ(file.Block(0).col_fields[1], 1);
+  EXPECT_EQ(file.Block(0).col_fields[3], 0);
+  EXPECT_EQ(file.Block(0).X[4], (real_t)0.5);
+  EXPECT_EQ(file.Block(1).col_fields[1], 1);
+  RemoveFile(kRowFile.c_str());
+  RemoveFile(kColumnFile.c_str());
+  RemoveFile((kColumnFile + kMetadataSuffix).c_str());
+}
+
+} // namespace f2m
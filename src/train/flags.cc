@@ -26,7 +26,9 @@ This file defines flags used by f2m to accept instructions.
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <set>
+#include <thread>
 
 #include "src/base/common.h"
 #include "src/base/stringprintf.h"
@@ -96,9 +98,81 @@ DEFINE_bool(f2m_in_memory_trainning, true, "Trainning model in memory or on "
                                            "disk. By default we set this flag "
                                            "to true for in-memory trainning.");
 
+DEFINE_bool(f2m_binary_cache, true, "Convert the text file to a binary file at "
+                                     "the first run, and map the binary file "
+                                     "into memory in later runs. Only used by "
+                                     "in-memory trainning. By default we set "
+                                     "this flag to true.");
+
+DEFINE_string(f2m_shared_dataset, "", "Name of the shared dataset. The parsed "
+                                      "data is published to the shared "
+                                      "memory by the first job, and the "
+                                      "other jobs of the same name map it "
+                                      "read-only. Only used by in-memory "
+                                      "trainning. By default we set this "
+                                      "flag to empty (not shared).");
+
+DEFINE_bool(f2m_direct_io, false, "Read the blocks of the binary file (or the "
+                                  "binary cache of the text file) by io_uring "
+                                  "with O_DIRECT in on-disk trainning. By "
+                                  "default we set this flag to false.");
+
+DEFINE_int32(f2m_io_queue_depth, 16, "Number of blocks read ahead when using "
+                                     "direct_io. We set this flag to 16 by "
+                                     "default.");
+
+DEFINE_int32(f2m_block_cache_size, 0, "Memory budget (MB) of the block cache "
+                                     "when using direct_io. The least "
+                                     "recently used blocks are evicted and "
+                                     "read again from disk. By default we "
+                                     "set this flag to 0 (no cache).");
+
+DEFINE_bool(f2m_shuffle, true, "Shuffle the order of the blocks at each "
+                               "epoch. Not used by on-disk trainning "
+                               "without direct_io. By default we set this "
+                               "flag to true.");
+
+DEFINE_int32(f2m_shuffle_seed, 0, "Seed of the block shuffling. The same "
+                                  "seed gives the same orders of the "
+                                  "epochs. We set this flag to 0 by "
+                                  "default.");
+
+DEFINE_int32(f2m_reblock_epochs, 0, "Regroup the samples into new blocks "
+                                    "every N epochs in in-memory "
+                                    "trainning, so the mini-batches are "
+                                    "different between epochs. By default "
+                                    "we set this flag to 0 (never).");
+
+DEFINE_double(f2m_negative_rate, 1.0, "Keep this fraction of the negative "
+                                      "samples of the trainning set when "
+                                      "it is loaded in in-memory "
+                                      "trainning, and weight the kept ones "
+                                      "so the loss stays calibrated. By "
+                                      "default we set this flag to 1.0 "
+                                      "(keep all).");
+
+DEFINE_bool(f2m_compress_columns, false, "Encode the sample indices and the "
+                                         "values of the columns in memory "
+                                         "in in-memory trainning, which "
+                                         "cuts the memory and the memory "
+                                         "bandwidth of each epoch. By "
+                                         "default we set this flag to "
+                                         "false.");
+
+DEFINE_int32(f2m_num_parse_threads, 0, "Number of threads used to parse the "
+                                      "text file in in-memory trainning. "
+                                      "By default we use all the cores.");
+
 DEFINE_int32(f2m_batch_size, 1000, "Mini-batch size in each iteration. "
                                    "We set this flag to 1000 by defaul.");
 
+DEFINE_bool(f2m_resize_blocks, false, "Split or merge the stored blocks into "
+                                      "blocks of batch_size samples when "
+                                      "trainning, instead of using the "
+                                      "block size of the converted data. "
+                                      "By default we set this flag to "
+                                      "false.");
+
 DEFINE_bool(f2m_early_stop, false, "If trainning model using early-stop. "
                                   "By default we set this flag to false.");
 
@@ -224,6 +298,42 @@ bool ValidateCommandLineFlags() {
     flags_valid = false;
   }
 
+  // The shared_dataset is a file name.
+  if (FLAGS_f2m_shared_dataset.find('/') != std::string::npos) {
+    LOG(ERROR) << "The shared_dataset cannot contain '/'.";
+    flags_valid = false;
+  }
+
+  // The io_queue_depth must be greater than 0.
+  if (FLAGS_f2m_io_queue_depth <= 0) {
+    LOG(ERROR) << "The io_queue_depth must be greater than 0.";
+    flags_valid = false;
+  }
+
+  // The block_cache_size must be greater than or equal to 0.
+  if (FLAGS_f2m_block_cache_size < 0) {
+    LOG(ERROR) << "The block_cache_size must be greater than or equal to 0.";
+    flags_valid = false;
+  }
+
+  // The reblock_epochs must be greater than or equal to 0.
+  if (FLAGS_f2m_reblock_epochs < 0) {
+    LOG(ERROR) << "The reblock_epochs must be greater than or equal to 0.";
+    flags_valid = false;
+  }
+
+  // The negative_rate must be in (0, 1].
+  if (FLAGS_f2m_negative_rate <= 0 || FLAGS_f2m_negative_rate > 1) {
+    LOG(ERROR) << "The negative_rate must be in (0, 1].";
+    flags_valid = false;
+  }
+
+  // The num_parse_threads must be greater than or equal to 0.
+  if (FLAGS_f2m_num_parse_threads < 0) {
+    LOG(ERROR) << "The num_parse_threads must be greater than or equal to 0.";
+    flags_valid = false;
+  }
+
   // The batch size must be greater than 0.
   if (FLAGS_f2m_batch_size <= 0) {
     LOG(ERROR) << "The batch_size must be greater than 0.";
@@ -242,6 +352,15 @@ bool ValidateCommandLineFlags() {
 //------------------------------------------------------------------------------
 // Set the hyper_param
 //------------------------------------------------------------------------------
+
+// Use all the cores if f2m_num_parse_threads is 0.
+static int NumParseThreads() {
+  if (FLAGS_f2m_num_parse_threads > 0) {
+    return FLAGS_f2m_num_parse_threads;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
 void SetHyperParam(HyperParam& hyper_param) {
   // train or predict
   hyper_param.is_train = FLAGS_f2m_is_train;
@@ -306,8 +425,32 @@ void SetHyperParam(HyperParam& hyper_param) {
   hyper_param.num_folds = FLAGS_f2m_num_folds;
   // in-memory or on disk trainning
   hyper_param.in_memory_trainning = FLAGS_f2m_in_memory_trainning;
+  // binary cache
+  hyper_param.binary_cache = FLAGS_f2m_binary_cache;
+  // shared dataset
+  hyper_param.shared_dataset = FLAGS_f2m_shared_dataset;
+  // direct io
+  hyper_param.direct_io = FLAGS_f2m_direct_io;
+  // io queue depth
+  hyper_param.io_queue_depth = FLAGS_f2m_io_queue_depth;
+  // block cache size
+  hyper_param.block_cache_size = FLAGS_f2m_block_cache_size;
+  // shuffle
+  hyper_param.shuffle = FLAGS_f2m_shuffle;
+  // shuffle seed
+  hyper_param.shuffle_seed = FLAGS_f2m_shuffle_seed;
+  // reblock epochs
+  hyper_param.reblock_epochs = FLAGS_f2m_reblock_epochs;
+  // negative rate
+  hyper_param.negative_rate = FLAGS_f2m_negative_rate;
+  // compress columns
+  hyper_param.compress_columns = FLAGS_f2m_compress_columns;
+  // number of parse threads
+  hyper_param.num_parse_threads = NumParseThreads();
   // mini-batch size
   hyper_param.batch_size = FLAGS_f2m_batch_size;
+  // resize blocks
+  hyper_param.resize_blocks = FLAGS_f2m_resize_blocks;
   // early stop
   hyper_param.early_stop = FLAGS_f2m_early_stop;
   // sigmoid
@@ -353,13 +496,30 @@ std::string LogFilebase() {
 //------------------------------------------------------------------------------
 // Create object
 //------------------------------------------------------------------------------
-Reader* CreateReader() {
+Reader* CreateReader(bool is_train_set) {
   Reader* reader = nullptr;
   std::string reader_type =
     FLAGS_f2m_in_memory_trainning ? "memory" : "disk";
+  if (FLAGS_f2m_in_memory_trainning &&
+      (FLAGS_f2m_binary_cache || !FLAGS_f2m_shared_dataset.empty())) {
+    reader_type = "mmap";
+  } else if (!FLAGS_f2m_in_memory_trainning && FLAGS_f2m_direct_io) {
+    reader_type = "async";
+  }
   reader = CREATE_READER(reader_type.c_str());
   if (reader == nullptr) {
     LOG(ERROR) << "Cannot create Reader: " << reader_type;
+  } else {
+    reader->SetNumThreads(NumParseThreads());
+    reader->SetQueueDepth(FLAGS_f2m_io_queue_depth);
+    reader->SetSharedName(FLAGS_f2m_shared_dataset);
+    reader->SetCacheSize(static_cast<uint64>(FLAGS_f2m_block_cache_size) << 20);
+    reader->SetCompressColumns(FLAGS_f2m_compress_columns);
+    if (is_train_set) {
+      reader->SetShuffle(FLAGS_f2m_shuffle, FLAGS_f2m_shuffle_seed);
+      reader->SetReblockEpochs(FLAGS_f2m_reblock_epochs);
+      reader->SetNegativeRate(FLAGS_f2m_negative_rate);
+    }
   }
   return reader;
 }
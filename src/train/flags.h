@@ -61,7 +61,19 @@ DECLARE_int32(f2m_num_iteration);
 DECLARE_bool(f2m_cross_validation);
 DECLARE_int32(f2m_num_folds);
 DECLARE_bool(f2m_in_memory_trainning);
+DECLARE_bool(f2m_binary_cache);
+DECLARE_string(f2m_shared_dataset);
+DECLARE_bool(f2m_direct_io);
+DECLARE_int32(f2m_io_queue_depth);
+DECLARE_int32(f2m_block_cache_size);
+DECLARE_bool(f2m_shuffle);
+DECLARE_int32(f2m_shuffle_seed);
+DECLARE_int32(f2m_reblock_epochs);
+DECLARE_double(f2m_negative_rate);
+DECLARE_bool(f2m_compress_columns);
+DECLARE_int32(f2m_num_parse_threads);
 DECLARE_int32(f2m_batch_size);
+DECLARE_bool(f2m_resize_blocks);
 DECLARE_bool(f2m_early_stop);
 DECLARE_bool(f2m_sigmoid);
 DECLARE_string(f2m_log_filebase);
@@ -84,7 +96,11 @@ std::string LogFilebase();
 //-----------------------------------------------------------------------------
 // Invoke ValidateCommandLineFlags() before using the following accessors.
 //-----------------------------------------------------------------------------
-Reader* CreateReader();
+
+// Only the Reader of the trainning set shuffles, regroups and downsamples
+// the blocks. The Readers of the testing set and of the predicting keep
+// all the samples in the input order.
+Reader* CreateReader(bool is_train_set);
 Parser* CreateParser();
 Loss* CreateLoss();
 Updater* CreateUpdater();
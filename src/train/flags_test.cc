@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests flags.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/base/file_util.h"
+#include "src/base/scoped_ptr.h"
+#include "src/data/data_structure.h"
+#include "src/reader/binary_format.h"
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
+#include "src/train/flags.h"
+
+using std::vector;
+using std::string;
+
+namespace f2m {
+
+const string kTestfilename = "/tmp/test_flags.txt";
+const index_t kNumBlocks = 10;
+const index_t kNumSamples = 100;
+const int kNumEpochs = 3;
+
+// Write kNumBlocks column blocks of one feature column, and the Y of
+// block k is k.
+void WriteBlocks(const string& filename) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t k = 0; k < kNumBlocks; ++k) {
+    string block = "2\n";
+    for (index_t i = 0; i < kNumSamples; ++i) {
+      block += std::to_string(k) + " ";
+    }
+    block += "\n1 ";
+    for (index_t i = 0; i < kNumSamples; ++i) {
+      block += std::to_string(i) + ":0.5 ";
+    }
+    block += "\n";
+    WriteDataToDisk(file, block.c_str(), block.size());
+  }
+  WriteDataToDisk(file, "2\n", 2);
+  Close(file);
+}
+
+// Return the Y of the blocks of each epoch.
+vector<vector<index_t>> EpochOrders(Reader* reader) {
+  vector<vector<index_t>> orders(kNumEpochs);
+  DMatrix* matrix = nullptr;
+  for (int e = 0; e < kNumEpochs; ++e) {
+    while (reader->Samples(matrix)) {
+      orders[e].push_back((*matrix->Y[0])[0]);
+    }
+    reader->GoToHead();
+  }
+  return orders;
+}
+
+// The Reader of the testing set (or the predicting set) returns the
+// blocks in the input order, so the predictions are in the order of the
+// samples, even if the trainning set is shuffled.
+TEST(FlagsTest, CreateTestReader) {
+  WriteBlocks(kTestfilename);
+  FLAGS_f2m_shuffle = true;
+  scoped_ptr<Parser> parser(CreateParser());
+  vector<index_t> input_order(kNumBlocks);
+  for (index_t k = 0; k < kNumBlocks; ++k) {
+    input_order[k] = k;
+  }
+  const bool kBinaryCaches[] = { false, true };
+  for (bool binary_cache : kBinaryCaches) {
+    FLAGS_f2m_binary_cache = binary_cache;
+    scoped_ptr<Reader> test_reader(CreateReader(false));
+    test_reader->Initialize(kTestfilename, kNumSamples, parser.get(), LR);
+    vector<vector<index_t>> orders = EpochOrders(test_reader.get());
+    for (int e = 0; e < kNumEpochs; ++e) {
+      EXPECT_EQ(orders[e], input_order);
+    }
+    scoped_ptr<Reader> train_reader(CreateReader(true));
+    train_reader->Initialize(kTestfilename, kNumSamples, parser.get(), LR);
+    orders = EpochOrders(train_reader.get());
+    EXPECT_NE(orders[0], input_order);
+  }
+  RemoveFile(kTestfilename.c_str());
+  RemoveFile((kTestfilename + kBinaryCacheSuffix).c_str());
+}
+
+} // namespace f2m
@@ -20,8 +20,11 @@ Author: Chao Ma (mctt90@gmail.com)
 This file is the implementation of the train.h file.
 */
 
+#include <algorithm>
+#include <map>
 #include <string>
 #include <set>
+#include <thread>
 
 #include "src/train/train.h"
 
@@ -30,11 +33,12 @@ This file is the implementation of the train.h file.
 #include "src/base/scoped_ptr.h"
 #include "src/base/stringprintf.h"
 #include "src/base/math.h"
+#include "src/base/stl-util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 #include "src/data/model_parameters_in_column.h"
 #include "src/reader/reader.h"
-#include "src/reader/file_splitor.h"
+#include "src/reader/metadata.h"
 #include "src/reader/parser.h"
 #include "src/loss/loss.h"
 #include "src/update/updater.h"
@@ -50,9 +54,16 @@ using std::string;
 // F2M context, using poor guy's singleton.
 //------------------------------------------------------------------------------
 
-scoped_ptr<FileSpliter>& GetFileSpliter() {
-  static scoped_ptr<FileSpliter> spliter;
-  return spliter;
+// Readers that are initialized but not used yet, indexed by filename.
+std::map<string, Reader*>& GetReaders() {
+  static std::map<string, Reader*> readers;
+  return readers;
+}
+
+// Metadata of the trainning set.
+DatasetMeta& GetTrainMeta() {
+  static DatasetMeta meta;
+  return meta;
 }
 
 scoped_ptr<Parser>& GetParser() {
@@ -120,26 +131,54 @@ bool Initialize() {
 
   LOG(PRINT) << "Initialize Parser successfully.";
 
-  // Read problem to get max_feature and num_field
-  scoped_ptr<Reader> reader(CreateReader());
-  // Read training file
-  reader->Initialize(GetHyperParam()->train_set_file,
-                     GetHyperParam()->batch_size,
-                     GetParser().get(),
-                    GetHyperParam()->model_type);
-  //printf("a\n");
-  ReadProblem(reader.get(),
-               &(GetHyperParam()->max_feature),
-               &(GetHyperParam()->num_field));
-  // Read test set
-  //printf("b\n");
-  reader->Initialize(GetHyperParam()->test_set_file,
-                     GetHyperParam()->batch_size,
-                     GetParser().get(),
-                     GetHyperParam()->model_type);
-  ReadProblem(reader.get(),
-              &(GetHyperParam()->max_feature),
-              &(GetHyperParam()->num_field));
+  // Read problem to get max_feature and num_field. We trust the
+  // metadata sidecar of the data file if it is up to date. Otherwise,
+  // we scan the data file (or all its shards), and write its sidecar.
+  // The Readers are kept for StartTrainWork() and StartPredictWork(),
+  // so that each file is only parsed once. The trainning set and the
+  // testing set are loaded in parallel.
+  const string data_files[2] = { GetHyperParam()->train_set_file,
+                                 GetHyperParam()->test_set_file };
+  bool used[2] = { GetHyperParam()->is_train,
+                   !GetHyperParam()->is_train ||
+                   !GetHyperParam()->cross_validation };
+  DatasetMeta metas[2];
+  Reader* readers[2] = { nullptr, nullptr };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 2; ++i) {
+    // The same file is only loaded once.
+    if (i == 1 && data_files[1] == data_files[0]) {
+      break;
+    }
+    // Only the samples of the trainning set are shuffled, regrouped
+    // and downsampled. The testing set (or the predicting set) keeps
+    // its input order.
+    readers[i] = CreateReader(i == 0 && GetHyperParam()->is_train);
+    threads.push_back(std::thread(LoadProblem, data_files[i], used[i],
+                                  readers[i], &metas[i]));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  if (readers[1] == nullptr) {
+    metas[1] = metas[0];
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (readers[i] == nullptr) {
+      continue;
+    }
+    if (readers[i]->IsInitialized()) {
+      GetReaders()[data_files[i]] = readers[i];
+    } else {
+      delete readers[i];
+    }
+  }
+  index_t max_feature = std::max(metas[0].max_feature, metas[1].max_feature);
+  int num_field = std::max(metas[0].num_field, metas[1].num_field);
+  GetTrainMeta() = metas[0];
+  // ceil for AVX
+  GetHyperParam()->max_feature = ((max_feature + 8) / 8.0) * 8;
+  GetHyperParam()->num_field = num_field;
 
   if (GetHyperParam()->model_type == FFM) {
     GetHyperParam()->num_param = (GetHyperParam()->max_feature)
@@ -205,101 +244,178 @@ bool Initialize() {
     LOG(PRINT) << "Initialize Validator successfully.";
   }
 
-  // Create the FileSpliter
-  if (GetHyperParam()->is_train) {
-    if (GetHyperParam()->cross_validation) {
-      GetFileSpliter().reset(new FileSpliter);
-      if (GetFileSpliter().get() == nullptr) {
-        LOG(ERROR) << "Create FileSpliter error.";
-        bo = false;
-      }
-      LOG(PRINT) << "Initialize FileSpliter successfully.";
-    }
-  }
-
   return bo;
 }
 
 void Finalize() {
+  // Delete the Readers that are not used.
+  STLDeleteValuesAndClear(&GetReaders());
 
   LOG(PRINT) << "Finalize successfully.";
 }
 
-// Read problem to get the max_feature and num_field
-void ReadProblem(Reader* reader, index_t* max_feature, int* num_field) {
-  index_t tmp_feature = 0;
-  int tmp_field = 0;
+// Return the Reader of the filename, which is created and initialized
+// if it is not in GetReaders().
+Reader* GetReader(const string& filename, bool is_train_set) {
+  std::map<string, Reader*>& readers = GetReaders();
+  if (readers.find(filename) == readers.end()) {
+    Reader* reader = CreateReader(is_train_set);
+    InitializeReader(filename, reader);
+    readers[filename] = reader;
+  }
+  return readers[filename];
+}
+
+// Take the Reader of the filename from GetReaders(), and then the
+// caller owns the Reader.
+Reader* TakeReader(const string& filename, bool is_train_set) {
+  Reader* reader = GetReader(filename, is_train_set);
+  GetReaders().erase(filename);
+  return reader;
+}
+
+// Get the metadata of the data file from its sidecar, or by scanning
+// the data file. If the data file is used, the reader is initialized.
+void LoadProblem(const string& filename,
+                 bool used,
+                 Reader* reader,
+                 DatasetMeta* meta) {
+  CHECK_NOTNULL(reader);
+  bool sharded = IsShardedPath(filename);
+  if (!sharded && ReadMetadata(filename, meta)) {
+    LOG(INFO) << "Read metadata of " << filename;
+    if (used) {
+      InitializeReader(filename, reader);
+    }
+    return;
+  }
+  // The metadata is of all the samples, but the reader of the trainning
+  // set may downsample them. So we scan the data file by a new plain
+  // Reader that keeps all the samples, and the reader is initialized
+  // before it is released, so the reader derives its blocks from the
+  // same parsed Dataset.
+  scoped_ptr<Reader> scan_reader(CreateReader(false));
+  CHECK_NOTNULL(scan_reader.get());
+  scan_reader->SetCompressColumns(false);
+  InitializeReader(filename, scan_reader.get());
+  ReadProblem(scan_reader.get(), meta);
+  if (used) {
+    InitializeReader(filename, reader);
+  }
+  // The sidecar of a directory or a glob pattern cannot tell whether
+  // a shard has been changed, so we always scan the shards.
+  if (!sharded && !WriteMetadata(filename, *meta)) {
+    LOG(WARNING) << "Cannot write the metadata of " << filename;
+  }
+}
+
+// Initialize the reader for the data file.
+void InitializeReader(const string& filename, Reader* reader) {
+  reader->Initialize(filename,
+                     GetHyperParam()->batch_size,
+                     GetParser().get(),
+                     GetHyperParam()->model_type);
+}
+
+// Read problem to get the metadata of the dataset. We scan the blocks
+// by a new cursor if possible, so the scan is not an epoch of the
+// Reader, e.g., it is not counted for the reblocking.
+void ReadProblem(Reader* reader, DatasetMeta* meta) {
+  *meta = DatasetMeta();
+  scoped_ptr<BlockCursor> cursor(reader->NewCursor());
   DMatrix* matrix = nullptr;
-  //printf("read1\n");
   for (;;) {
-    int record_num = reader->Samples(matrix);
-    if (record_num == 0) {
-      reader->GoToHead();
+    const ColumnBlock* block = nullptr;
+    if (cursor.get() != nullptr) {
+      block = cursor->Next();
+    } else if (reader->Samples(matrix) != 0) {
+      block = matrix->block;
+      CHECK_NOTNULL(block);
+    }
+    if (block == nullptr) {
       break;
     }
-     //printf("read1.5\n");
-    for (size_t i = 0; i < matrix->row_len; ++i) {
-      SparseRow* row = matrix->row[i];
-      if (row->id > tmp_feature) {
-          tmp_feature = row->id;
+    for (size_t i = 0; i < block->num_columns; ++i) {
+      if (block->col_ids[i] > meta->max_feature) {
+        meta->max_feature = block->col_ids[i];
       }
     }
+    // The fields are numbered from 0 (the bias column).
+    if (block->col_fields != nullptr) {
+      for (size_t i = 0; i < block->num_columns; ++i) {
+        int field = static_cast<int>(block->col_fields[i]);
+        if (field >= meta->num_field) {
+          meta->num_field = field + 1;
+        }
+      }
+    }
+    meta->num_blocks++;
+    meta->num_samples += block->num_samples;
+    meta->nnz += block->nnz;
+  }
+  if (cursor.get() == nullptr) {
+    reader->GoToHead();
   }
-   //printf("read2\n");
-  // ceil for AVX
-  *max_feature = ((tmp_feature + 8) / 8.0) * 8;
-  *num_field = tmp_field;
 }
 
 //------------------------------------------------------------------------------
 // Train model
 //------------------------------------------------------------------------------
 void StartTrainWork() {
-  // Split trainning file into K folds if using cross-validation
-  if (GetHyperParam()->cross_validation) {
-    GetFileSpliter()->split(GetHyperParam()->train_set_file,
-                            GetHyperParam()->num_folds);
-    LOG(PRINT) << "Split file successfully.";
-  }
-
   // We train K times if we using a K-folds cross-validation
   int train_num = GetHyperParam()->cross_validation ?
                   GetHyperParam()->num_folds : 1;
 
-  // Init file list
-  vector<string> file_list;
+  // Init Reader. The Readers of the train set and the test set may
+  // have been initialized by ReadProblem().
+  vector<Reader*> reader_list;
+  vector<Reader*> validate_list;
   if (GetHyperParam()->cross_validation) {
-    file_list.resize(train_num);
-    for (int i = 0; i < train_num; ++i) {
-      file_list[i] = StringPrintf("%s_%d",
-                                  GetHyperParam()->train_set_file.c_str(),
-                                  i);
+    // Each fold is a range of blocks of the trainning set. The fold is
+    // validated by a Reader that keeps all its samples, and trained by
+    // a Reader that may shuffle, regroup and downsample them. The
+    // in-memory Readers of the folds derive their blocks from one
+    // parsed copy of the file, which is kept by a plain Reader until
+    // all the folds are initialized.
+    size_t num_blocks = GetTrainMeta().num_blocks;
+    if (num_blocks < train_num) {
+      LOG(FATAL) << "Cannot split " << num_blocks << " blocks into "
+                 << train_num << " folds.";
+    }
+    scoped_ptr<Reader> source_reader(CreateReader(false));
+    source_reader->SetCompressColumns(false);
+    InitializeReader(GetHyperParam()->train_set_file, source_reader.get());
+    reader_list.resize(train_num);
+    validate_list.resize(train_num);
+    for (int k = 0; k < train_num; ++k) {
+      validate_list[k] = CreateReader(false);
+      validate_list[k]->SetBlockRange(num_blocks * k / train_num,
+                                      num_blocks * (k + 1) / train_num);
+      InitializeReader(GetHyperParam()->train_set_file, validate_list[k]);
     }
+    for (int k = 0; k < train_num; ++k) {
+      reader_list[k] = CreateReader(true);
+      reader_list[k]->SetBlockRange(num_blocks * k / train_num,
+                                    num_blocks * (k + 1) / train_num);
+      InitializeReader(GetHyperParam()->train_set_file, reader_list[k]);
+    }
+    STLDeleteValuesAndClear(&GetReaders());
   } else {
-    file_list.resize(2);
-    file_list[0] = GetHyperParam()->train_set_file;
-    file_list[1] = GetHyperParam()->test_set_file;
+    // If the testing set is the trainning set, the Reader of the
+    // trainning set is taken first, and the testing set gets a new
+    // Reader in the input order.
+    reader_list.push_back(TakeReader(GetHyperParam()->train_set_file, true));
+    reader_list.push_back(TakeReader(GetHyperParam()->test_set_file, false));
   }
 
-  // Init Reader
-  vector<Reader*> reader_list;
-  if (GetHyperParam()->cross_validation) {
-    reader_list.resize(train_num);
-    for (int i = 0; i < train_num; ++i) {
-      reader_list[i] = CreateReader();
-      reader_list[i]->Initialize(file_list[i],
-                                 GetHyperParam()->batch_size,
-                                 GetParser().get(),
-                                 GetHyperParam()->model_type);
+  // The metadata and the block ranges use the stored blocks, so the
+  // blocks are resized after the readers are initialized.
+  if (GetHyperParam()->resize_blocks) {
+    for (size_t i = 0; i < reader_list.size(); ++i) {
+      reader_list[i]->SetBlockSize(GetHyperParam()->batch_size);
     }
-  } else {
-    reader_list.resize(2);
-    for (int i = 0; i < 2; ++i) {
-      reader_list[i] = CreateReader();
-      reader_list[i]->Initialize(file_list[i],
-                                 GetHyperParam()->batch_size,
-                                 GetParser().get(),
-                                 GetHyperParam()->model_type);
+    for (size_t i = 0; i < validate_list.size(); ++i) {
+      validate_list[i]->SetBlockSize(GetHyperParam()->batch_size);
     }
   }
 
@@ -307,14 +423,14 @@ void StartTrainWork() {
 
   // Train
   if (GetHyperParam()->cross_validation) {
-    CVTrain(reader_list, train_num);
-    // Clear the tmp files
-    for (int i = 0; i < train_num; ++i) {
-      RemoveFile(file_list[i].c_str());
-    }
+    CVTrain(reader_list, validate_list, train_num);
   } else {
     Train(reader_list);
   }
+
+  // Delete the readers, which may be reading data in background.
+  STLDeleteElementsAndClear(&reader_list);
+  STLDeleteElementsAndClear(&validate_list);
 }
 
 //------------------------------------------------------------------------------
@@ -337,6 +453,11 @@ void Train(const vector<Reader*>& reader_list) {
                                    reader_list[0],
                                    reader_list[1],
                                    count);
+      uint64 num_hits = 0, num_misses = 0;
+      if (reader_list[0]->TakeCacheStats(&num_hits, &num_misses)) {
+        LOG(PRINT) << "block cache hits: " << num_hits
+                   << "  misses: " << num_misses;
+      }
       // Using early stopping
       if (GetHyperParam()->early_stop && current_loss > tmp_loss) {
         LOG(PRINT) << "Early stop at iteration " << count
@@ -367,14 +488,16 @@ void Train(const vector<Reader*>& reader_list) {
 //------------------------------------------------------------------------------
 // Train with Cross-validation
 //------------------------------------------------------------------------------
-void CVTrain(const vector<Reader*>& reader_list, int train_num) {
+void CVTrain(const vector<Reader*>& reader_list,
+             const vector<Reader*>& validate_list,
+             int train_num) {
   LOG(PRINT) << "Start to cross validation.";
   DMatrix* matrix = nullptr;
   real_t average_loss = 0.0;
   // K folds
   for (int k = 0; k < train_num; ++k) {
     LOG(PRINT) << "K folds: " << k << "/" << train_num;
-    Reader* validate_reader = reader_list[k];
+    Reader* validate_reader = validate_list[k];
     // Reset current model
     GetModel()->Reset(IfGaussian());
     int reader_id = 0;
@@ -420,18 +543,15 @@ void CVTrain(const vector<Reader*>& reader_list, int train_num) {
 //------------------------------------------------------------------------------
 
 void StartPredictWork() {
-  scoped_ptr<Reader> reader(CreateReader());
-  reader->Initialize(GetHyperParam()->test_set_file,
-                     GetHyperParam()->batch_size,
-                     GetParser().get(),
-                     GetHyperParam()->model_type);
+  scoped_ptr<Reader> reader(TakeReader(GetHyperParam()->test_set_file,
+                                       false));
   LOG(PRINT) << "Start predication work.";
   DMatrix* matrix = nullptr;
   std::vector<real_t> pred;
   FILE* file = OpenFileOrDie("./result.txt", "w");
   while (reader->Samples(matrix)) {
-    if (pred.size() != matrix->row_len) {
-      pred.resize(matrix->row_len);
+    if (pred.size() != matrix->Y[0]->size()) {
+      pred.resize(matrix->Y[0]->size());
     }
     GetLoss()->Predict(matrix, GetModel().get(), pred);
     if (GetHyperParam()->sigmoid) {
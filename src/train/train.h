@@ -23,8 +23,10 @@ This file defines the control process in f2m.
 #ifndef F2M_TRAIN_TRAIN_H_
 #define F2M_TRAIN_TRAIN_H_
 
+#include <string>
 #include <vector>
 
+#include "src/reader/metadata.h"
 #include "src/reader/reader.h"
 
 namespace f2m {
@@ -36,7 +38,27 @@ bool Initialize();
 
 void Finalize();
 
-void ReadProblem(Reader* reader, index_t* max_feature, int* num_field);
+// Get the metadata of the data file from its sidecar, or by scanning
+// all its samples by a new Reader. The reader is initialized if the
+// data file is used by the task.
+void LoadProblem(const std::string& filename,
+                 bool used,
+                 Reader* reader,
+                 DatasetMeta* meta);
+
+// Initialize the reader for the data file (or the data path of shards).
+void InitializeReader(const std::string& filename, Reader* reader);
+
+// Scan all the blocks of the Reader to get the metadata.
+void ReadProblem(Reader* reader, DatasetMeta* meta);
+
+// Return the initialized Reader of the data file. The Reader is kept
+// by f2m until it is taken by TakeReader(). A new Reader is created by
+// CreateReader(is_train_set).
+Reader* GetReader(const std::string& filename, bool is_train_set);
+
+// Take the Reader of the data file, and the caller owns it.
+Reader* TakeReader(const std::string& filename, bool is_train_set);
 
 //------------------------------------------------------------------------------
 // Train model
@@ -51,7 +73,9 @@ void Train(const std::vector<Reader*>& reader_list);
 //------------------------------------------------------------------------------
 // Train with cross-validation
 //------------------------------------------------------------------------------
-void CVTrain(const std::vector<Reader*>& reader_list, int train_num);
+void CVTrain(const std::vector<Reader*>& reader_list,
+             const std::vector<Reader*>& validate_list,
+             int train_num);
 
 //------------------------------------------------------------------------------
 // Start predict work
@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2016 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+Author: Chao Ma (mctt90@gmail.com)
+
+This file tests train.h
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "src/base/file_util.h"
+#include "src/data/data_structure.h"
+#include "src/reader/metadata.h"
+#include "src/reader/parser.h"
+#include "src/reader/reader.h"
+#include "src/train/train.h"
+
+using std::string;
+
+namespace f2m {
+
+const string kTestfilename = "/tmp/test_train.txt";
+const index_t kNumBlocks = 10;
+const index_t kNumSamples = 100;
+
+Parser* parser_lr = new LibsvmParser;
+Parser* parser_ffm = new FFMParser;
+
+// Write kNumBlocks column blocks of two feature columns, and the Y of
+// block k is k. The libffm blocks give the column j the field j.
+void WriteBlocks(const string& filename, bool has_field = false) {
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  for (index_t k = 0; k < kNumBlocks; ++k) {
+    string block = "3\n";
+    for (index_t i = 0; i < kNumSamples; ++i) {
+      block += std::to_string(k) + " ";
+    }
+    block += "\n";
+    for (index_t j = 1; j <= 2; ++j) {
+      if (has_field) {
+        block += std::to_string(j) + ":";
+      }
+      block += std::to_string(j) + " ";
+      for (index_t i = 0; i < kNumSamples; ++i) {
+        block += std::to_string(i) + ":0.5 ";
+      }
+      block += "\n";
+    }
+    WriteDataToDisk(file, block.c_str(), block.size());
+  }
+  WriteDataToDisk(file, "3\n", 2);
+  Close(file);
+}
+
+// Return true if all the samples of each block of the epoch have the
+// same Y, i.e., the blocks are the stored ones.
+bool IsStoredEpoch(Reader* reader) {
+  DMatrix* matrix = nullptr;
+  bool stored = true;
+  index_t num_blocks = 0;
+  while (reader->Samples(matrix)) {
+    const std::vector<real_t>& Y = *matrix->Y[0];
+    for (size_t i = 0; i < Y.size(); ++i) {
+      stored = stored && Y[i] == Y[0];
+    }
+    ++num_blocks;
+  }
+  reader->GoToHead();
+  EXPECT_EQ(num_blocks, kNumBlocks);
+  return stored;
+}
+
+// The scan of ReadProblem() is not an epoch of the Reader, so the
+// samples are not regrouped before the first epoch of the trainning.
+TEST(TrainTest, ReadProblem) {
+  WriteBlocks(kTestfilename);
+  InmemReader reader;
+  reader.SetReblockEpochs(1);
+  reader.Initialize(kTestfilename, kNumSamples, parser_lr, LR);
+  DatasetMeta meta;
+  ReadProblem(&reader, &meta);
+  EXPECT_EQ(meta.max_feature, 2);
+  EXPECT_EQ(meta.num_blocks, kNumBlocks);
+  EXPECT_EQ(meta.num_samples, kNumBlocks * kNumSamples);
+  EXPECT_EQ(meta.nnz, kNumBlocks * kNumSamples * 3);
+  EXPECT_EQ(meta.num_field, 0);
+  EXPECT_TRUE(IsStoredEpoch(&reader));
+  // The first epoch of the trainning is counted.
+  EXPECT_FALSE(IsStoredEpoch(&reader));
+  RemoveFile(kTestfilename.c_str());
+}
+
+// The fields are the field 0 of the bias column and the fields 1 and 2.
+TEST(TrainTest, ReadProblemFields) {
+  WriteBlocks(kTestfilename, true);
+  InmemReader reader;
+  reader.Initialize(kTestfilename, kNumSamples, parser_ffm, FFM);
+  DatasetMeta meta;
+  ReadProblem(&reader, &meta);
+  EXPECT_EQ(meta.max_feature, 2);
+  EXPECT_EQ(meta.num_field, 3);
+  RemoveFile(kTestfilename.c_str());
+}
+
+} // namespace f2m
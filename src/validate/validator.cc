@@ -24,6 +24,7 @@ This file is the implementation of the Validator.
 #include <iostream>
 
 #include "src/validate/validator.h"
+#include "src/base/scoped_ptr.h"
 #include "src/data/data_structure.h"
 
 namespace f2m {
@@ -45,24 +46,55 @@ real_t Validator::Validate(Model* model, Reader* rd_train, Reader* rd_val, int i
   return train_loss;
 }
 
-// Give current model and data, return evaluated loss.
+// Return the next block of the cursor, or of the Reader if we cannot
+// create a cursor. Return false at the end of data.
+static bool NextMatrix(Reader* reader,
+                       BlockCursor* cursor,
+                       DMatrix* buffer,
+                       std::vector<real_t>* labels,
+                       DMatrix* &matrix) {
+  if (cursor == nullptr) {
+    return reader->Samples(matrix) != 0;
+  }
+  const ColumnBlock* block = cursor->Next();
+  if (block == nullptr) {
+    return false;
+  }
+  buffer->SetBlock(block, labels);
+  matrix = buffer;
+  return true;
+}
+
+// Give current model and data, return evaluated loss. We scan the
+// data by a new cursor if possible, so the position of the Reader is
+// not changed by the validation.
 real_t Validator::validate(Model* model, Reader* reader) {
-  reader->GoToHead();
+  scoped_ptr<BlockCursor> cursor(reader->NewCursor());
+  if (cursor.get() == nullptr) {
+    reader->GoToHead();
+  }
+  DMatrix buffer;
+  std::vector<real_t> labels;
   DMatrix* matrix = nullptr;
   std::vector<real_t> pred;
   real_t loss_val = 0.0;
-  uint64 total_size = 0;
+  real_t total_weight = 0.0;
   // Read until end of file
-  while (reader->Samples(matrix)) {
+  while (NextMatrix(reader, cursor.get(), &buffer, &labels, matrix)) {
     if (matrix->Y[0]->size() != pred.size()) {
       pred.resize(matrix->Y[0]->size());
     }
     loss_->Predict(matrix, model, pred);
-    loss_val += loss_->Evaluate(pred, (*matrix->Y[0]));
-    total_size += matrix->Y[0]->size();
+    // The downsampled samples are weighted (see Dataset::Downsample()).
+    const ColumnBlock* block = matrix->block;
+    CHECK_NOTNULL(block);
+    loss_val += loss_->Evaluate(pred, (*matrix->Y[0]), block->weights);
+    total_weight += TotalWeight(*block);
+  }
+  loss_val /= total_weight;
+  if (cursor.get() == nullptr) {
+    reader->GoToHead();
   }
-  loss_val /= total_size;
-  reader->GoToHead();
 
   return loss_val;
 }